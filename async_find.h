@@ -0,0 +1,49 @@
+#ifndef _GRAVEYARD_ASYNC_FIND_H_
+#define _GRAVEYARD_ASYNC_FIND_H_
+
+// Coroutine lookups that overlap their cache misses.
+//
+// `async_find(table, key)` prefetches the key's bucket and suspends
+// before probing.  Run many of them together with `RunInterleaved`,
+// or `co_await` them from other `Task`s (so that lookups issued deep
+// in a call chain of coroutines are interleaved too):
+//
+//   yobiduck::RunInterleaved(
+//       keys.size(), 16,
+//       [&](size_t i) { return yobiduck::async_find(set, keys[i]); },
+//       [&](size_t i, auto it) { found[i] = it != set.end(); });
+//
+// Requires C++20 coroutines; this header is empty otherwise.
+
+#include "internal/task.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+
+namespace yobiduck {
+
+using internal::RunInterleaved;
+using internal::Task;
+
+// Task<const_iterator> async_find(const Table &table, const K &key);
+//
+// Effect: Returns a task that finds `key` in `table`, suspending once
+// after prefetching the memory that the probe reads first.
+//
+// Requires: `table` and `key` outlive the task, and `table` isn't
+// modified while the task is in flight.
+template <class Table, class K>
+Task<typename Table::const_iterator> async_find(const Table &table,
+                                                const K &key) {
+  const size_t hash = table.hash_function()(key);
+  table.prefetch(hash);
+  co_await std::suspend_always{};
+  co_return table.find(key, hash);
+}
+
+} // namespace yobiduck
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif // _GRAVEYARD_ASYNC_FIND_H_
@@ -0,0 +1,93 @@
+#include "async_find.h"
+
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graveyard_map.h"
+#include "graveyard_set.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::ElementsAreArray;
+using yobiduck::async_find;
+using yobiduck::RunInterleaved;
+using yobiduck::Task;
+
+TEST(AsyncFind, Interleaved) {
+  yobiduck::GraveyardSet<uint64_t> set;
+  for (uint64_t i = 0; i < 1000; i += 2) {
+    set.insert(i);
+  }
+  std::vector<uint64_t> keys;
+  std::vector<bool> expected;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    keys.push_back(i * 7 % 1000);
+    expected.push_back(keys.back() % 2 == 0);
+  }
+  for (size_t width : {1, 3, 16, 2000}) {
+    std::vector<bool> found(keys.size());
+    std::vector<size_t> calls(keys.size());
+    RunInterleaved(
+        keys.size(), width, [&](size_t i) { return async_find(set, keys[i]); },
+        [&](size_t i, auto it) {
+          ++calls[i];
+          found[i] = it != set.end();
+          if (found[i]) {
+            EXPECT_EQ(*it, keys[i]);
+          }
+        });
+    EXPECT_THAT(found, ElementsAreArray(expected)) << "width=" << width;
+    EXPECT_THAT(calls, ElementsAreArray(std::vector<size_t>(keys.size(), 1)));
+  }
+}
+
+// A lookup awaited two calls deep.
+Task<int> Lookup(const yobiduck::GraveyardMap<std::string, int> &map,
+                 const std::string &key) {
+  auto it = co_await async_find(map, key);
+  co_return it == map.end() ? -1 : it->second;
+}
+
+Task<int> SumOfLookups(const yobiduck::GraveyardMap<std::string, int> &map,
+                       const std::string &a, const std::string &b) {
+  int x = co_await Lookup(map, a);
+  int y = co_await Lookup(map, b);
+  co_return x + y;
+}
+
+TEST(AsyncFind, NestedTasks) {
+  yobiduck::GraveyardMap<std::string, int> map;
+  map["a"] = 1;
+  map["b"] = 10;
+  map["c"] = 100;
+  const std::vector<std::string> keys = {"a", "b", "c", "d"};
+  std::vector<int> sums(keys.size() * keys.size());
+  RunInterleaved(
+      sums.size(), 5,
+      [&](size_t i) {
+        return SumOfLookups(map, keys[i / keys.size()], keys[i % keys.size()]);
+      },
+      [&](size_t i, int sum) { sums[i] = sum; });
+  const int values[] = {1, 10, 100, -1};
+  for (size_t i = 0; i < sums.size(); ++i) {
+    EXPECT_EQ(sums[i], values[i / keys.size()] + values[i % keys.size()]);
+  }
+}
+
+Task<void> Throws() {
+  co_await std::suspend_always{};
+  throw std::runtime_error("oops");
+}
+
+TEST(AsyncFind, VoidTasksAndExceptions) {
+  size_t done = 0;
+  RunInterleaved(
+      3, 2, [](size_t) -> Task<void> { co_return; }, [&](size_t) { ++done; });
+  EXPECT_EQ(done, 3);
+  EXPECT_THROW(RunInterleaved(
+                   1, 1, [](size_t) { return Throws(); }, [](size_t) {}),
+               std::runtime_error);
+}
@@ -0,0 +1,117 @@
+// Compares lookup throughput of plain `find` with interleaved
+// `async_find` coroutines, on a table much larger than the last-level
+// cache (so nearly every lookup misses).
+//
+// Two workloads: independent lookups (where the processor already
+// overlaps the misses of consecutive `find`s on its own), and chains
+// of lookups in which each key is the value found by the previous
+// lookup (as in a request handler), where only interleaving the
+// chains overlaps the misses.
+
+#include <algorithm> // for min, shuffle
+#include <chrono>    // for steady_clock
+#include <cstddef>   // for size_t
+#include <cstdint>   // for uint64_t
+#include <cstdio>    // for printf
+#include <random>    // for mt19937_64
+#include <vector>
+
+#include "async_find.h"
+#include "graveyard_map.h"
+
+namespace {
+
+using Map = yobiduck::GraveyardMap<uint64_t, uint64_t>;
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns the best-of-3 nanoseconds per lookup of `f()`, which does
+// `lookups` lookups.
+template <class F> double Time(size_t lookups, F f) {
+  double best = 1e9;
+  for (int trial = 0; trial < 3; ++trial) {
+    double start = Now();
+    f();
+    best = std::min(best, (Now() - start) / lookups);
+  }
+  return best * 1e9;
+}
+
+constexpr size_t kChainLength = 100;
+
+// Follows `kChainLength` links from `key`, and returns the last key.
+yobiduck::Task<uint64_t> Chain(const Map &map, uint64_t key) {
+  for (size_t i = 0; i < kChainLength; ++i) {
+    key = (co_await yobiduck::async_find(map, key))->second;
+  }
+  co_return key;
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kSize = size_t(1) << 25;
+  constexpr size_t kLookups = 4000000;
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(kSize);
+  for (uint64_t &key : keys) {
+    key = rng();
+  }
+  // Each key maps to the next key of a random cycle through all of
+  // them.
+  Map map;
+  map.reserve(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    map[keys[i]] = keys[(i + 1) % kSize];
+  }
+  std::shuffle(keys.begin(), keys.end(), rng);
+  keys.resize(kLookups);
+  printf("table of %zu values, %zu MiB\n", map.size(),
+         map.GetAllocatedMemorySize() >> 20);
+  const size_t kWidths[] = {1, 4, 8, 16, 32};
+  uint64_t sum = 0;
+
+  printf("independent lookups\n");
+  double ns = Time(kLookups, [&]() {
+    for (uint64_t key : keys) {
+      sum += map.find(key)->second;
+    }
+  });
+  printf("find:                %6.1fns\n", ns);
+  for (size_t width : kWidths) {
+    ns = Time(kLookups, [&]() {
+      yobiduck::RunInterleaved(
+          kLookups, width,
+          [&](size_t i) { return yobiduck::async_find(map, keys[i]); },
+          [&](size_t, auto it) { sum += it->second; });
+    });
+    printf("async_find width=%-2zu %6.1fns\n", width, ns);
+  }
+
+  printf("chains of %zu dependent lookups\n", kChainLength);
+  const size_t chains = kLookups / kChainLength;
+  ns = Time(kLookups, [&]() {
+    for (size_t c = 0; c < chains; ++c) {
+      uint64_t key = keys[c];
+      for (size_t i = 0; i < kChainLength; ++i) {
+        key = map.find(key)->second;
+      }
+      sum += key;
+    }
+  });
+  printf("find:                %6.1fns\n", ns);
+  for (size_t width : kWidths) {
+    ns = Time(kLookups, [&]() {
+      yobiduck::RunInterleaved(
+          chains, width, [&](size_t c) { return Chain(map, keys[c]); },
+          [&](size_t, uint64_t key) { sum += key; });
+    });
+    printf("async_find width=%-2zu %6.1fns\n", width, ns);
+  }
+  // Keep `sum` live.
+  printf("(sum %lu)\n", sum);
+}
@@ -0,0 +1,64 @@
+// Measures what `BackgroundRehashTable` does to insert latency: inserts
+// 10 million random keys one at a time into a `HashTable` and into a
+// `BackgroundRehashTable`, and prints the total time and the slowest
+// inserts (for the `HashTable`, the ones that grew the table).
+
+#include <algorithm>  // for sort
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to, greater
+#include <memory>     // for allocator
+#include <random>     // for mt19937_64
+#include <vector>
+
+#include "hashers.h"
+#include "internal/background_rehash.h"
+#include "internal/hash_table.h"
+
+namespace {
+
+struct Traits : public yobiduck::internal::HashTableTraits<
+                    uint64_t, void, yobiduck::MixHash,
+                    std::equal_to<uint64_t>, std::allocator<uint64_t>> {};
+
+template <class Table>
+void Run(const char *name, const std::vector<uint64_t> &keys) {
+  Table table;
+  std::vector<uint64_t> latencies(keys.size());
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    auto before = std::chrono::steady_clock::now();
+    table.insert(keys[i]);
+    latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - before)
+                       .count();
+  }
+  double total = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  std::sort(latencies.begin(), latencies.end(), std::greater<uint64_t>());
+  printf("  %-10s total %6.3fs  slowest inserts", name, total);
+  for (size_t i = 0; i < 3; ++i) {
+    printf(" %7.2fms", latencies[i] * 1e-6);
+  }
+  printf("  p99.99 %6.2fus\n", latencies[latencies.size() / 10000] * 1e-3);
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kSize = 10000000;
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(kSize);
+  for (uint64_t &key : keys) {
+    key = rng();
+  }
+  printf("%zu keys\n", kSize);
+  for (int trial = 0; trial < 3; ++trial) {
+    Run<yobiduck::internal::HashTable<Traits>>("foreground", keys);
+    Run<yobiduck::internal::BackgroundRehashTable<Traits>>("background",
+                                                           keys);
+  }
+}
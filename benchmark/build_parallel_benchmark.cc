@@ -0,0 +1,62 @@
+// Measures building a `GraveyardSet` of 20 million random `uint64_t`s
+// by inserting them one at a time (into a reserved set), by
+// `GraveyardSet::Build`, and by `GraveyardSet::BuildParallel` with 2 to
+// 32 threads.
+
+#include <chrono>  // for steady_clock
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <cstdio>  // for printf
+#include <random>  // for mt19937_64
+#include <vector>
+
+#include "graveyard_set.h"
+#include "hashers.h"
+
+namespace {
+
+using Set = yobiduck::GraveyardSet<uint64_t, yobiduck::MixHash>;
+
+constexpr size_t kSize = 20000000;
+
+template <class F> void Report(const char *name, F build) {
+  double best = 0;
+  for (int trial = 0; trial < 3; ++trial) {
+    auto start = std::chrono::steady_clock::now();
+    Set set = build();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if (set.size() == 0) {
+      printf("empty\n");
+    }
+    if (trial == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  printf("%-16s %6.3fs\n", name, best);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> values(kSize);
+  for (uint64_t &value : values) {
+    value = rng();
+  }
+  Report("insert", [&]() {
+    Set set;
+    set.reserve(values.size());
+    for (uint64_t value : values) {
+      set.insert(value);
+    }
+    return set;
+  });
+  Report("Build", [&]() { return Set::Build(values); });
+  for (size_t threads = 2; threads <= 32; threads *= 2) {
+    char name[32];
+    snprintf(name, sizeof(name), "BuildParallel/%zu", threads);
+    Report(name, [&]() { return Set::BuildParallel(values, threads); });
+  }
+}
@@ -0,0 +1,102 @@
+// Measures the insert throughput of `ConcurrentInsertTable` against a
+// `GraveyardSet` behind one mutex, at 1 to 64 threads.  The threads
+// insert 16 million random keys between them, drawn from 8 million, so
+// that about a third of the inserts find their key present (as when
+// collecting the distinct keys of a stream).  Both tables start empty
+// and grow as they go.
+
+#include <algorithm>  // for max
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+#include <mutex>
+#include <random> // for mt19937_64
+#include <thread>
+#include <vector>
+
+#include "graveyard_set.h"
+#include "hashers.h"
+#include "internal/concurrent_insert_table.h"
+
+namespace {
+
+constexpr uint64_t kKeys = 8000000;
+constexpr uint64_t kOperations = 16000000;
+
+struct Traits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {};
+
+class LockFree {
+public:
+  static constexpr const char *kName = "lock-free";
+  bool Insert(uint64_t key) { return set_.insert(key); }
+  size_t size() const { return set_.size(); }
+
+private:
+  yobiduck::internal::ConcurrentInsertTable<Traits> set_;
+};
+
+class Locked {
+public:
+  static constexpr const char *kName = "mutex";
+  bool Insert(uint64_t key) {
+    std::lock_guard lock(mutex_);
+    return set_.insert(key).second;
+  }
+  size_t size() const { return set_.size(); }
+
+private:
+  std::mutex mutex_;
+  yobiduck::GraveyardSet<uint64_t, yobiduck::MixHash> set_;
+};
+
+// Returns millions of inserts per second.
+template <class Set> double Run(size_t thread_count) {
+  Set set;
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&set, t, thread_count]() {
+      std::mt19937_64 rng(t);
+      for (uint64_t i = 0; i < kOperations / thread_count; ++i) {
+        set.Insert(rng() % kKeys);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  // Keep the inserts from being optimized away.
+  if (set.size() == 0) {
+    printf("empty\n");
+  }
+  return kOperations / seconds * 1e-6;
+}
+
+template <class Set> void Report(size_t thread_count) {
+  double best = 0;
+  for (int trial = 0; trial < 3; ++trial) {
+    best = std::max(best, Run<Set>(thread_count));
+  }
+  printf(" %9s %7.1f", Set::kName, best);
+}
+
+} // namespace
+
+int main() {
+  printf("threads  Minserts/s\n");
+  for (size_t thread_count = 1; thread_count <= 64; thread_count *= 2) {
+    printf("%7zu", thread_count);
+    Report<LockFree>(thread_count);
+    Report<Locked>(thread_count);
+    printf("\n");
+  }
+}
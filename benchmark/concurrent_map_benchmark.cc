@@ -0,0 +1,134 @@
+// Measures the throughput of `ConcurrentGraveyardMap` against
+// `libcuckoo::cuckoohash_map` and a `GraveyardMap` behind one mutex,
+// at 1 to 64 threads.  The maps start with a million keys, and each
+// thread does a mix of 90% finds, 5% inserts, and 5% erases of random
+// keys.
+
+#include <algorithm> // for max
+#include <chrono>    // for steady_clock
+#include <cstddef>   // for size_t
+#include <cstdint>   // for uint64_t
+#include <cstdio>    // for printf
+#include <mutex>
+#include <random> // for mt19937_64
+#include <thread>
+#include <vector>
+
+#include "concurrent_graveyard_map.h"
+#include "graveyard_map.h"
+#include "libcuckoo/cuckoohash_map.hh"
+
+namespace {
+
+constexpr uint64_t kInitialSize = 1000000;
+constexpr uint64_t kOperations = 8000000;
+
+// The common interface of the maps.
+class Concurrent {
+public:
+  static constexpr const char *kName = "graveyard";
+  bool Find(uint64_t key, uint64_t &value) { return map_.find(key, value); }
+  void Insert(uint64_t key) { map_.insert({key, key}); }
+  void Erase(uint64_t key) { map_.erase(key); }
+
+private:
+  yobiduck::ConcurrentGraveyardMap<uint64_t, uint64_t> map_;
+};
+
+class Cuckoo {
+public:
+  static constexpr const char *kName = "cuckoo";
+  bool Find(uint64_t key, uint64_t &value) { return map_.find(key, value); }
+  void Insert(uint64_t key) { map_.insert(key, key); }
+  void Erase(uint64_t key) { map_.erase(key); }
+
+private:
+  libcuckoo::cuckoohash_map<uint64_t, uint64_t> map_;
+};
+
+class Locked {
+public:
+  static constexpr const char *kName = "mutex";
+  bool Find(uint64_t key, uint64_t &value) {
+    std::lock_guard lock(mutex_);
+    auto it = map_.find(key);
+    if (it == map_.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+  void Insert(uint64_t key) {
+    std::lock_guard lock(mutex_);
+    map_.insert({key, key});
+  }
+  void Erase(uint64_t key) {
+    std::lock_guard lock(mutex_);
+    map_.erase(key);
+  }
+
+private:
+  std::mutex mutex_;
+  yobiduck::GraveyardMap<uint64_t, uint64_t> map_;
+};
+
+// Returns millions of operations per second.
+template <class Map> double Run(size_t thread_count) {
+  Map map;
+  for (uint64_t key = 0; key < kInitialSize; ++key) {
+    map.Insert(key);
+  }
+  std::vector<std::thread> threads;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t t = 0; t < thread_count; ++t) {
+    threads.emplace_back([&map, t, thread_count]() {
+      std::mt19937_64 rng(t);
+      uint64_t found = 0;
+      for (uint64_t i = 0; i < kOperations / thread_count; ++i) {
+        const uint64_t r = rng();
+        const uint64_t key = r % (2 * kInitialSize);
+        const uint64_t dice = (r >> 32) % 100;
+        if (dice < 90) {
+          uint64_t value;
+          found += map.Find(key, value);
+        } else if (dice < 95) {
+          map.Insert(key);
+        } else {
+          map.Erase(key);
+        }
+      }
+      // Keep the finds from being optimized away.
+      if (found == kOperations) {
+        printf("all found\n");
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return kOperations / seconds * 1e-6;
+}
+
+template <class Map> void Report(size_t thread_count) {
+  double best = 0;
+  for (int trial = 0; trial < 3; ++trial) {
+    best = std::max(best, Run<Map>(thread_count));
+  }
+  printf(" %9s %7.1f", Map::kName, best);
+}
+
+} // namespace
+
+int main() {
+  printf("threads  Mops/s\n");
+  for (size_t thread_count = 1; thread_count <= 64; thread_count *= 2) {
+    printf("%7zu", thread_count);
+    Report<Concurrent>(thread_count);
+    Report<Cuckoo>(thread_count);
+    Report<Locked>(thread_count);
+    printf("\n");
+  }
+}
@@ -0,0 +1,67 @@
+// Measures a full scan of a `GraveyardMap` of 10 million random
+// `uint64_t`s that increments every mapped value, with the iterator,
+// with `for_each`, and with `parallel_for_each` at 2 to 32 threads.
+
+#include <chrono>  // for steady_clock
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <cstdio>  // for printf
+#include <random>  // for mt19937_64
+
+#include "graveyard_map.h"
+#include "hashers.h"
+
+namespace {
+
+using Map = yobiduck::GraveyardMap<uint64_t, uint64_t, yobiduck::MixHash>;
+
+constexpr size_t kSize = 10000000;
+
+// Reports the best of five scans.
+template <class F> void Report(const char *name, F scan) {
+  double best = 0;
+  for (int trial = 0; trial < 5; ++trial) {
+    auto start = std::chrono::steady_clock::now();
+    scan();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    if (trial == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+  printf("%-20s %7.1fms\n", name, best * 1e3);
+}
+
+} // namespace
+
+int main() {
+  std::mt19937_64 rng(0);
+  Map map;
+  map.reserve(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    map[rng()] = i;
+  }
+  Report("iterator", [&]() {
+    for (auto &[key, value] : map) {
+      ++value;
+    }
+  });
+  Report("for_each", [&]() {
+    map.for_each([](Map::value_type &value) { ++value.second; });
+  });
+  for (size_t threads = 2; threads <= 32; threads *= 2) {
+    char name[32];
+    snprintf(name, sizeof(name), "parallel_for_each/%zu", threads);
+    Report(name, [&]() {
+      map.parallel_for_each([](Map::value_type &value) { ++value.second; },
+                            threads);
+    });
+  }
+  // Keep the increments from being optimized away.
+  uint64_t sum = 0;
+  map.for_each([&sum](const Map::value_type &value) { sum += value.second; });
+  if (sum == 0) {
+    printf("zero\n");
+  }
+}
@@ -13,6 +13,7 @@
 #include "folly/container/F14Set.h"
 #include "folly/lang/Bits.h" // for findLastSet
 #include "graveyard_set.h"
+#include "hashers.h" // for IdentityHash
 #include "libcuckoo/cuckoohash_map.hh"
 
 using Int64Traits =
@@ -65,7 +66,8 @@ using Int64Traits9092NoGraveyard = Traits9092NoGraveyard<Int64Traits>;
 using Graveyard9092NoGraveyard =
     yobiduck::internal::HashTable<Int64Traits9092NoGraveyard>;
 
-using GraveyardNoHash = yobiduck::GraveyardSet<uint64_t, IdentityHash>;
+using GraveyardNoHash =
+    yobiduck::GraveyardSet<uint64_t, yobiduck::IdentityHash>;
 
 template <>
 constexpr NamePair kTableNames<GraveyardNoHash> = {"graveyard identity-hash",
@@ -0,0 +1,103 @@
+// Measures the hash-quality watchdog (`Traits::kHashWatchdog`) on
+// keys crafted to collide, as in a HashDoS attack, and what it costs
+// on random keys.
+//
+// `FibonacciHash` is a multiplication by an odd constant, so it's
+// invertible: the crafted keys are the small hashes `0, 1, 2, ...`
+// multiplied by the inverse, so they all prefer the first bucket.
+// Without the watchdog every insert scans all the keys before it (and
+// after about 3500 keys the search distance overflows, which fails a
+// CHECK), so the table without the watchdog only gets a few thousand.
+
+#include <algorithm> // for min
+#include <chrono>    // for steady_clock
+#include <cstddef>   // for size_t
+#include <cstdint>   // for uint64_t
+#include <cstdio>    // for printf
+#include <functional> // for equal_to
+#include <memory>    // for allocator
+#include <random>    // for mt19937_64
+#include <vector>
+
+#include "hashers.h"
+#include "internal/hash_table.h"
+
+namespace {
+
+struct Traits : public yobiduck::internal::HashTableTraits<
+                    uint64_t, void, yobiduck::FibonacciHash,
+                    std::equal_to<uint64_t>, std::allocator<uint64_t>> {};
+
+struct WatchdogTraits : public Traits {
+  static constexpr bool kHashWatchdog = true;
+};
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns the best-of-3 nanoseconds per key of `f()`.
+template <class F> double Time(size_t keys, F f) {
+  double best = 1e9;
+  for (int trial = 0; trial < 3; ++trial) {
+    double start = Now();
+    f();
+    best = std::min(best, (Now() - start) / keys);
+  }
+  return best * 1e9;
+}
+
+// Returns the inverse of the odd `a` modulo 2^64 (by Newton's method,
+// each step of which doubles the number of correct low bits).
+uint64_t Inverse(uint64_t a) {
+  uint64_t x = a;
+  for (int i = 0; i < 5; ++i) {
+    x *= 2 - a * x;
+  }
+  return x;
+}
+
+template <class TableTraits>
+void Run(const char *name, const std::vector<uint64_t> &keys) {
+  using Table = yobiduck::internal::HashTable<TableTraits>;
+  Table table;
+  double insert_ns = Time(keys.size(), [&]() {
+    table = Table();
+    for (uint64_t key : keys) {
+      table.insert(key);
+    }
+  });
+  size_t found = 0;
+  double find_ns = Time(keys.size(), [&]() {
+    for (uint64_t key : keys) {
+      found += table.contains(key);
+    }
+  });
+  printf("  %-12s %8zu keys  insert %9.1fns  find %9.1fns  probe %6.2f\n",
+         name, keys.size(), insert_ns, find_ns,
+         table.GetProbeStatistics().successful);
+}
+
+} // namespace
+
+int main() {
+  const uint64_t inverse = Inverse(yobiduck::FibonacciHash::kMultiplier);
+  std::mt19937_64 rng(0);
+  for (size_t size : {1000, 3000, 1000000}) {
+    std::vector<uint64_t> crafted(size), random(size);
+    for (size_t i = 0; i < size; ++i) {
+      crafted[i] = i * inverse;
+      random[i] = rng();
+    }
+    printf("crafted\n");
+    if (size < 3500) {
+      Run<Traits>("no watchdog", crafted);
+    }
+    Run<WatchdogTraits>("watchdog", crafted);
+    printf("random\n");
+    Run<Traits>("no watchdog", random);
+    Run<WatchdogTraits>("watchdog", random);
+  }
+}
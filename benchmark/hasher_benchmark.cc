@@ -0,0 +1,160 @@
+// Compares the hashers in hashers.h with absl's default hash, for
+// several key distributions: the time to insert and find, and the
+// probe lengths (`GetProbeStatistics`) that the hash produces.
+//
+// `IdentityHash` only runs on the random keys: for the others, many
+// keys share their high bits, so they land in the same bucket and
+// overflow the search distance.
+
+#include <algorithm> // for min
+#include <chrono>    // for steady_clock
+#include <cstddef>   // for size_t
+#include <cstdint>   // for uint64_t
+#include <cstdio>    // for printf
+#include <random>    // for mt19937_64
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h" // for hash_default_hash
+#include "graveyard_set.h"
+#include "hashers.h"
+
+namespace {
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns the best-of-3 nanoseconds per key of `f()`.
+template <class F> double Time(size_t keys, F f) {
+  double best = 1e9;
+  for (int trial = 0; trial < 3; ++trial) {
+    double start = Now();
+    f();
+    best = std::min(best, (Now() - start) / keys);
+  }
+  return best * 1e9;
+}
+
+// Prints a row of the matrix for `Hash` inserting `keys` and then
+// looking up `keys` (hits) and `absent` (misses).
+template <class Hash, class Key>
+void Run(const char *hash_name, const std::vector<Key> &keys,
+         const std::vector<Key> &absent) {
+  using Set = yobiduck::GraveyardSet<Key, Hash>;
+  Set set;
+  double insert_ns = Time(keys.size(), [&]() {
+    set = Set();
+    for (const Key &key : keys) {
+      set.insert(key);
+    }
+  });
+  size_t found = 0;
+  double hit_ns = Time(keys.size(), [&]() {
+    for (const Key &key : keys) {
+      found += set.contains(key);
+    }
+  });
+  double miss_ns = Time(absent.size(), [&]() {
+    for (const Key &key : absent) {
+      found += set.contains(key);
+    }
+  });
+  auto probe = set.GetProbeStatistics();
+  printf("  %-10s %7.1f %7.1f %7.1f %10.2f %10.2f   (found %zu)\n", hash_name,
+         insert_ns, hit_ns, miss_ns, probe.successful, probe.unsuccessful,
+         found);
+}
+
+void PrintHeader(const char *distribution) {
+  printf("%s\n  %-10s %7s %7s %7s %10s %10s\n", distribution, "hash",
+         "insert", "hit", "miss", "probe-hit", "probe-miss");
+}
+
+void RunIntegers(const char *distribution, const std::vector<uint64_t> &keys,
+                 const std::vector<uint64_t> &absent, bool run_identity) {
+  PrintHeader(distribution);
+  Run<absl::container_internal::hash_default_hash<uint64_t>>("absl", keys,
+                                                            absent);
+  if (run_identity) {
+    Run<yobiduck::IdentityHash>("identity", keys, absent);
+  }
+  Run<yobiduck::FibonacciHash>("fibonacci", keys, absent);
+  Run<yobiduck::MixHash>("mix", keys, absent);
+}
+
+void RunStrings(const char *distribution, const std::vector<std::string> &keys,
+                const std::vector<std::string> &absent) {
+  PrintHeader(distribution);
+  Run<absl::container_internal::hash_default_hash<std::string>>("absl", keys,
+                                                                absent);
+  Run<yobiduck::StringHash>("string", keys, absent);
+}
+
+} // namespace
+
+int main() {
+  constexpr size_t kSize = 1000000;
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(kSize), absent(kSize);
+
+  // Keys `0..kSize-1`; misses from the next `kSize`.
+  for (size_t i = 0; i < kSize; ++i) {
+    keys[i] = i;
+    absent[i] = kSize + i;
+  }
+  RunIntegers("uint64_t sequential", keys, absent, false);
+
+  // Multiples of 2^16 (e.g., aligned addresses).
+  for (size_t i = 0; i < kSize; ++i) {
+    keys[i] = uint64_t{i} << 16;
+    absent[i] = uint64_t{kSize + i} << 16;
+  }
+  RunIntegers("uint64_t strided (i << 16)", keys, absent, false);
+
+  // Runs of 16 consecutive keys at random places.
+  for (size_t i = 0; i < kSize; i += 16) {
+    uint64_t base = rng(), absent_base = rng();
+    for (size_t j = 0; j < 16 && i + j < kSize; ++j) {
+      keys[i + j] = base + j;
+      absent[i + j] = absent_base + j;
+    }
+  }
+  RunIntegers("uint64_t clustered", keys, absent, false);
+
+  for (size_t i = 0; i < kSize; ++i) {
+    keys[i] = rng();
+    absent[i] = rng();
+  }
+  RunIntegers("uint64_t random", keys, absent, true);
+
+  std::vector<std::string> strings(kSize), absent_strings(kSize);
+  for (size_t i = 0; i < kSize; ++i) {
+    strings[i] = "key-" + std::to_string(i);
+    absent_strings[i] = "key-" + std::to_string(kSize + i);
+  }
+  RunStrings("string sequential (\"key-<i>\")", strings, absent_strings);
+
+  // A long common prefix, as in URLs or file paths.
+  const std::string prefix = "https://www.example.com/some/long/path/";
+  for (size_t i = 0; i < kSize; ++i) {
+    strings[i] = prefix + std::to_string(rng());
+    absent_strings[i] = prefix + std::to_string(rng());
+  }
+  RunStrings("string clustered (long common prefix)", strings, absent_strings);
+
+  auto random_string = [&]() {
+    std::string s(8 + rng() % 25, ' ');
+    for (char &c : s) {
+      c = 'a' + rng() % 26;
+    }
+    return s;
+  };
+  for (size_t i = 0; i < kSize; ++i) {
+    strings[i] = random_string();
+    absent_strings[i] = random_string();
+  }
+  RunStrings("string random (8 to 32 letters)", strings, absent_strings);
+}
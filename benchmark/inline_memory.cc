@@ -0,0 +1,47 @@
+// Reports the memory used by small tables, with and without inline
+// storage (`kInlineCapacity`), for sizes 0 through 32.
+//
+// The "total" column is `sizeof(table) + GetAllocatedMemorySize()`.
+
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+
+#include "absl/hash/hash.h" // for Hash
+#include "graveyard_set.h"  // for HashTable, HashTableTraits
+
+namespace {
+
+using Int64Traits =
+    yobiduck::internal::HashTableTraits<uint64_t, void, absl::Hash<uint64_t>,
+                                        std::equal_to<uint64_t>,
+                                        std::allocator<uint64_t>>;
+
+template <size_t kCapacity> struct InlineTraits : public Int64Traits {
+  static constexpr size_t kInlineCapacity = kCapacity;
+};
+
+template <class Table> size_t TotalBytes(size_t n) {
+  Table table;
+  for (uint64_t i = 0; i < n; ++i) {
+    table.insert(i);
+  }
+  return sizeof(table) + table.GetAllocatedMemorySize();
+}
+
+} // namespace
+
+int main() {
+  using Plain = yobiduck::internal::HashTable<Int64Traits>;
+  using Inline4 = yobiduck::internal::HashTable<InlineTraits<4>>;
+  using Inline8 = yobiduck::internal::HashTable<InlineTraits<8>>;
+  printf("%4s %10s %10s %10s\n", "size", "plain", "inline4", "inline8");
+  printf("%4s %10zu %10zu %10zu\n", "sizeof", sizeof(Plain), sizeof(Inline4),
+         sizeof(Inline8));
+  for (size_t n = 0; n <= 32; ++n) {
+    printf("%4zu %10zu %10zu %10zu\n", n, TotalBytes<Plain>(n),
+           TotalBytes<Inline4>(n), TotalBytes<Inline8>(n));
+  }
+}
@@ -0,0 +1,121 @@
+// Measures insert throughput (new keys and duplicate keys) at several
+// load factors.  At high load the insert probe windows are long, which
+// is where the cost of `PrepareInsert`'s probe shows.
+
+#include <algorithm>  // for min
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+#include <random>     // for mt19937_64
+#include <vector>
+
+#include "absl/hash/hash.h" // for Hash
+#include "graveyard_set.h"  // for HashTable, HashTableTraits
+
+namespace {
+
+size_t rehash_count = 0;
+
+struct CountRehashes {
+  template <class Table> void operator()(Table &table, size_t slot_count) {
+    ++rehash_count;
+    table.rehash_internal(slot_count);
+  }
+};
+
+struct Int64Traits : public yobiduck::internal::HashTableTraits<
+                         uint64_t, void, absl::Hash<uint64_t>,
+                         std::equal_to<uint64_t>, std::allocator<uint64_t>> {
+  using rehash_callback = CountRehashes;
+};
+
+// 24/28 full when rehashing, and 23/28 full after.
+struct HighLoadTraits : public Int64Traits {
+  static constexpr size_t full_utilization_numerator = 24;
+  static constexpr size_t full_utilization_denominator = 28;
+  static constexpr size_t rehashed_utilization_numerator = 23;
+  static constexpr size_t rehashed_utilization_denominator = 28;
+  static constexpr yobiduck::internal::TombstoneRatio kTombstoneRatio{1, 1};
+};
+
+// 15/16 full when rehashing, and 29/32 full after.  (Much fuller than
+// this and the search distances outgrow `kSearchDistanceEndSentinal`.)
+struct VeryHighLoadTraits : public Int64Traits {
+  static constexpr size_t full_utilization_numerator = 15;
+  static constexpr size_t full_utilization_denominator = 16;
+  static constexpr size_t rehashed_utilization_numerator = 29;
+  static constexpr size_t rehashed_utilization_denominator = 32;
+  static constexpr yobiduck::internal::TombstoneRatio kTombstoneRatio{1, 4};
+};
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Prints the best-of-5 nanoseconds per insert for filling a table of
+// `n` values with new values, up to the point where it would rehash,
+// and then for inserting the same values again (all duplicates).
+template <class Traits> void Run(const char *name, size_t n) {
+  using Table = yobiduck::internal::HashTable<Traits>;
+  std::mt19937_64 rng(n);
+  std::vector<uint64_t> initial(n), values;
+  for (uint64_t &value : initial) {
+    value = rng();
+  }
+  // A table holding `initial` at the rehashed utilization.
+  auto make_table = [&]() {
+    Table table;
+    table.rehash(n * Traits::rehashed_utilization_denominator /
+                 Traits::rehashed_utilization_numerator);
+    for (uint64_t value : initial) {
+      table.insert(value);
+    }
+    return table;
+  };
+  double best_new = 1e9, best_duplicate = 1e9;
+  for (int trial = 0; trial < 5; ++trial) {
+    values.resize(n);
+    for (uint64_t &value : values) {
+      value = rng();
+    }
+    // Find how many new values fit before the table rehashes.
+    {
+      Table table = make_table();
+      const size_t rehashes = rehash_count;
+      size_t count = 0;
+      while (rehash_count == rehashes) {
+        table.insert(values[count++]);
+      }
+      values.resize(count - 2);
+    }
+    const size_t count = values.size();
+    Table table = make_table();
+    double start = Now();
+    for (uint64_t value : values) {
+      table.insert(value);
+    }
+    best_new = std::min(best_new, (Now() - start) / count);
+    start = Now();
+    for (uint64_t value : values) {
+      table.insert(value);
+    }
+    best_duplicate = std::min(best_duplicate, (Now() - start) / count);
+  }
+  printf("%-10s n=%-9zu new: %6.1fns  duplicate: %6.1fns\n", name, n,
+         best_new * 1e9, best_duplicate * 1e9);
+}
+
+} // namespace
+
+int main() {
+  for (size_t n : {100000, 1000000, 10000000}) {
+    Run<Int64Traits>("default", n);
+    Run<HighLoadTraits>("high", n);
+    Run<VeryHighLoadTraits>("very-high", n);
+  }
+}
@@ -0,0 +1,160 @@
+// Measures what `CountingInstrumentation` and
+// `SampledCountingInstrumentation` cost: inserts, hits, and misses on
+// random keys, with the default `NullInstrumentation`, with counting,
+// and with sampled counting, and prints the counting tables' snapshots.
+//
+// The finds are timed in rounds that take turns between the three
+// tables, and each time reported is the median of the rounds, so that
+// a noisy machine slows all three alike.
+
+#include <algorithm>  // for min, sort
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+#include <random>     // for mt19937_64
+#include <vector>
+
+#include "hashers.h"
+#include "internal/hash_table.h"
+
+namespace {
+
+struct Traits : public yobiduck::internal::HashTableTraits<
+                    uint64_t, void, yobiduck::MixHash,
+                    std::equal_to<uint64_t>, std::allocator<uint64_t>> {};
+
+struct CountingTraits : public Traits {
+  using instrumentation = yobiduck::internal::CountingInstrumentation;
+};
+
+struct SampledTraits : public Traits {
+  using instrumentation = yobiduck::internal::SampledCountingInstrumentation;
+};
+
+double Now() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+double Median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// Returns the best-of-5 nanoseconds per key of inserting `keys` into an
+// empty table.
+template <class Table>
+double TimeInserts(Table &table, const std::vector<uint64_t> &keys) {
+  double best = 1e9;
+  for (int trial = 0; trial < 5; ++trial) {
+    double start = Now();
+    table = Table();
+    for (uint64_t key : keys) {
+      table.insert(key);
+    }
+    best = std::min(best, (Now() - start) / keys.size());
+  }
+  return best * 1e9;
+}
+
+// Returns the nanoseconds per find of looking up each of `keys`
+// `repetitions` times, and adds the hits to `found`.
+template <class Table>
+double TimeFinds(const Table &table, const std::vector<uint64_t> &keys,
+                 size_t repetitions, size_t &found) {
+  double start = Now();
+  for (size_t r = 0; r < repetitions; ++r) {
+    for (uint64_t key : keys) {
+      found += table.contains(key);
+    }
+  }
+  return (Now() - start) / (keys.size() * repetitions) * 1e9;
+}
+
+void PrintHistogram(
+    const char *name,
+    const yobiduck::internal::InstrumentationSnapshot::Histogram &histogram) {
+  printf("  %-7s", name);
+  for (uint64_t count : histogram) {
+    printf(" %llu", static_cast<unsigned long long>(count));
+  }
+  printf("\n");
+}
+
+template <class Table> void PrintSnapshot(const Table &table) {
+  auto snapshot = table.GetInstrumentationSnapshot();
+  printf("  finds %llu  hits %llu  h2 false positives %llu  rehashes %llu "
+         "(%.2fms, %llu bytes)  max search distance %zu\n",
+         static_cast<unsigned long long>(snapshot.finds()),
+         static_cast<unsigned long long>(snapshot.hits()),
+         static_cast<unsigned long long>(snapshot.h2_false_positives),
+         static_cast<unsigned long long>(snapshot.rehashes),
+         snapshot.rehash_nanoseconds * 1e-6,
+         static_cast<unsigned long long>(snapshot.rehash_bytes_moved),
+         snapshot.max_search_distance);
+  PrintHistogram("hit", snapshot.hit_probe_lengths);
+  PrintHistogram("miss", snapshot.miss_probe_lengths);
+  PrintHistogram("insert", snapshot.insert_probe_lengths);
+}
+
+} // namespace
+
+using NullTable = yobiduck::internal::HashTable<Traits>;
+using CountingTable = yobiduck::internal::HashTable<CountingTraits>;
+using SampledTable = yobiduck::internal::HashTable<SampledTraits>;
+
+constexpr int kRounds = 21;
+// The finds per round, for each table and each of hits and misses.
+constexpr size_t kFindsPerRound = 10000000;
+
+int main() {
+  std::mt19937_64 rng(0);
+  for (size_t size : {1000, 100000, 10000000}) {
+    std::vector<uint64_t> keys(size), absent(size);
+    for (size_t i = 0; i < size; ++i) {
+      keys[i] = rng();
+      absent[i] = rng();
+    }
+    printf("%zu keys\n", size);
+    NullTable null_table;
+    CountingTable counting_table;
+    SampledTable sampled_table;
+    const double insert_ns[3] = {TimeInserts(null_table, keys),
+                                 TimeInserts(counting_table, keys),
+                                 TimeInserts(sampled_table, keys)};
+    const size_t repetitions = std::max(size_t{1}, kFindsPerRound / size);
+    std::vector<double> hit_ns[3], miss_ns[3];
+    size_t found = 0;
+    for (int round = 0; round < kRounds; ++round) {
+      hit_ns[0].push_back(TimeFinds(null_table, keys, repetitions, found));
+      hit_ns[1].push_back(TimeFinds(counting_table, keys, repetitions, found));
+      hit_ns[2].push_back(TimeFinds(sampled_table, keys, repetitions, found));
+      miss_ns[0].push_back(TimeFinds(null_table, absent, repetitions, found));
+      miss_ns[1].push_back(
+          TimeFinds(counting_table, absent, repetitions, found));
+      miss_ns[2].push_back(
+          TimeFinds(sampled_table, absent, repetitions, found));
+    }
+    const double null_hit = Median(hit_ns[0]);
+    const double null_miss = Median(miss_ns[0]);
+    const char *names[3] = {"null", "counting", "sampled"};
+    for (int i = 0; i < 3; ++i) {
+      const double hit = Median(hit_ns[i]);
+      const double miss = Median(miss_ns[i]);
+      printf("  %-8s insert %6.1fns  hit %6.2fns (%+5.1f%%)  "
+             "miss %6.2fns (%+5.1f%%)\n",
+             names[i], insert_ns[i], hit, (hit / null_hit - 1) * 100, miss,
+             (miss / null_miss - 1) * 100);
+    }
+    if (found != 3 * kRounds * repetitions * size) {
+      printf("  wrong number found\n");
+    }
+    // Counted over all the rounds.
+    PrintSnapshot(counting_table);
+    PrintSnapshot(sampled_table);
+  }
+}
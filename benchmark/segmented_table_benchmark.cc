@@ -0,0 +1,91 @@
+// Compares a `SegmentedTable` with a `GraveyardSet` by inserting 30
+// million random `uint64_t`s (growing from empty) and then finding them
+// all.  Reports the times, the memory each table ends up with, and the
+// peak resident memory, which includes a `GraveyardSet`'s last rehash.
+// Each table is measured in its own child process, so that the peaks
+// don't mix.
+
+#include <sys/resource.h> // for getrusage
+#include <sys/wait.h>     // for waitpid
+#include <unistd.h>       // for fork
+
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <cstdlib>    // for exit
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+#include <random>     // for mt19937_64
+#include <vector>
+
+#include "graveyard_set.h"
+#include "hashers.h"
+#include "internal/segmented_table.h"
+
+namespace {
+
+constexpr size_t kSize = 30000000;
+
+struct Traits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {};
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+template <class Table> void Run(const char *name, Table &table) {
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(kSize);
+  for (uint64_t &key : keys) {
+    key = rng();
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t key : keys) {
+    table.insert(key);
+  }
+  const double insert_seconds = SecondsSince(start);
+  start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (uint64_t key : keys) {
+    found += table.contains(key);
+  }
+  const double find_seconds = SecondsSince(start);
+  if (found != kSize) {
+    printf("missing values\n");
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%-16s insert %6.3fs  find %6.3fs  memory %5zuMiB  maxrss %5ldMiB\n",
+         name, insert_seconds, find_seconds,
+         table.GetAllocatedMemorySize() >> 20, usage.ru_maxrss >> 10);
+}
+
+// Runs `f` in a child process and waits for it.
+template <class F> void InChild(F f) {
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    f();
+    fflush(stdout);
+    exit(0);
+  }
+  waitpid(pid, nullptr, 0);
+}
+
+} // namespace
+
+int main() {
+  InChild([]() {
+    yobiduck::GraveyardSet<uint64_t, yobiduck::MixHash> set;
+    Run("GraveyardSet", set);
+  });
+  InChild([]() {
+    yobiduck::internal::SegmentedTable<Traits> table;
+    Run("SegmentedTable", table);
+  });
+}
@@ -0,0 +1,152 @@
+// Measures the find throughput of `SingleWriterTable` readers against
+// readers of a `HashTable` behind a `std::shared_mutex`, at 1 to 32
+// reader threads, while one writer thread keeps inserting and erasing
+// random keys in a map of a million keys.
+
+#include <algorithm> // for max
+#include <atomic>
+#include <chrono>     // for steady_clock
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <cstdio>     // for printf
+#include <functional> // for equal_to
+#include <memory>     // for allocator
+#include <mutex>
+#include <random> // for mt19937_64
+#include <shared_mutex>
+#include <thread>
+#include <utility> // for pair
+#include <vector>
+
+#include "hashers.h"
+#include "internal/hash_table.h"
+#include "internal/single_writer_table.h"
+
+namespace {
+
+struct Traits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, uint64_t, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<std::pair<const uint64_t, uint64_t>>> {};
+
+constexpr uint64_t kSize = 1000000;
+constexpr std::chrono::milliseconds kDuration(500);
+
+class LockFree {
+public:
+  static constexpr const char *kName = "lock-free";
+  class Reader {
+  public:
+    explicit Reader(LockFree &map) : reader_(map.table_.NewReader()) {}
+    bool Find(uint64_t key, uint64_t &value) {
+      return reader_.find(key, &value);
+    }
+
+  private:
+    yobiduck::internal::SingleWriterTable<Traits>::Reader reader_;
+  };
+  void Insert(uint64_t key) { table_.insert({key, key}); }
+  void Erase(uint64_t key) { table_.erase(key); }
+
+private:
+  yobiduck::internal::SingleWriterTable<Traits> table_;
+};
+
+class Locked {
+public:
+  static constexpr const char *kName = "shared_mutex";
+  class Reader {
+  public:
+    explicit Reader(Locked &map) : map_(map) {}
+    bool Find(uint64_t key, uint64_t &value) {
+      std::shared_lock lock(map_.mutex_);
+      auto it = map_.table_.find(key);
+      if (it == map_.table_.end()) {
+        return false;
+      }
+      value = it->second;
+      return true;
+    }
+
+  private:
+    Locked &map_;
+  };
+  void Insert(uint64_t key) {
+    std::lock_guard lock(mutex_);
+    table_.insert({key, key});
+  }
+  void Erase(uint64_t key) {
+    std::lock_guard lock(mutex_);
+    table_.erase(key);
+  }
+
+private:
+  std::shared_mutex mutex_;
+  yobiduck::internal::HashTable<Traits> table_;
+};
+
+// Returns millions of finds per second.
+template <class Map> double Run(size_t reader_count) {
+  Map map;
+  for (uint64_t key = 0; key < kSize; ++key) {
+    map.Insert(key);
+  }
+  std::atomic<bool> done{false};
+  std::atomic<uint64_t> finds{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < reader_count; ++t) {
+    threads.emplace_back([&, t]() {
+      typename Map::Reader reader(map);
+      std::mt19937_64 rng(t);
+      uint64_t count = 0, found = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        uint64_t value;
+        found += reader.Find(rng() % (2 * kSize), value);
+        ++count;
+      }
+      finds.fetch_add(count);
+      // Keep the finds from being optimized away.
+      if (found == count + 1) {
+        printf("impossible\n");
+      }
+    });
+  }
+  threads.emplace_back([&]() {
+    std::mt19937_64 rng(1000);
+    while (!done.load(std::memory_order_relaxed)) {
+      const uint64_t key = rng() % (2 * kSize);
+      if (rng() % 2 == 0) {
+        map.Insert(key);
+      } else {
+        map.Erase(key);
+      }
+    }
+  });
+  std::this_thread::sleep_for(kDuration);
+  done.store(true);
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  return finds.load() / std::chrono::duration<double>(kDuration).count() *
+         1e-6;
+}
+
+template <class Map> void Report(size_t reader_count) {
+  double best = 0;
+  for (int trial = 0; trial < 3; ++trial) {
+    best = std::max(best, Run<Map>(reader_count));
+  }
+  printf(" %12s %7.1f", Map::kName, best);
+}
+
+} // namespace
+
+int main() {
+  printf("readers  Mfinds/s\n");
+  for (size_t reader_count = 1; reader_count <= 32; reader_count *= 2) {
+    printf("%7zu", reader_count);
+    Report<LockFree>(reader_count);
+    Report<Locked>(reader_count);
+    printf("\n");
+  }
+}
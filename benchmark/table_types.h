@@ -12,20 +12,17 @@
 #include "absl/hash/hash.h"               // for Hash
 #include "folly/container/F14Set.h"
 #include "graveyard_set.h"
+#include "hashers.h" // for IdentityHash
 #include "libcuckoo/cuckoohash_map.hh"
 #include "ordered_linear_probing_set.h"
 
 // Define the various table types used in the various benchmarks in
 // the paper.
 
-struct IdentityHash {
-  size_t operator()(uint64_t v) const { return v; }
-};
-
 using GoogleSet = absl::flat_hash_set<uint64_t>;
-using GoogleSetNoHash = absl::flat_hash_set<uint64_t, IdentityHash>;
+using GoogleSetNoHash = absl::flat_hash_set<uint64_t, yobiduck::IdentityHash>;
 using FacebookSet = folly::F14FastSet<uint64_t>;
-using FacebookSetNoHash = folly::F14FastSet<uint64_t, IdentityHash>;
+using FacebookSetNoHash = folly::F14FastSet<uint64_t, yobiduck::IdentityHash>;
 using CuckooSet = libcuckoo::cuckoohash_map<uint64_t, uint64_t>;
 
 using Int64Traits =
@@ -106,7 +103,7 @@ struct NamePair {
 };
 
 using OLPSet = OrderedLinearProbingSet<uint64_t>;
-using OLPSetNoHash = OrderedLinearProbingSet<uint64_t, IdentityHash>;
+using OLPSetNoHash = OrderedLinearProbingSet<uint64_t, yobiduck::IdentityHash>;
 
 template <class Table> constexpr NamePair kTableNames = NamePair();
 
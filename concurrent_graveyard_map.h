@@ -0,0 +1,217 @@
+#ifndef _GRAVEYARD_CONCURRENT_GRAVEYARD_MAP_H_
+#define _GRAVEYARD_CONCURRENT_GRAVEYARD_MAP_H_
+
+// A hash map that many threads can use at once.  It's a power-of-two
+// number of shards, each a graveyard `HashMap` with its own
+// reader-writer lock, padded to a cache line so that threads working on
+// different shards don't share lines.  An operation hashes the key
+// once, picks the shard from the hash, and locks only that shard (finds
+// share the lock).  Each shard grows (rehashes) on its own, under its
+// own lock, so a growth blocks only the keys of one shard.
+//
+// The shard is picked from the hash bits just above H2.  (H1 is the
+// high bits of `hash * logical_bucket_count` and H2 is the low 6 bits,
+// so sharding on the high bits would leave every shard using only its
+// slice of its own buckets.)  Those bits must be well mixed, as they are
+// for the default hasher and `MixHash`, but not for `FibonacciHash`.
+//
+// Values are never handed out by reference, since another thread could
+// move them.  `find` copies the value out, and `visit` calls a function
+// on the value while holding the shard's lock.
+
+#include <cstddef> // for size_t
+#include <memory>  // for allocator
+#include <mutex>   // for lock_guard
+#include <shared_mutex>
+#include <utility> // for pair, forward
+#include <vector>
+
+#include "absl/container/flat_hash_set.h" // For hash_default_hash
+#include "internal/hash_map.h"
+
+namespace yobiduck {
+
+template <class Key, class T,
+          class Hash = absl::container_internal::hash_default_hash<Key>,
+          class KeyEqual = absl::container_internal::hash_default_eq<Key>,
+          class Allocator = std::allocator<std::pair<const Key, T>>>
+class ConcurrentGraveyardMap {
+  using Traits =
+      yobiduck::internal::HashTableTraits<Key, T, Hash, KeyEqual, Allocator>;
+  using Table = yobiduck::internal::HashMap<Traits>;
+
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<const Key, T>;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+
+  static constexpr size_t kDefaultShardCount = 64;
+
+  // Rounds `shard_count` up to a power of two.
+  explicit ConcurrentGraveyardMap(size_t shard_count = kDefaultShardCount,
+                                  const hasher &hash = hasher())
+      : hash_(hash), shard_bits_(Log2Ceiling(shard_count)),
+        shards_(size_t{1} << shard_bits_) {
+    // Each shard rehashes with its own hasher, which must hash the way
+    // `hash_` does.
+    for (Shard &shard : shards_) {
+      shard.table = Table(0, hash_);
+    }
+  }
+  ConcurrentGraveyardMap(const ConcurrentGraveyardMap &) = delete;
+  ConcurrentGraveyardMap &operator=(const ConcurrentGraveyardMap &) = delete;
+
+  size_t shard_count() const { return shards_.size(); }
+
+  // The sum of the shards' sizes, each read under its lock (so with
+  // concurrent changes it's only approximately the size).
+  size_t size() const {
+    size_t size = 0;
+    for (const Shard &shard : shards_) {
+      std::shared_lock lock(shard.mutex);
+      size += shard.table.size();
+    }
+    return size;
+  }
+  bool empty() const { return size() == 0; }
+
+  bool contains(const key_type &key) const {
+    const size_t hash = hash_(key);
+    const Shard &shard = ShardOf(hash);
+    std::shared_lock lock(shard.mutex);
+    return shard.table.contains(key, hash);
+  }
+
+  // If `key` is present, copies its value into `value` and returns
+  // true.
+  bool find(const key_type &key, mapped_type &value) const {
+    const size_t hash = hash_(key);
+    const Shard &shard = ShardOf(hash);
+    std::shared_lock lock(shard.mutex);
+    auto it = shard.table.find(key, hash);
+    if (it == shard.table.end()) {
+      return false;
+    }
+    value = it->second;
+    return true;
+  }
+
+  // Inserts `value` if its key isn't present.  Returns true if it
+  // inserted.
+  bool insert(const value_type &value) {
+    const size_t hash = hash_(value.first);
+    Shard &shard = ShardOf(hash);
+    std::lock_guard lock(shard.mutex);
+    return shard.table.insert(value, hash).second;
+  }
+
+  // Constructs the value from `args` and inserts it if `key` isn't
+  // present.  Returns true if it inserted.
+  template <class... Args>
+  bool try_emplace(const key_type &key, Args &&...args) {
+    const size_t hash = hash_(key);
+    Shard &shard = ShardOf(hash);
+    std::lock_guard lock(shard.mutex);
+    return shard.table
+        .try_emplace_with_hash(hash, key, std::forward<Args>(args)...)
+        .second;
+  }
+
+  size_t erase(const key_type &key) {
+    const size_t hash = hash_(key);
+    Shard &shard = ShardOf(hash);
+    std::lock_guard lock(shard.mutex);
+    return shard.table.erase(key, hash);
+  }
+
+  // If `key` is present, calls `f(value)` (where `value` is a
+  // `value_type &`) holding the shard's lock exclusively, and returns
+  // true.  `f` must not use the map.
+  template <class F> bool visit(const key_type &key, F &&f) {
+    const size_t hash = hash_(key);
+    Shard &shard = ShardOf(hash);
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.table.find(key, hash);
+    if (it == shard.table.end()) {
+      return false;
+    }
+    f(*it);
+    return true;
+  }
+
+  // Like `visit`, but `f` gets a `const value_type &`, and the lock is
+  // shared with other readers.
+  template <class F> bool cvisit(const key_type &key, F &&f) const {
+    const size_t hash = hash_(key);
+    const Shard &shard = ShardOf(hash);
+    std::shared_lock lock(shard.mutex);
+    auto it = shard.table.find(key, hash);
+    if (it == shard.table.end()) {
+      return false;
+    }
+    f(*it);
+    return true;
+  }
+
+  // Makes room for `count` values in all, spread evenly over the
+  // shards.
+  void reserve(size_t count) {
+    const size_t per_shard = (count + shards_.size() - 1) / shards_.size();
+    for (Shard &shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      shard.table.reserve(per_shard);
+    }
+  }
+
+  void clear() {
+    for (Shard &shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      shard.table.clear();
+    }
+  }
+
+  // The memory allocated by all the shards (not including `*this`).
+  size_t GetAllocatedMemorySize() const {
+    size_t bytes = 0;
+    for (const Shard &shard : shards_) {
+      std::shared_lock lock(shard.mutex);
+      bytes += shard.table.GetAllocatedMemorySize();
+    }
+    return bytes;
+  }
+
+private:
+  // Each shard starts on its own cache line, so that locking one shard
+  // doesn't contend with the shards next to it.
+  struct alignas(Traits::kCacheLineSize) Shard {
+    mutable std::shared_mutex mutex;
+    Table table;
+  };
+
+  // The bits of the hash below these are H2.
+  static constexpr int kShardShift = 6;
+
+  static int Log2Ceiling(size_t n) {
+    int bits = 0;
+    while ((size_t{1} << bits) < n) {
+      ++bits;
+    }
+    return bits;
+  }
+
+  size_t ShardIndex(size_t hash) const {
+    return (hash >> kShardShift) & (shards_.size() - 1);
+  }
+  Shard &ShardOf(size_t hash) { return shards_[ShardIndex(hash)]; }
+  const Shard &ShardOf(size_t hash) const { return shards_[ShardIndex(hash)]; }
+
+  const hasher hash_;
+  const int shard_bits_;
+  std::vector<Shard> shards_;
+};
+
+} // namespace yobiduck
+
+#endif // _GRAVEYARD_CONCURRENT_GRAVEYARD_MAP_H_
@@ -68,12 +68,24 @@ class GraveyardMap
 
   using Base::clear;
 
+  // void clear_keep_capacity();
+  //
+  // Effect: Erases all the elements but keeps the allocated memory, so
+  // that refilling the map doesn't need to allocate or rehash.
+  //
+  // Note: Not part of the `stl::unordered_map` API.
+  using Base::clear_keep_capacity;
+
   using Base::swap;
 
   using typename Base::iterator;
 
   using typename Base::const_iterator;
 
+  using typename Base::node_type;
+
+  using typename Base::insert_return_type;
+
   using Base::begin;
 
   using Base::cbegin;
@@ -84,10 +96,44 @@ class GraveyardMap
 
   using Base::insert;
 
+  using Base::erase;
+
   using Base::emplace;
 
+  // pair<iterator, bool> emplace_with_hash(size_t hash, Args&&... args);
+  //
+  // Effect: Same as `emplace(args...)`, where `hash` is the hash of the
+  // new value's key.  `insert`, `lazy_emplace`, `erase`, `extract`,
+  // `find`, `count` and `contains` similarly have overloads taking
+  // the hash after the key.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  using Base::emplace_with_hash;
+
+  // iterator lazy_emplace(const key_arg<K> &key, F &&f);
+  //
+  // Effect: If `key` is present, returns an iterator to it.  Otherwise
+  // calls `f(constructor)`, where `constructor(args...)` constructs the
+  // new value in place (its key must equal `key`), and returns an
+  // iterator to the new value.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  using Base::lazy_emplace;
+
+  using typename Base::constructor;
+
   using Base::try_emplace;
 
+  // Same as `try_emplace(key, args...)`, where `hash` is the hash of
+  // `key`.
+  using Base::try_emplace_with_hash;
+
+  using Base::extract;
+
+  void merge(GraveyardMap &other) { Base::merge(other); }
+
+  void merge(GraveyardMap &&other) { Base::merge(other); }
+
   template <class K = key_type> T &operator[](const key_arg<K> &key) {
     auto [it, inserted] = try_emplace(key);
     return it->second;
@@ -99,6 +145,39 @@ class GraveyardMap
 
   using Base::contains;
 
+  // void contains_many(const key_type *keys, size_t n, bool *found) const;
+  //
+  // Effect: Sets `found[i] = contains(keys[i])` for each `i` in
+  // `[0, n)`, overlapping the lookups' cache misses.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  using Base::contains_many;
+
+  // void prefetch(size_t hash) const;
+  //
+  // Effect: Prefetches the first memory that a lookup or insert of a
+  // key with hash `hash` touches.  Issue it a stage ahead of the
+  // operation to overlap the cache miss with other work.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  using Base::prefetch;
+
+  // void for_each(F &&f);
+  //
+  // void parallel_for_each(F &&f, size_t threads);
+  //
+  // Effect: Calls `f(value)` for each value, passing a `value_type &`
+  // (so that `f` may change the mapped values), or a `const value_type
+  // &` if *this is const.  `parallel_for_each` splits the buckets into
+  // chunks that `threads` threads take from a work-stealing scheduler,
+  // calling `f` concurrently.  `f` mustn't insert or erase.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  using Base::for_each;
+  using Base::parallel_for_each;
+
+  using Base::hash_function;
+
   using Base::equal_range;
 
   using Base::empty;
@@ -121,6 +200,15 @@ class GraveyardMap
 
   using Base::reserve;
 
+  // void Maintain();
+  //
+  // Effect: Does any deferred maintenance, such as shrinking a table
+  // that has become too empty (if the traits have a shrink policy).
+  // Invalidates iterators if it changes the table.
+  //
+  // Note: Not part of the `stl::unordered_map` API.
+  using Base::Maintain;
+
   // size_t GetAllocatedMemorySize() const;
   //
   // Effect: Returns the amount of memory allocated in *this.  Doesn't include
@@ -130,8 +218,78 @@ class GraveyardMap
   using Base::GetAllocatedMemorySize;
 
   using Base::GetProbeStatistics;
+  using Base::GetOnlineProbeStatistics;
+  using Base::EstimateProbeStatistics;
+  using Base::GetInstrumentationSnapshot;
   using Base::GetSuccessfulProbeLength;
 
+  friend bool operator==(const GraveyardMap &a, const GraveyardMap &b) {
+    return a.Equals(b);
+  }
+
+  friend bool operator!=(const GraveyardMap &a, const GraveyardMap &b) {
+    return !a.Equals(b);
+  }
+
+  // GraveyardMap Union(const GraveyardMap &a, const GraveyardMap &b);
+  // GraveyardMap Union(const GraveyardMap &a, const GraveyardMap &b,
+  //                    Combine combine);
+  //
+  // GraveyardMap Intersect(const GraveyardMap &a, const GraveyardMap &b);
+  // GraveyardMap Intersect(const GraveyardMap &a, const GraveyardMap &b,
+  //                        Combine combine);
+  //
+  // GraveyardMap Difference(const GraveyardMap &a, const GraveyardMap &b);
+  //
+  // Effect: Returns the union, intersection, or difference (the keys
+  // in `a` but not `b`) of `a` and `b`.  A key in both maps gets the
+  // value `combine(a_value, b_value)`, or `a`'s value if there is no
+  // `combine`.  Runs in linear time by reading both maps in hash
+  // order, without doing any lookups.
+  //
+  // Note: Not part of the `std::unordered_map` API.
+  friend GraveyardMap Union(const GraveyardMap &a, const GraveyardMap &b) {
+    return Compute<yobiduck::internal::SetOperation::kUnion>(a, b, KeepFirst);
+  }
+
+  template <class Combine>
+  friend GraveyardMap Union(const GraveyardMap &a, const GraveyardMap &b,
+                            Combine combine) {
+    return Compute<yobiduck::internal::SetOperation::kUnion>(a, b, combine);
+  }
+
+  friend GraveyardMap Intersect(const GraveyardMap &a, const GraveyardMap &b) {
+    return Compute<yobiduck::internal::SetOperation::kIntersection>(a, b,
+                                                                    KeepFirst);
+  }
+
+  template <class Combine>
+  friend GraveyardMap Intersect(const GraveyardMap &a, const GraveyardMap &b,
+                                Combine combine) {
+    return Compute<yobiduck::internal::SetOperation::kIntersection>(a, b,
+                                                                    combine);
+  }
+
+  friend GraveyardMap Difference(const GraveyardMap &a,
+                                 const GraveyardMap &b) {
+    return Compute<yobiduck::internal::SetOperation::kDifference>(a, b,
+                                                                  KeepFirst);
+  }
+
+private:
+  static const T &KeepFirst(const T &a, const T &) { return a; }
+
+  template <yobiduck::internal::SetOperation op, class Combine>
+  static GraveyardMap Compute(const GraveyardMap &a, const GraveyardMap &b,
+                              Combine &combine) {
+    GraveyardMap result;
+    result.template AssignSetOperation<op>(
+        a, b, [&](const value_type &a_value, const value_type &b_value) {
+          return value_type(a_value.first,
+                            combine(a_value.second, b_value.second));
+        });
+    return result;
+  }
 };
 
 } // namespace yobiduck
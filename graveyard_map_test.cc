@@ -1,18 +1,22 @@
 #include "graveyard_map.h"
 
+#include <atomic>
 #include <cstddef> // for size_t, ptrdiff_t
 #include <cstdint> // for uint64_t
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits> // for is_same_v
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/hash/hash.h" // for Hash
 #include "absl/log/check.h"
 #include "absl/random/random.h"
 #include "absl/strings/str_cat.h" // for StrCat
+#include "concurrent_graveyard_map.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -329,17 +333,7 @@ void TryArgsMovedTest(std::string_view called_from) {
   {
     Map map;
     map.emplace("a", Counted());
-    // Graveyard is doing extra move constructors.  TODO: Fix this to pass thus:
-    //  EXPECT_EQ(counts, (Counts{.def=1, .mc=1, .des=1})) << " from " << called_from;
-    //
-    // For now, we are happy if there are no copies
-
-    // Make sure that every move construction has a destruction
-    EXPECT_EQ(counts.mc, counts.des);
-    // Then make sure the only other thing happening is the default constructor.
-    counts.mc = 0;
-    counts.des = 0;
-    EXPECT_EQ(counts, Counts{.def=1});
+    EXPECT_EQ(counts, (Counts{.def=1, .mc=1, .des=1})) << " from " << called_from;
     counts.Reset();
   }
   EXPECT_EQ(counts, (Counts{.des=1})) << " from " << called_from;
@@ -420,15 +414,7 @@ void MovesMovableTest() {
     MapType<Counted, int, Counted::Hash> map;
     map.emplace(std::make_pair(Counted(2), 0));
     EXPECT_FALSE(map.empty());
-    // Abseil and Std give Counts{.mc=2, .ec=1, .des=2}
-    //
-    // GraveyardMap gives Counts{.mc=4 .ec=1 .des=4} because we haven't done the fancy decomposition.
-    EXPECT_EQ(counts.def, 0);
-    EXPECT_EQ(counts.cc, 0);
-    EXPECT_EQ(counts.ca, 0);
-    EXPECT_EQ(counts.ec, 1);
-    EXPECT_EQ(counts.ma, 0);
-    EXPECT_EQ(counts.mc, counts.des);
+    EXPECT_EQ(counts, (Counts{.mc=2, .ec=1, .des=2}));
     counts.Reset();
   }
   EXPECT_EQ(counts, (Counts{.des=1}));
@@ -437,21 +423,13 @@ void MovesMovableTest() {
     counts.Reset();
     MapType<Counted, int, Counted::Hash> map;
     map.emplace(Counted(2), 0);
-    // Abseil and std give Counts{.mc=1 .ec=1 .des=1}
-    // Graveyard does a couple extra moves because we haven't done the fancy decomposition.
-    // For now what we care about is no copying.
-    EXPECT_EQ(counts.cc, 0);
-    EXPECT_EQ(counts.ca, 0);
+    EXPECT_EQ(counts, (Counts{.mc=1, .ec=1, .des=1}));
   }
 
   counts.Reset();
   MapType<Counted, Counted, Counted::Hash> map;
   map.emplace(Counted(1), Counted(2));
-  // Abseil and Std expect Counts{.mc=2, .ec=2, .des=2}.
-  // Graveyard does some extra moves because we haven't done the fancy decomposition.
-  // For now what we care about is no copying.
-  EXPECT_EQ(counts.cc, 0);
-  EXPECT_EQ(counts.ca, 0);
+  EXPECT_EQ(counts, (Counts{.mc=2, .ec=2, .des=2}));
   {
     auto it = map.find(Counted(1));
     EXPECT_TRUE(it != map.end());
@@ -523,12 +501,8 @@ void DoesntMoveNonmovableTest() {
   counts.Reset();
   MapType<CountedNonStandard, Counted, Counted::Hash> map;
   map.emplace(CountedNonStandard(1), Counted(2));
-  // Expect two move constructors and two deletions.  But we haven't
-  // done the fancy decomposition, so there's not much to test.
-  // Graveyard does a copule extra copy constructors and move
-  // constructors.
-  // TODO: Make graveyard pass this EXPECT:
-  //  EXPECT_EQ(counts, (Counts{.mc=2, .ec=2, .des=2}));
+  // Expect two move constructors and two deletions.
+  EXPECT_EQ(counts, (Counts{.mc=2, .ec=2, .des=2}));
   {
     auto it = map.find(CountedNonStandard(1));
     EXPECT_TRUE(it != map.end());
@@ -558,3 +532,231 @@ TEST(GraveyardMap, DoesntMoveNonmovablePairAbsl) {
 TEST(GraveyardMap, DoesntMoveNonmovablePairGraveyard) {
   DoesntMoveNonmovableTest<yobiduck::GraveyardMap, true>();
 }
+
+TEST(GraveyardMap, NodeHandle) {
+  yobiduck::GraveyardMap<std::string, std::string> map;
+  map["a"] = "A";
+  map["b"] = "B";
+  auto node = map.extract("a");
+  ASSERT_FALSE(node.empty());
+  EXPECT_EQ(node.key(), "a");
+  EXPECT_EQ(node.mapped(), "A");
+  // The key of a node can be changed.
+  node.key() = "c";
+  node.mapped() = "C";
+  auto result = map.insert(std::move(node));
+  EXPECT_TRUE(result.inserted);
+  EXPECT_THAT(*result.position, Pair("c", "C"));
+  EXPECT_THAT(map, UnorderedElementsAre(Pair("b", "B"), Pair("c", "C")));
+}
+
+TEST(GraveyardMap, Merge) {
+  yobiduck::GraveyardMap<std::string, std::string> map;
+  map["a"] = "A";
+  map["b"] = "B";
+  yobiduck::GraveyardMap<std::string, std::string> other;
+  other["b"] = "other";
+  other["c"] = "C";
+  map.merge(other);
+  EXPECT_THAT(map, UnorderedElementsAre(Pair("a", "A"), Pair("b", "B"),
+                                        Pair("c", "C")));
+  EXPECT_THAT(other, UnorderedElementsAre(Pair("b", "other")));
+}
+
+TEST(GraveyardMap, SetAlgebra) {
+  yobiduck::GraveyardMap<std::string, int> a, b;
+  a["x"] = 1;
+  a["y"] = 2;
+  b["y"] = 10;
+  b["z"] = 20;
+  auto add = [](int u, int v) { return u + v; };
+  EXPECT_THAT(Union(a, b),
+              UnorderedElementsAre(Pair("x", 1), Pair("y", 2), Pair("z", 20)));
+  EXPECT_THAT(Union(a, b, add), UnorderedElementsAre(Pair("x", 1),
+                                                     Pair("y", 12),
+                                                     Pair("z", 20)));
+  EXPECT_THAT(Intersect(a, b), UnorderedElementsAre(Pair("y", 2)));
+  EXPECT_THAT(Intersect(b, a, add), UnorderedElementsAre(Pair("y", 12)));
+  EXPECT_THAT(Difference(a, b), UnorderedElementsAre(Pair("x", 1)));
+  // Equality compares the mapped values too.
+  auto copy = a;
+  EXPECT_TRUE(copy == a);
+  copy["x"] = 3;
+  EXPECT_TRUE(copy != a);
+}
+
+// `emplace` finds the key in its arguments and probes before it
+// constructs anything, so a duplicate costs no constructions.
+TEST(GraveyardMap, EmplaceDuplicateConstructsNothing) {
+  Counts &counts = Counted::counts;
+  yobiduck::GraveyardMap<Counted, Counted, Counted::Hash> map;
+  map.emplace(Counted(1), Counted(2));
+  Counted key(1);
+  Counted mapped(3);
+  counts.Reset();
+  EXPECT_FALSE(map.emplace(key, std::move(mapped)).second);
+  EXPECT_FALSE(map.emplace(std::make_pair(std::cref(key), 4)).second);
+  EXPECT_FALSE(map.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                           std::forward_as_tuple(5))
+                   .second);
+  EXPECT_EQ(counts, Counts());
+  EXPECT_EQ(map.find(key)->second.v, 2);
+  counts.Reset();
+  EXPECT_TRUE(map.emplace(std::piecewise_construct,
+                          std::forward_as_tuple(Counted(6)),
+                          std::forward_as_tuple(7))
+                  .second);
+  EXPECT_EQ(counts, (Counts{.mc=1, .ec=2, .des=1}));
+}
+
+TEST(GraveyardMap, LazyEmplace) {
+  yobiduck::GraveyardMap<std::string, std::string> map;
+  size_t calls = 0;
+  auto make = [&](const auto &construct) {
+    ++calls;
+    construct("a", "A");
+  };
+  auto it = map.lazy_emplace("a", make);
+  EXPECT_THAT(*it, Pair("a", "A"));
+  EXPECT_EQ(map.lazy_emplace(std::string("a"), make), it);
+  EXPECT_EQ(calls, 1);
+  EXPECT_THAT(map, UnorderedElementsAre(Pair("a", "A")));
+}
+
+TEST(GraveyardMap, PrecomputedHash) {
+  using Map = yobiduck::GraveyardMap<std::string, int>;
+  Map map;
+  const std::string key = "a";
+  const size_t hash = Map::hasher()(key);
+  map.prefetch(hash);
+  EXPECT_TRUE(map.try_emplace_with_hash(hash, key, 1).second);
+  EXPECT_FALSE(map.try_emplace_with_hash(hash, key, 2).second);
+  EXPECT_FALSE(map.emplace_with_hash(hash, key, 3).second);
+  EXPECT_EQ(map.find(key, hash)->second, 1);
+  EXPECT_EQ(map.erase(key, hash), 1);
+  EXPECT_TRUE(map.emplace_with_hash(hash, key, 4).second);
+  EXPECT_TRUE(map.contains(key, hash));
+  EXPECT_THAT(map, UnorderedElementsAre(Pair("a", 4)));
+}
+
+namespace {
+// A hasher with state, so that a default-constructed one hashes
+// differently.
+class SeededHash {
+public:
+  explicit SeededHash(uint64_t seed = 0) : seed_(seed) {}
+  size_t operator()(uint64_t key) const {
+    return absl::Hash<std::pair<uint64_t, uint64_t>>()({key, seed_});
+  }
+
+private:
+  uint64_t seed_;
+};
+}  // namespace
+
+TEST(ConcurrentGraveyardMap, StatefulHasher) {
+  yobiduck::ConcurrentGraveyardMap<uint64_t, uint64_t, SeededHash> map(
+      /*shard_count=*/4, SeededHash(12345));
+  // Enough keys that every shard rehashes many times.
+  constexpr uint64_t N = 100000;
+  for (uint64_t key = 0; key < N; ++key) {
+    EXPECT_TRUE(map.insert({key, key}));
+  }
+  EXPECT_EQ(map.size(), N);
+  for (uint64_t key = 0; key < N; ++key) {
+    uint64_t value = 0;
+    EXPECT_TRUE(map.find(key, value)) << key;
+    EXPECT_EQ(value, key);
+  }
+}
+
+TEST(GraveyardMap, ForEach) {
+  using Map = yobiduck::GraveyardMap<uint64_t, uint64_t>;
+  Map map;
+  size_t visits = 0;
+  map.for_each([&visits](const auto &) { ++visits; });
+  map.parallel_for_each([&visits](const auto &) { ++visits; }, 4);
+  EXPECT_EQ(visits, 0);
+  // Small enough to be one chunk, and then many chunks.
+  for (uint64_t size : {100, 200000}) {
+    map.clear();
+    for (uint64_t key = 0; key < size; ++key) {
+      map[key] = key;
+    }
+    map.for_each([](auto &value) { ++value.second; });
+    for (size_t threads : {1, 2, 3, 8}) {
+      map.parallel_for_each([](auto &value) { value.second += 2; }, threads);
+    }
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> count{0};
+    const Map &const_map = map;
+    const_map.parallel_for_each(
+        [&](const Map::value_type &value) {
+          EXPECT_EQ(value.second, value.first + 9);
+          sum.fetch_add(value.first, std::memory_order_relaxed);
+          count.fetch_add(1, std::memory_order_relaxed);
+        },
+        5);
+    EXPECT_EQ(count.load(), size);
+    EXPECT_EQ(sum.load(), size * (size - 1) / 2);
+    uint64_t const_count = 0;
+    const_map.for_each([&const_count](const auto &) { ++const_count; });
+    EXPECT_EQ(const_count, size);
+  }
+}
+
+TEST(ConcurrentGraveyardMap, Threads) {
+  yobiduck::ConcurrentGraveyardMap<uint64_t, uint64_t> map(/*shard_count=*/6);
+  EXPECT_EQ(map.shard_count(), 8);
+  constexpr uint64_t kThreads = 4;
+  constexpr uint64_t kPerThread = 50000;
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&map, t]() {
+      for (uint64_t i = 0; i < kPerThread; ++i) {
+        const uint64_t key = t * kPerThread + i;
+        EXPECT_TRUE(map.insert({key, key}));
+        EXPECT_FALSE(map.try_emplace(key, 0));
+        // Another thread's key is either absent or right.
+        const uint64_t other = (key + kPerThread) % (kThreads * kPerThread);
+        uint64_t value;
+        if (map.find(other, value)) {
+          EXPECT_EQ(value, other);
+        }
+        if (i % 2 == 1) {
+          EXPECT_EQ(map.erase(key), 1);
+        }
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(map.size(), kThreads * kPerThread / 2);
+  for (uint64_t key = 0; key < kThreads * kPerThread; ++key) {
+    uint64_t value = 0;
+    EXPECT_EQ(map.find(key, value), key % 2 == 0) << key;
+    if (key % 2 == 0) {
+      EXPECT_EQ(value, key);
+    }
+  }
+  // Concurrent visits don't lose updates.
+  threads.clear();
+  for (uint64_t t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&map]() {
+      for (int i = 0; i < 1000; ++i) {
+        EXPECT_TRUE(map.visit(2, [](auto &value) { ++value.second; }));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  uint64_t seen = 0;
+  EXPECT_TRUE(map.cvisit(2, [&seen](const auto &value) { seen = value.second; }));
+  EXPECT_EQ(seen, 2 + kThreads * 1000);
+  EXPECT_FALSE(map.visit(1, [](auto &) {}));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.GetAllocatedMemorySize(), 0);
+}
@@ -1,9 +1,11 @@
 #ifndef _GRAVEYARD_SET_H_
 #define _GRAVEYARD_SET_H_
 
-#include <memory> // for allocator
+#include <cstddef> // for size_t
+#include <memory>  // for allocator
 
 #include "absl/container/flat_hash_set.h" // For hash_default_hash (TODO: use internal/hash_function_defaults.h
+#include "absl/types/span.h"
 #include "internal/hash_table.h" // IWYU pragma: export
 
 namespace yobiduck {
@@ -67,12 +69,24 @@ public:
 
   using Base::clear;
 
+  // void clear_keep_capacity();
+  //
+  // Effect: Erases all the elements but keeps the allocated memory, so
+  // that refilling the set doesn't need to allocate or rehash.
+  //
+  // Note: Not part of the `stl::unordered_set` API.
+  using Base::clear_keep_capacity;
+
   using Base::swap;
 
   using typename Base::iterator;
 
   using typename Base::const_iterator;
 
+  using typename Base::node_type;
+
+  using typename Base::insert_return_type;
+
   using Base::begin;
 
   using Base::cbegin;
@@ -87,12 +101,74 @@ public:
 
   using Base::emplace;
 
+  // pair<iterator, bool> emplace_with_hash(size_t hash, Args&&... args);
+  //
+  // Effect: Same as `emplace(args...)`, where `hash` is the hash of the
+  // new value's key.  `insert`, `lazy_emplace`, `erase`, `extract`,
+  // `find`, `count` and `contains` similarly have overloads taking
+  // the hash after the key.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  using Base::emplace_with_hash;
+
+  // iterator lazy_emplace(const key_arg<K> &key, F &&f);
+  //
+  // Effect: If `key` is present, returns an iterator to it.  Otherwise
+  // calls `f(constructor)`, where `constructor(args...)` constructs the
+  // new value in place (its key must equal `key`), and returns an
+  // iterator to the new value.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  using Base::lazy_emplace;
+
+  using typename Base::constructor;
+
+  using Base::extract;
+
+  void merge(GraveyardSet &other) { Base::merge(other); }
+
+  void merge(GraveyardSet &&other) { Base::merge(other); }
+
   using Base::count;
 
   using Base::find;
 
   using Base::contains;
 
+  // void contains_many(const key_type *keys, size_t n, bool *found) const;
+  //
+  // Effect: Sets `found[i] = contains(keys[i])` for each `i` in
+  // `[0, n)`, overlapping the lookups' cache misses.  With AVX-512,
+  // `uint64_t` keys and a hasher from hashers.h, looks up eight keys
+  // at a time with vector gathers.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  using Base::contains_many;
+
+  // void prefetch(size_t hash) const;
+  //
+  // Effect: Prefetches the first memory that a lookup or insert of a
+  // key with hash `hash` touches.  Issue it a stage ahead of the
+  // operation to overlap the cache miss with other work.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  using Base::prefetch;
+
+  // void for_each(F &&f);
+  //
+  // void parallel_for_each(F &&f, size_t threads);
+  //
+  // Effect: Calls `f(value)` for each value, passing a `const
+  // value_type &`.  `parallel_for_each` splits the buckets into chunks
+  // that `threads` threads take from a work-stealing scheduler, calling
+  // `f` concurrently.  `f` mustn't insert or erase.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  using Base::for_each;
+  using Base::parallel_for_each;
+
+  using Base::hash_function;
+
   using Base::equal_range;
 
   using Base::empty;
@@ -115,6 +191,15 @@ public:
 
   using Base::reserve;
 
+  // void Maintain();
+  //
+  // Effect: Does any deferred maintenance, such as shrinking a table
+  // that has become too empty (if the traits have a shrink policy).
+  // Invalidates iterators if it changes the table.
+  //
+  // Note: Not part of the `stl::unordered_set` API.
+  using Base::Maintain;
+
   // size_t GetAllocatedMemorySize() const;
   //
   // Effect: Returns the amount of memory allocated in *this.  Doesn't include
@@ -124,10 +209,80 @@ public:
   using Base::GetAllocatedMemorySize;
 
   using Base::GetProbeStatistics;
+  using Base::GetOnlineProbeStatistics;
+  using Base::EstimateProbeStatistics;
+  using Base::GetInstrumentationSnapshot;
   using Base::GetSuccessfulProbeLength;
 
   using Base::ToString;
   using Base::Validate;
+
+  friend bool operator==(const GraveyardSet &a, const GraveyardSet &b) {
+    return a.Equals(b);
+  }
+
+  friend bool operator!=(const GraveyardSet &a, const GraveyardSet &b) {
+    return !a.Equals(b);
+  }
+
+  // GraveyardSet Union(const GraveyardSet &a, const GraveyardSet &b);
+  //
+  // GraveyardSet Intersect(const GraveyardSet &a, const GraveyardSet &b);
+  //
+  // GraveyardSet Difference(const GraveyardSet &a, const GraveyardSet &b);
+  //
+  // Effect: Returns the union, intersection, or difference (the
+  // values in `a` but not `b`) of `a` and `b`.  Runs in linear time
+  // by reading both sets in hash order, without doing any lookups.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  friend GraveyardSet Union(const GraveyardSet &a, const GraveyardSet &b) {
+    return Compute<yobiduck::internal::SetOperation::kUnion>(a, b);
+  }
+
+  friend GraveyardSet Intersect(const GraveyardSet &a, const GraveyardSet &b) {
+    return Compute<yobiduck::internal::SetOperation::kIntersection>(a, b);
+  }
+
+  friend GraveyardSet Difference(const GraveyardSet &a,
+                                 const GraveyardSet &b) {
+    return Compute<yobiduck::internal::SetOperation::kDifference>(a, b);
+  }
+
+  // GraveyardSet Build(absl::Span<const value_type> values);
+  //
+  // GraveyardSet BuildParallel(absl::Span<const value_type> values,
+  //                            size_t threads);
+  //
+  // Effect: Returns a set of `values`, built by sorting them by hash
+  // and writing them in hash order, without probing.  `BuildParallel`
+  // hashes, sorts and writes with `threads` threads, and builds the
+  // same set, bucket for bucket.
+  //
+  // Note: Not part of the `std::unordered_set` API.
+  static GraveyardSet Build(absl::Span<const value_type> values) {
+    GraveyardSet result;
+    result.AssignBulk(values);
+    return result;
+  }
+
+  static GraveyardSet BuildParallel(absl::Span<const value_type> values,
+                                    size_t threads) {
+    GraveyardSet result;
+    result.AssignBulkParallel(values, threads);
+    return result;
+  }
+
+private:
+  template <yobiduck::internal::SetOperation op>
+  static GraveyardSet Compute(const GraveyardSet &a, const GraveyardSet &b) {
+    GraveyardSet result;
+    result.template AssignSetOperation<op>(
+        a, b, [](const value_type &value, const value_type &) {
+          return value;
+        });
+    return result;
+  }
 };
 
 // TODO: Idea, keep a bit that says whether a particular slot is out of its
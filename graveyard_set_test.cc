@@ -1,7 +1,9 @@
 #include "graveyard_set.h"
 
 #include <time.h> // for timespec, clock_gettime
+#include <unistd.h> // for close, pipe, read
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <functional> // for equal_to
@@ -10,8 +12,10 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
@@ -20,6 +24,11 @@
 #include "absl/numeric/bits.h"
 #include "absl/random/random.h"
 #include "benchmark.h"
+#include "hashers.h"
+#include "internal/background_rehash.h"
+#include "internal/concurrent_insert_table.h"
+#include "internal/segmented_table.h"
+#include "internal/single_writer_table.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -129,7 +138,33 @@ TEST(GraveyardSet, Rehash0) {
   set.Validate();
 }
 
-// TODO: A test that does a rehash after some erases.
+TEST(GraveyardSet, RehashAfterErases) {
+  GraveyardSet<std::string> set;
+  constexpr size_t N = 10000;
+  for (size_t i = 0; i < N; ++i) {
+    set.insert(std::to_string(i));
+  }
+  for (size_t i = 0; i < N; ++i) {
+    if (i % 10 != 0) {
+      set.erase(std::to_string(i));
+    }
+  }
+  const size_t capacity_before = set.capacity();
+  // Shrinks in place.
+  set.rehash(0);
+  set.Validate();
+  EXPECT_LT(set.capacity(), capacity_before / 4);
+  EXPECT_EQ(set.size(), N / 10);
+  for (size_t i = 0; i < N; ++i) {
+    EXPECT_EQ(set.contains(std::to_string(i)), i % 10 == 0) << i;
+  }
+  // Shrinks to nothing.
+  set.clear();
+  set.rehash(0);
+  EXPECT_EQ(set.capacity(), 0);
+  set.insert("a");
+  EXPECT_THAT(set, UnorderedElementsAre("a"));
+}
 
 namespace {
 template <class KeyType> size_t ExpectedCapacityAfterRehash(size_t size) {
@@ -661,3 +696,1418 @@ TEST(GraveyardSet, CopyDestructsSource) {
   }
   EXPECT_TRUE(AllocatedInt::IsAllDestructed());
 }
+
+namespace {
+// Shrink when less than 1/4 full.
+template <class T>
+struct ShrinkingTraits
+    : public yobiduck::internal::HashTableTraits<
+          T, void, absl::container_internal::hash_default_hash<T>,
+          absl::container_internal::hash_default_eq<T>, std::allocator<T>> {
+  static constexpr size_t shrink_utilization_numerator = 1;
+  static constexpr size_t shrink_utilization_denominator = 4;
+};
+}  // namespace
+
+TEST(GraveyardSet, ShrinkOnErase) {
+  constexpr size_t N = 10000;
+  {
+    std::vector<AllocatedInt> values(N);
+    yobiduck::internal::HashTable<ShrinkingTraits<AllocatedInt>> set;
+    for (const AllocatedInt &value : values) {
+      set.insert(value);
+    }
+    const size_t capacity_before = set.capacity();
+    const size_t memory_before = set.GetAllocatedMemorySize();
+    for (size_t i = 0; i < N; ++i) {
+      if (i % 20 != 0) {
+        set.erase(values[i]);
+      }
+    }
+    set.Validate();
+    EXPECT_LT(set.capacity(), capacity_before / 4);
+    EXPECT_LT(set.GetAllocatedMemorySize(), memory_before / 4);
+    EXPECT_EQ(set.size(), N / 20);
+    for (size_t i = 0; i < N; ++i) {
+      EXPECT_EQ(set.contains(values[i]), i % 20 == 0) << i;
+    }
+  }
+  EXPECT_TRUE(AllocatedInt::IsAllDestructed());
+}
+
+// Right after a shrink, inserting and erasing a few values shouldn't
+// cause the table to grow or shrink again.
+TEST(GraveyardSet, ShrinkHysteresis) {
+  yobiduck::internal::HashTable<ShrinkingTraits<uint64_t>> set;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    set.insert(i);
+  }
+  const size_t capacity_before = set.capacity();
+  uint64_t next = 0;
+  while (set.capacity() == capacity_before) {
+    set.erase(next++);
+  }
+  const size_t capacity = set.capacity();
+  uint64_t next_insert = 10000;
+  for (size_t round = 0; round < 100; ++round) {
+    set.insert(next_insert++);
+    set.insert(next_insert++);
+    EXPECT_EQ(set.capacity(), capacity);
+    set.erase(next++);
+    set.erase(next++);
+    EXPECT_EQ(set.capacity(), capacity);
+  }
+  set.Validate();
+}
+
+// Inserting a value that's already present never grows the table,
+// even when the table is full enough that a new value would.
+TEST(GraveyardSet, DuplicateInsertAtThresholdDoesntRehash) {
+  GraveyardSet<uint64_t> set;
+  set.insert(0);
+  const size_t initial_capacity = set.capacity();
+  uint64_t count = 1;
+  while (set.capacity() == initial_capacity) {
+    set.insert(count++);
+  }
+  // The table grew when inserting `count - 1`, so a table holding
+  // `0..count-2` is right at the threshold.
+  set = GraveyardSet<uint64_t>();
+  for (uint64_t i = 0; i + 1 < count; ++i) {
+    set.insert(i);
+  }
+  EXPECT_EQ(set.capacity(), initial_capacity);
+  for (uint64_t i = 0; i + 1 < count; ++i) {
+    EXPECT_FALSE(set.insert(i).second);
+    EXPECT_EQ(set.capacity(), initial_capacity);
+  }
+  EXPECT_TRUE(set.insert(count - 1).second);
+  EXPECT_GT(set.capacity(), initial_capacity);
+  set.Validate();
+}
+
+TEST(GraveyardSet, MaintainShrinksAfterIteratorErases) {
+  yobiduck::internal::HashTable<ShrinkingTraits<uint64_t>> set;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    set.insert(i);
+  }
+  const size_t capacity_before = set.capacity();
+  for (auto it = set.begin(); it != set.end();) {
+    if (*it % 16 != 0) {
+      set.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  // Erasing through iterators doesn't invalidate iterators, so it
+  // doesn't shrink.
+  EXPECT_EQ(set.capacity(), capacity_before);
+  set.Maintain();
+  set.Validate();
+  EXPECT_LT(set.capacity(), capacity_before / 4);
+  EXPECT_EQ(set.size(), 625);
+  for (uint64_t i = 0; i < 10000; ++i) {
+    EXPECT_EQ(set.contains(i), i % 16 == 0) << i;
+  }
+}
+
+TEST(GraveyardSet, ClearKeepCapacity) {
+  {
+    std::vector<AllocatedInt> values(1000);
+    GraveyardSet<AllocatedInt> set;
+    for (const AllocatedInt &value : values) {
+      set.insert(value);
+    }
+    const size_t capacity = set.capacity();
+    set.clear_keep_capacity();
+    EXPECT_TRUE(set.empty());
+    EXPECT_EQ(set.begin(), set.end());
+    EXPECT_EQ(set.capacity(), capacity);
+    set.Validate();
+    for (size_t i = 0; i < 500; ++i) {
+      set.insert(values[i]);
+    }
+    EXPECT_EQ(set.capacity(), capacity);
+    EXPECT_THAT(set, UnorderedElementsAreArray(values.begin(),
+                                               values.begin() + 500));
+    set.Validate();
+  }
+  EXPECT_TRUE(AllocatedInt::IsAllDestructed());
+  GraveyardSet<uint64_t> empty;
+  empty.clear_keep_capacity();
+  EXPECT_TRUE(empty.empty());
+}
+
+namespace {
+template <class T>
+struct PooledTraits
+    : public yobiduck::internal::HashTableTraits<
+          T, void, absl::container_internal::hash_default_hash<T>,
+          absl::container_internal::hash_default_eq<T>, std::allocator<T>> {
+  static constexpr bool kUseBucketPool = true;
+};
+}  // namespace
+
+TEST(GraveyardSet, BucketPool) {
+  using yobiduck::internal::BucketPool;
+  using Set = yobiduck::internal::HashTable<PooledTraits<uint64_t>>;
+  BucketPool &pool = *BucketPool::ThisThread();
+  EXPECT_EQ(pool.cached_bytes(), 0);
+  const uint64_t *first_address;
+  size_t allocated;
+  {
+    Set set;
+    set.insert(42);
+    first_address = &*set.begin();
+    allocated = set.GetAllocatedMemorySize();
+  }
+  EXPECT_EQ(pool.cached_bytes(), allocated);
+  {
+    // Gets the same memory back.
+    Set set;
+    set.insert(42);
+    EXPECT_EQ(&*set.begin(), first_address);
+    EXPECT_EQ(pool.cached_bytes(), 0);
+    set.Validate();
+  }
+  pool.set_max_bytes(0);
+  EXPECT_EQ(pool.cached_bytes(), 0);
+  {
+    Set set;
+    for (uint64_t i = 0; i < 1000; ++i) {
+      set.insert(i);
+    }
+  }
+  EXPECT_EQ(pool.cached_bytes(), 0);
+  pool.set_max_bytes(BucketPool::kDefaultMaxBytes);
+}
+
+TEST(GraveyardSet, CopyEmpty) {
+  GraveyardSet<uint64_t> set;
+  GraveyardSet<uint64_t> copy(set);
+  EXPECT_TRUE(copy.empty());
+  set.insert(1);
+  set.erase(1);
+  copy = set;
+  EXPECT_TRUE(copy.empty());
+  copy.Validate();
+}
+
+namespace {
+template <class T>
+struct ZeroIsEmptyTraits
+    : public yobiduck::internal::HashTableTraits<
+          T, void, absl::container_internal::hash_default_hash<T>,
+          absl::container_internal::hash_default_eq<T>, std::allocator<T>> {
+  static constexpr bool kZeroIsEmpty = true;
+  static constexpr size_t shrink_utilization_numerator = 1;
+  static constexpr size_t shrink_utilization_denominator = 4;
+};
+}  // namespace
+
+TEST(GraveyardSet, ZeroIsEmpty) {
+  using Set = yobiduck::internal::HashTable<ZeroIsEmptyTraits<uint64_t>>;
+  absl::BitGen bitgen;
+  // Big enough that the buckets are mmapped.
+  constexpr size_t N = 200000;
+  Set set;
+  absl::flat_hash_set<uint64_t> fset;
+  // `UnorderedElementsAreArray` is quadratic.
+  auto expect_same = [&fset](const Set &s) {
+    EXPECT_EQ(s.size(), fset.size());
+    for (uint64_t v : s) {
+      EXPECT_TRUE(fset.contains(v)) << v;
+    }
+  };
+  for (size_t i = 0; i < N; ++i) {
+    uint64_t v = absl::Uniform<uint64_t>(bitgen, 0, 4 * N);
+    EXPECT_EQ(set.insert(v).second, fset.insert(v).second);
+  }
+  set.Validate();
+  expect_same(set);
+  Set copy(set);
+  copy.Validate();
+  expect_same(copy);
+  // Shrinks, first within the mmapped allocation, then by
+  // reallocating when the table gets small enough to be malloced.
+  for (size_t i = 0; i < 4 * N; ++i) {
+    if (i % 100 != 0) {
+      EXPECT_EQ(set.erase(i), fset.erase(i));
+    }
+  }
+  set.Validate();
+  expect_same(set);
+  copy.clear_keep_capacity();
+  EXPECT_TRUE(copy.empty());
+  copy.Validate();
+  copy.insert(7);
+  EXPECT_THAT(copy, UnorderedElementsAre(7));
+}
+
+TEST(GraveyardSet, ZeroIsEmptyReserve) {
+  yobiduck::internal::HashTable<ZeroIsEmptyTraits<std::string>> set;
+  // Doesn't touch the memory.
+  set.reserve(10'000'000);
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(set.begin(), set.end());
+  set.insert("a");
+  set.insert("b");
+  EXPECT_THAT(set, UnorderedElementsAre("a", "b"));
+  set.clear_keep_capacity();
+  set.insert("c");
+  EXPECT_THAT(set, UnorderedElementsAre("c"));
+}
+
+TEST(GraveyardSet, EmptyFunctorsTakeNoSpace) {
+  // The size and the bucket pointer and size.
+  EXPECT_EQ(sizeof(GraveyardSet<uint64_t>), 3 * sizeof(size_t));
+}
+
+namespace {
+template <class T>
+struct InlineTraits
+    : public yobiduck::internal::HashTableTraits<
+          T, void, absl::container_internal::hash_default_hash<T>,
+          absl::container_internal::hash_default_eq<T>, std::allocator<T>> {
+  static constexpr size_t kInlineCapacity = 4;
+};
+}  // namespace
+
+TEST(GraveyardSet, InlineStorage) {
+  {
+    std::vector<AllocatedInt> values(20);
+    using Set = yobiduck::internal::HashTable<InlineTraits<AllocatedInt>>;
+    Set set;
+    EXPECT_EQ(set.begin(), set.end());
+    EXPECT_EQ(set.capacity(), 4);
+    for (size_t i = 0; i < 4; ++i) {
+      EXPECT_TRUE(set.insert(values[i]).second);
+      EXPECT_FALSE(set.insert(values[i]).second);
+      EXPECT_EQ(set.GetAllocatedMemorySize(), 0);
+      set.Validate();
+    }
+    EXPECT_THAT(set, UnorderedElementsAreArray(values.begin(),
+                                               values.begin() + 4));
+    EXPECT_FALSE(set.contains(values[4]));
+    Set copy(set);
+    EXPECT_EQ(copy.GetAllocatedMemorySize(), 0);
+    EXPECT_THAT(copy, UnorderedElementsAreArray(values.begin(),
+                                                values.begin() + 4));
+    // The fifth value moves everything into buckets.
+    set.insert(values[4]);
+    EXPECT_GT(set.GetAllocatedMemorySize(), 0);
+    set.Validate();
+    EXPECT_THAT(set, UnorderedElementsAreArray(values.begin(),
+                                               values.begin() + 5));
+    // Swapping a heap table with an inline one.
+    set.swap(copy);
+    EXPECT_EQ(set.size(), 4);
+    EXPECT_EQ(copy.size(), 5);
+    set.Validate();
+    copy.Validate();
+    // Assigning a small heap table makes an inline copy.
+    copy.erase(values[0]);
+    copy.erase(values[1]);
+    set = copy;
+    EXPECT_EQ(set.GetAllocatedMemorySize(), 0);
+    EXPECT_THAT(set, UnorderedElementsAreArray(values.begin() + 2,
+                                               values.begin() + 5));
+    // Rehashing a small table moves it back inline.
+    copy.rehash(0);
+    EXPECT_EQ(copy.GetAllocatedMemorySize(), 0);
+    copy.Validate();
+    EXPECT_THAT(copy, UnorderedElementsAreArray(values.begin() + 2,
+                                                values.begin() + 5));
+    for (const AllocatedInt &value : values) {
+      copy.insert(value);
+    }
+    copy.Validate();
+    EXPECT_THAT(copy, UnorderedElementsAreArray(values));
+    set.clear();
+    EXPECT_TRUE(set.empty());
+    EXPECT_EQ(set.begin(), set.end());
+  }
+  EXPECT_TRUE(AllocatedInt::IsAllDestructed());
+}
+
+TEST(GraveyardSet, ExtractAndInsertNode) {
+  GraveyardSet<std::string> set;
+  set.insert("a");
+  set.insert("b");
+  set.insert("c");
+  GraveyardSet<std::string>::node_type node = set.extract("b");
+  ASSERT_FALSE(node.empty());
+  EXPECT_EQ(node.value(), "b");
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_FALSE(set.contains("b"));
+  EXPECT_TRUE(set.extract("b").empty());
+  // Inserting a key that is present leaves the value in the node.
+  node.value() = "a";
+  auto result = set.insert(std::move(node));
+  EXPECT_FALSE(result.inserted);
+  EXPECT_EQ(*result.position, "a");
+  ASSERT_FALSE(result.node.empty());
+  EXPECT_EQ(result.node.value(), "a");
+  result.node.value() = "d";
+  result = set.insert(std::move(result.node));
+  EXPECT_TRUE(result.inserted);
+  EXPECT_EQ(*result.position, "d");
+  EXPECT_TRUE(result.node.empty());
+  // The cached hash is good in another table.
+  GraveyardSet<std::string> other;
+  result = other.insert(set.extract(set.find("c")));
+  EXPECT_TRUE(result.inserted);
+  EXPECT_TRUE(other.contains("c"));
+  EXPECT_THAT(set, UnorderedElementsAre("a", "d"));
+  EXPECT_FALSE(other.insert(GraveyardSet<std::string>::node_type()).inserted);
+  set.Validate();
+  other.Validate();
+}
+
+TEST(GraveyardSet, Merge) {
+  using yobiduck::internal::ceil;
+  // Small enough that merging doesn't need to grow `set` (so it
+  // inserts one value at a time), or big enough that it does (so it
+  // streams both tables into new buckets).
+  for (size_t n : {10, 100000}) {
+    GraveyardSet<uint64_t> set;
+    if (n == 10) {
+      set.reserve(4 * n);
+    }
+    GraveyardSet<uint64_t> other;
+    for (uint64_t i = 0; i < 3 * n; ++i) {
+      set.insert(2 * i);
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      other.insert(3 * i);
+    }
+    const size_t capacity = set.capacity();
+    set.merge(other);
+    if (n == 10) {
+      EXPECT_EQ(set.capacity(), capacity);
+    } else {
+      EXPECT_GT(set.capacity(), capacity);
+    }
+    set.Validate();
+    other.Validate();
+    // The multiples of 6 were in both, so they stay in `other`.
+    EXPECT_EQ(set.size(), 3 * n + n - ceil(n, 2));
+    EXPECT_EQ(other.size(), ceil(n, 2));
+    for (uint64_t i = 0; i < 6 * n; ++i) {
+      EXPECT_EQ(set.contains(i), i % 2 == 0 || (i % 3 == 0 && i < 3 * n))
+          << i;
+      EXPECT_EQ(other.contains(i), i % 6 == 0 && i < 3 * n) << i;
+    }
+  }
+}
+
+TEST(GraveyardSet, SetAlgebra) {
+  for (size_t n : {0, 3, 1000, 100000}) {
+    GraveyardSet<uint64_t> multiples_of_2;
+    GraveyardSet<uint64_t> multiples_of_3;
+    for (uint64_t i = 0; i < 2 * n; i += 2) {
+      multiples_of_2.insert(i);
+    }
+    for (uint64_t i = 0; i < 3 * n; i += 3) {
+      multiples_of_3.insert(i);
+    }
+    GraveyardSet<uint64_t> set_union = Union(multiples_of_2, multiples_of_3);
+    GraveyardSet<uint64_t> intersection =
+        Intersect(multiples_of_2, multiples_of_3);
+    GraveyardSet<uint64_t> difference =
+        Difference(multiples_of_2, multiples_of_3);
+    set_union.Validate();
+    intersection.Validate();
+    difference.Validate();
+    size_t union_size = 0, intersection_size = 0, difference_size = 0;
+    for (uint64_t i = 0; i < 3 * n; ++i) {
+      const bool in_2 = i % 2 == 0 && i < 2 * n;
+      const bool in_3 = i % 3 == 0;
+      EXPECT_EQ(set_union.contains(i), in_2 || in_3) << i;
+      EXPECT_EQ(intersection.contains(i), in_2 && in_3) << i;
+      EXPECT_EQ(difference.contains(i), in_2 && !in_3) << i;
+      union_size += in_2 || in_3;
+      intersection_size += in_2 && in_3;
+      difference_size += in_2 && !in_3;
+    }
+    EXPECT_EQ(set_union.size(), union_size);
+    EXPECT_EQ(intersection.size(), intersection_size);
+    EXPECT_EQ(difference.size(), difference_size);
+    EXPECT_TRUE(Union(difference, intersection) == multiples_of_2);
+    EXPECT_EQ(Union(multiples_of_2, multiples_of_2), multiples_of_2);
+    // The result is much smaller than the buckets it was built in, so
+    // they are given back.
+    GraveyardSet<uint64_t> empty = Difference(multiples_of_2, multiples_of_2);
+    EXPECT_EQ(empty.size(), 0);
+    EXPECT_EQ(empty.GetAllocatedMemorySize(), 0);
+    if (n > 0) {
+      EXPECT_NE(set_union, multiples_of_2);
+      GraveyardSet<uint64_t> copy = multiples_of_2;
+      copy.erase(0);
+      copy.insert(1);
+      EXPECT_NE(copy, multiples_of_2);
+    }
+  }
+}
+
+TEST(GraveyardSet, SetAlgebraStrings) {
+  GraveyardSet<std::string> a, b;
+  for (std::string s : {"a", "b", "c"}) {
+    a.insert(s);
+  }
+  for (std::string s : {"b", "c", "d"}) {
+    b.insert(s);
+  }
+  EXPECT_THAT(Union(a, b), UnorderedElementsAre("a", "b", "c", "d"));
+  EXPECT_THAT(Intersect(a, b), UnorderedElementsAre("b", "c"));
+  EXPECT_THAT(Difference(a, b), UnorderedElementsAre("a"));
+  EXPECT_THAT(Difference(b, a), UnorderedElementsAre("d"));
+  EXPECT_NE(a, b);
+  b.erase("d");
+  b.insert("a");
+  EXPECT_EQ(a, b);
+}
+
+TEST(GraveyardSet, LazyEmplace) {
+  GraveyardSet<std::string> set;
+  size_t calls = 0;
+  auto make = [&](const auto &construct) {
+    ++calls;
+    construct(3, 'x');
+  };
+  EXPECT_EQ(*set.lazy_emplace("xxx", make), "xxx");
+  EXPECT_EQ(*set.lazy_emplace("xxx", make), "xxx");
+  EXPECT_EQ(calls, 1);
+  // A duplicate `emplace` doesn't construct a string.
+  std::string value(100, 'y');
+  EXPECT_TRUE(set.emplace(std::move(value)).second);
+  value.assign(100, 'y');
+  EXPECT_FALSE(set.emplace(std::move(value)).second);
+  EXPECT_EQ(value.size(), 100);
+  EXPECT_EQ(set.size(), 2);
+}
+
+// Counts the calls, to check that the overloads taking a hash don't
+// hash the key again.
+struct CountingHasher {
+  static size_t calls;
+  size_t operator()(uint64_t v) const {
+    ++calls;
+    return absl::Hash<uint64_t>()(v);
+  }
+};
+size_t CountingHasher::calls = 0;
+
+TEST(GraveyardSet, PrecomputedHash) {
+  GraveyardSet<uint64_t, CountingHasher> set;
+  std::vector<size_t> hashes;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    hashes.push_back(absl::Hash<uint64_t>()(i));
+  }
+  CountingHasher::calls = 0;
+  for (uint64_t i = 0; i < 1000; ++i) {
+    set.prefetch(hashes[i]);
+    if (i % 2 == 0) {
+      EXPECT_TRUE(set.insert(i, hashes[i]).second);
+      EXPECT_FALSE(set.insert(i, hashes[i]).second);
+    } else {
+      EXPECT_TRUE(set.emplace_with_hash(hashes[i], i).second);
+      EXPECT_FALSE(set.emplace_with_hash(hashes[i], i).second);
+    }
+  }
+  // Only the rehashes hash the values.
+  const size_t rehash_calls = CountingHasher::calls;
+  EXPECT_LT(rehash_calls, 3000);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(set.contains(i, hashes[i]));
+    EXPECT_EQ(set.count(i, hashes[i]), 1);
+    EXPECT_EQ(*set.find(i, hashes[i]), i);
+  }
+  EXPECT_EQ(set.erase(uint64_t{1}, hashes[1]), 1);
+  EXPECT_EQ(set.erase(uint64_t{1}, hashes[1]), 0);
+  auto node = set.extract(uint64_t{2}, hashes[2]);
+  ASSERT_FALSE(node.empty());
+  EXPECT_EQ(node.value(), 2);
+  EXPECT_TRUE(set.extract(uint64_t{2}, hashes[2]).empty());
+  EXPECT_EQ(*set.lazy_emplace(uint64_t{2}, hashes[2],
+                              [](const auto &construct) { construct(2); }),
+            2);
+  EXPECT_EQ(CountingHasher::calls, rehash_calls);
+  EXPECT_EQ(set.size(), 999);
+  EXPECT_FALSE(set.contains(1));
+  set.Validate();
+}
+
+template <class Hash> void TestContainsMany() {
+  absl::BitGen bitgen;
+  for (size_t size : {0, 3, 100, 10000}) {
+    GraveyardSet<uint64_t, Hash> set;
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < size; ++i) {
+      uint64_t value = absl::Uniform<uint64_t>(bitgen);
+      set.insert(value);
+      keys.push_back(value);
+      // Often an H2 match (with the identity hash).
+      keys.push_back(value ^ (uint64_t{1} << 63));
+    }
+    for (size_t i = 0; i < 100; ++i) {
+      keys.push_back(absl::Uniform<uint64_t>(bitgen));
+    }
+    for (size_t n : {size_t{0}, size_t{7}, keys.size()}) {
+      std::unique_ptr<bool[]> found(new bool[n]);
+      set.contains_many(keys.data(), n, found.get());
+      for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(found[i], set.contains(keys[i]))
+            << "size=" << size << " i=" << i << " key=" << keys[i];
+      }
+    }
+  }
+}
+
+TEST(GraveyardSet, ContainsMany) {
+  TestContainsMany<yobiduck::IdentityHash>();
+  TestContainsMany<yobiduck::FibonacciHash>();
+  TestContainsMany<absl::Hash<uint64_t>>();
+}
+
+TEST(GraveyardSet, MixHash) {
+  GraveyardSet<uint64_t, yobiduck::MixHash> set;
+  // Strided keys, which have the same low bits.
+  for (uint64_t i = 0; i < 10000; ++i) {
+    set.insert(i << 32);
+  }
+  EXPECT_EQ(set.size(), 10000);
+  EXPECT_TRUE(set.contains(uint64_t{9999} << 32));
+  EXPECT_FALSE(set.contains(1));
+  set.Validate();
+}
+
+TEST(GraveyardSet, StringHash) {
+  yobiduck::StringHash hash;
+  // Every length up to 100 hits each of the code paths (and their
+  // boundaries).  Prefixes of the same string are the hard case.
+  const std::string all(100, 'x');
+  std::vector<size_t> hashes;
+  GraveyardSet<std::string, yobiduck::StringHash, std::equal_to<>> set;
+  for (size_t len = 0; len <= all.size(); ++len) {
+    std::string s = all.substr(0, len);
+    hashes.push_back(hash(s));
+    set.insert(s);
+    // Changing any one byte changes the hash.
+    for (size_t i = 0; i < len; ++i) {
+      std::string t = s;
+      t[i] = 'y';
+      EXPECT_NE(hash(t), hashes.back()) << "len=" << len << " i=" << i;
+    }
+  }
+  EXPECT_EQ(absl::flat_hash_set<size_t>(hashes.begin(), hashes.end()).size(),
+            hashes.size());
+  EXPECT_EQ(set.size(), all.size() + 1);
+  // Transparent lookups.
+  EXPECT_TRUE(set.contains(all.c_str() + 83));
+  EXPECT_TRUE(set.contains("xxx"));
+  EXPECT_FALSE(set.contains("xxy"));
+  EXPECT_EQ(hash("abc"), hash(std::string("abc")));
+}
+
+namespace {
+struct WatchdogTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::IdentityHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kHashWatchdog = true;
+};
+}  // namespace
+
+TEST(GraveyardSet, HashWatchdog) {
+  using Set = yobiduck::internal::HashTable<WatchdogTraits>;
+  // With the identity hash these keys all prefer the first bucket, so
+  // without the watchdog they would overflow the search distance.
+  constexpr uint64_t N = 100000;
+  Set set;
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_TRUE(set.insert(i << 8).second) << i;
+  }
+  EXPECT_EQ(set.size(), N);
+  for (uint64_t i = 0; i < N; ++i) {
+    ASSERT_TRUE(set.contains(i << 8)) << i;
+    ASSERT_FALSE(set.contains((i << 8) + 1)) << i;
+  }
+  set.Validate();
+  EXPECT_LT(set.GetProbeStatistics().successful, 2);
+  // Copies hash the same way, and tables with different seeds still
+  // combine correctly.
+  Set copy(set);
+  copy.Validate();
+  EXPECT_TRUE(copy.Equals(set));
+  Set small;
+  for (uint64_t i = 0; i < 10; ++i) {
+    small.insert(i << 8);
+  }
+  Set intersection;
+  intersection
+      .AssignSetOperation<yobiduck::internal::SetOperation::kIntersection>(
+          set, small, [](uint64_t a, uint64_t) { return a; });
+  EXPECT_TRUE(intersection.Equals(small));
+  set.merge(small);
+  EXPECT_EQ(set.size(), N);
+  EXPECT_EQ(small.size(), 10);
+  // An emptied table starts over without a seed.
+  set.clear();
+  for (uint64_t i = 0; i < 10; ++i) {
+    set.insert(i << 8);
+  }
+  EXPECT_TRUE(set.Equals(small));
+  set.Validate();
+}
+
+TEST(GraveyardSet, SetAlgebraOfReseededTables) {
+  using Set = yobiduck::internal::HashTable<WatchdogTraits>;
+  using yobiduck::internal::SetOperation;
+  // As in `HashWatchdog`, these keys make the table reseed.
+  constexpr uint64_t N = 3000;
+  Set set;
+  for (uint64_t i = 0; i < N; ++i) {
+    set.insert(i << 8);
+  }
+  // A copy has the same seed, so the two are streamed together.
+  Set odd(set);
+  for (uint64_t i = 0; i < N; i += 2) {
+    odd.erase(i << 8);
+  }
+  auto first = [](uint64_t a, uint64_t) { return a; };
+  Set intersection;
+  intersection.AssignSetOperation<SetOperation::kIntersection>(set, odd,
+                                                               first);
+  intersection.Validate(__LINE__);
+  Set set_union;
+  set_union.AssignSetOperation<SetOperation::kUnion>(set, odd, first);
+  set_union.Validate(__LINE__);
+  Set difference;
+  difference.AssignSetOperation<SetOperation::kDifference>(set, odd, first);
+  difference.Validate(__LINE__);
+  EXPECT_EQ(intersection.size(), N / 2);
+  EXPECT_EQ(set_union.size(), N);
+  EXPECT_EQ(difference.size(), N / 2);
+  for (uint64_t i = 0; i < N; ++i) {
+    EXPECT_EQ(intersection.contains(i << 8), i % 2 == 1) << i;
+    EXPECT_TRUE(set_union.contains(i << 8)) << i;
+    EXPECT_EQ(difference.contains(i << 8), i % 2 == 0) << i;
+  }
+}
+
+namespace {
+struct CountingTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::FibonacciHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  using instrumentation = yobiduck::internal::CountingInstrumentation;
+};
+}  // namespace
+
+TEST(GraveyardSet, Instrumentation) {
+  using Set = yobiduck::internal::HashTable<CountingTraits>;
+  constexpr uint64_t N = 10000;
+  Set set;
+  EXPECT_EQ(set.GetInstrumentationSnapshot().finds(), 0);
+  for (uint64_t i = 0; i < N; ++i) {
+    set.insert(i);
+  }
+  // Duplicates aren't inserts.
+  set.insert(0);
+  for (uint64_t i = 0; i < 2 * N; ++i) {
+    EXPECT_EQ(set.contains(i), i < N);
+  }
+  auto snapshot = set.GetInstrumentationSnapshot();
+  EXPECT_EQ(snapshot.inserts(), N);
+  EXPECT_EQ(snapshot.hits(), N);
+  EXPECT_EQ(snapshot.misses(), N);
+  EXPECT_EQ(snapshot.finds(), 2 * N);
+  // Every hit visits at least one bucket.
+  EXPECT_EQ(snapshot.hit_probe_lengths[0], 0);
+  EXPECT_GT(snapshot.hit_probe_lengths[1], N / 2);
+  EXPECT_GT(snapshot.rehashes, 5);
+  EXPECT_GT(snapshot.rehash_bytes_moved, N * sizeof(uint64_t));
+  EXPECT_GT(snapshot.max_search_distance, 0);
+  // A copy starts counting from zero.
+  Set copy(set);
+  EXPECT_EQ(copy.GetInstrumentationSnapshot().finds(), 0);
+  copy.contains(N);
+  EXPECT_EQ(copy.GetInstrumentationSnapshot().misses(), 1);
+  EXPECT_EQ(set.GetInstrumentationSnapshot().misses(), N);
+  // The default policy takes no space.
+  EXPECT_EQ(sizeof(yobiduck::internal::HashTable<yobiduck::internal::HashTableTraits<
+                       uint64_t, void, yobiduck::FibonacciHash,
+                       std::equal_to<uint64_t>, std::allocator<uint64_t>>>),
+            3 * sizeof(size_t));
+}
+
+namespace {
+struct SampledCountingTraits : public CountingTraits {
+  using instrumentation = yobiduck::internal::SampledCountingInstrumentation;
+};
+}  // namespace
+
+TEST(GraveyardSet, SampledInstrumentation) {
+  using Set = yobiduck::internal::HashTable<SampledCountingTraits>;
+  constexpr uint64_t kPeriod = yobiduck::internal::kSampledFindPeriod;
+  constexpr uint64_t N = 100000;
+  Set set;
+  for (uint64_t i = 0; i < N; ++i) {
+    set.insert(i);
+  }
+  for (uint64_t i = 0; i < 2 * N; ++i) {
+    EXPECT_EQ(set.contains(i), i < N);
+  }
+  auto snapshot = set.GetInstrumentationSnapshot();
+  // Inserts aren't sampled.
+  EXPECT_EQ(snapshot.inserts(), N);
+  // Finds are, and the counts are scaled up.
+  EXPECT_EQ(snapshot.hits() % kPeriod, 0);
+  EXPECT_EQ(snapshot.misses() % kPeriod, 0);
+  EXPECT_NEAR(snapshot.hits(), N, N / 10);
+  EXPECT_NEAR(snapshot.misses(), N, N / 10);
+  // The finds are sampled, not the keys, so a find of the same key
+  // over and over is counted in proportion.
+  for (uint64_t i = 0; i < N; ++i) {
+    set.contains(7);
+  }
+  EXPECT_NEAR(set.GetInstrumentationSnapshot().hits() - snapshot.hits(), N,
+              N / 10);
+}
+
+namespace {
+struct SampledTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::FibonacciHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kSample = true;
+};
+struct BadlyHashedSampledTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::IdentityHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kSample = true;
+};
+}  // namespace
+
+TEST(GraveyardSet, Sampler) {
+  using Set = yobiduck::internal::HashTable<SampledTraits>;
+  using yobiduck::internal::TableSampler;
+  TableSampler &sampler = TableSampler::Global();
+  const size_t rate = sampler.sample_rate();
+  const size_t live_samples = sampler.Snapshot().size();
+  sampler.SetSampleRate(0);
+  {
+    Set set;
+    set.insert(1);
+    EXPECT_EQ(sampler.Snapshot().size(), live_samples);
+  }
+  sampler.SetSampleRate(1);
+  {
+    Set set;
+    constexpr uint64_t N = 1000;
+    for (uint64_t i = 0; i < N; ++i) {
+      set.insert(i);
+    }
+    set.erase(0);
+    auto snapshots = sampler.Snapshot();
+    ASSERT_EQ(snapshots.size(), live_samples + 1);
+    // The newest sample is at the head of the list.
+    const auto &sample = snapshots.front();
+    EXPECT_EQ(sample.value_size, sizeof(uint64_t));
+    EXPECT_EQ(sample.size, N - 1);
+    EXPECT_EQ(sample.max_size, N);
+    EXPECT_EQ(sample.capacity, set.capacity());
+    EXPECT_EQ(sample.allocated_bytes, set.GetAllocatedMemorySize());
+    EXPECT_EQ(sample.inserts, N);
+    EXPECT_GE(sample.average_insert_probe_length(), 1);
+    EXPECT_GE(sample.successful_probe_length, 1);
+    EXPECT_LT(sample.successful_probe_length, 2);
+    EXPECT_LT(sample.unsuccessful_probe_length, 2);
+    EXPECT_GT(sample.rehashes, 3);
+    ASSERT_FALSE(sample.rehash_history.empty());
+    EXPECT_EQ(sample.rehash_history.back(), set.capacity());
+    // A copy is sampled separately.
+    Set copy(set);
+    EXPECT_EQ(sampler.Snapshot().size(), live_samples + 2);
+    EXPECT_EQ(sampler.Snapshot().front().size, N - 1);
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_TRUE(sampler.Dump(fds[1], TableSampler::Format::kJson));
+    close(fds[1]);
+    std::string json;
+    char buffer[4096];
+    for (ssize_t n; (n = read(fds[0], buffer, sizeof(buffer))) > 0;) {
+      json.append(buffer, n);
+    }
+    close(fds[0]);
+    EXPECT_EQ(json.front(), '[');
+    EXPECT_NE(json.find("\"size\": 999,"), std::string::npos) << json;
+    EXPECT_NE(json.find("\"successful_probe_length\": "), std::string::npos)
+        << json;
+  }
+  {
+    // With the identity hash, these keys all prefer the first bucket,
+    // so a lookup of one of them visits many buckets.
+    yobiduck::internal::HashTable<BadlyHashedSampledTraits> set;
+    for (uint64_t i = 0; i < 1000; ++i) {
+      set.insert(i);
+    }
+    const auto sample = sampler.Snapshot().front();
+    EXPECT_EQ(sample.size, 1000);
+    EXPECT_GT(sample.successful_probe_length, 10);
+  }
+  // Destroyed tables free their samples, which are reused.
+  EXPECT_EQ(sampler.Snapshot().size(), live_samples);
+  {
+    Set set;
+    EXPECT_EQ(sampler.Snapshot().size(), live_samples + 1);
+  }
+  sampler.SetSampleRate(rate);
+}
+
+namespace {
+struct OnlineProbeTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kOnlineProbeStatistics = true;
+  static constexpr size_t shrink_utilization_numerator = 1;
+  static constexpr size_t shrink_utilization_denominator = 4;
+};
+}  // namespace
+
+TEST(GraveyardSet, OnlineProbeStatistics) {
+  using Set = yobiduck::internal::HashTable<OnlineProbeTraits>;
+  auto expect_matches = [](const Set &set) {
+    set.Validate(__LINE__);
+    if (set.empty()) {
+      return;
+    }
+    auto exact = set.GetProbeStatistics();
+    auto online = set.GetOnlineProbeStatistics();
+    EXPECT_DOUBLE_EQ(online.successful, exact.successful);
+    EXPECT_DOUBLE_EQ(online.unsuccessful, exact.unsuccessful);
+  };
+  absl::BitGen bitgen;
+  Set set;
+  std::vector<uint64_t> keys;
+  for (size_t i = 0; i < 20000; ++i) {
+    keys.push_back(bitgen());
+    set.insert(keys.back());
+  }
+  expect_matches(set);
+  // Erase by key, by iterator, and by extract, down to where it
+  // shrinks.
+  for (size_t i = 0; i < 18000; ++i) {
+    switch (i % 3) {
+    case 0:
+      set.erase(keys[i]);
+      break;
+    case 1:
+      set.erase(set.find(keys[i]));
+      break;
+    case 2:
+      set.extract(keys[i]);
+      break;
+    }
+  }
+  expect_matches(set);
+  Set other;
+  for (size_t i = 0; i < 1000; ++i) {
+    other.insert(keys[i]);
+    other.insert(bitgen());
+  }
+  Set copy(other);
+  expect_matches(copy);
+  set.merge(other);
+  expect_matches(set);
+  expect_matches(other);
+  set.rehash(0);
+  expect_matches(set);
+  set.swap(copy);
+  expect_matches(set);
+  expect_matches(copy);
+  set.clear();
+  expect_matches(set);
+}
+
+TEST(GraveyardSet, EstimateProbeStatistics) {
+  GraveyardSet<uint64_t> set;
+  absl::BitGen bitgen;
+  for (size_t i = 0; i < 100000; ++i) {
+    set.insert(bitgen());
+  }
+  auto exact = set.GetProbeStatistics();
+  auto estimate = set.EstimateProbeStatistics(1000, 1);
+  // The intervals are 95% ones, so allow for a little bad luck.
+  EXPECT_NEAR(estimate.mean.successful, exact.successful,
+              2 * estimate.error.successful);
+  EXPECT_NEAR(estimate.mean.unsuccessful, exact.unsuccessful,
+              2 * estimate.error.unsuccessful);
+  EXPECT_NEAR(estimate.mean.insert, exact.insert, 2 * estimate.error.insert);
+  EXPECT_LT(estimate.error.successful, 0.1);
+  EXPECT_GT(estimate.error.unsuccessful, 0);
+}
+
+namespace {
+struct BudgetTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kMemoryBudget = true;
+};
+}  // namespace
+
+TEST(GraveyardSet, MemoryBudget) {
+  using Set = yobiduck::internal::HashTable<BudgetTraits>;
+  using yobiduck::internal::MemoryBudget;
+  MemoryBudget &budget = MemoryBudget::Global();
+  constexpr uint64_t N = 100000;
+  Set hot, cold;
+  for (uint64_t i = 0; i < N; ++i) {
+    hot.insert(i);
+    cold.insert(i);
+  }
+  for (uint64_t i = 0; i < N; ++i) {
+    EXPECT_TRUE(hot.contains(i));
+  }
+  const size_t default_bytes =
+      hot.GetAllocatedMemorySize() + cold.GetAllocatedMemorySize();
+  // Plenty of memory: both tables go spacious, and grow.
+  budget.SetBudget(0);
+  auto report = budget.Rebalance();
+  EXPECT_EQ(report.tables, 2);
+  EXPECT_EQ(report.spacious, 2);
+  EXPECT_EQ(report.allocated_bytes, default_bytes);
+  hot.Maintain();
+  cold.Maintain();
+  hot.Validate();
+  EXPECT_LE(hot.size(), hot.capacity() * 7 / 10);
+  const size_t spacious_bytes = hot.GetAllocatedMemorySize();
+  EXPECT_GT(spacious_bytes, default_bytes / 2);
+  // A tight budget makes the cold table dense before the hot one.
+  budget.SetBudget(report.projected_bytes * 3 / 4);
+  for (uint64_t i = 0; i < N; ++i) {
+    EXPECT_TRUE(hot.contains(i));
+  }
+  report = budget.Rebalance();
+  EXPECT_EQ(report.dense, 1);
+  EXPECT_EQ(report.spacious, 0);
+  EXPECT_LE(report.projected_bytes, budget.budget());
+  cold.Maintain();
+  hot.Maintain();
+  cold.Validate();
+  hot.Validate();
+  EXPECT_LT(cold.GetAllocatedMemorySize(), spacious_bytes * 3 / 5);
+  EXPECT_LT(hot.GetAllocatedMemorySize(), spacious_bytes);
+  EXPECT_LT(cold.GetAllocatedMemorySize(), hot.GetAllocatedMemorySize());
+  // A dense table grows only when it's 15/16 full.
+  const size_t capacity = cold.capacity();
+  for (uint64_t i = N; cold.size() < capacity * 7 / 8; ++i) {
+    cold.insert(i);
+  }
+  EXPECT_EQ(cold.capacity(), capacity);
+  cold.Validate();
+  // A copy registers separately.
+  {
+    Set copy(cold);
+    EXPECT_EQ(budget.Rebalance().tables, 3);
+  }
+  EXPECT_EQ(budget.Rebalance().tables, 2);
+  budget.SetBudget(0);
+}
+
+TEST(GraveyardSet, MemoryBudgetSwap) {
+  using Set = yobiduck::internal::HashTable<BudgetTraits>;
+  using yobiduck::internal::MemoryBudget;
+  MemoryBudget &budget = MemoryBudget::Global();
+  Set full;
+  {
+    Set empty;
+    for (uint64_t i = 0; i < 10000; ++i) {
+      full.insert(i);
+    }
+    EXPECT_EQ(budget.Rebalance().allocated_bytes,
+              full.GetAllocatedMemorySize());
+    // The entries follow the contents, so destroying `empty` (which now
+    // holds the values) takes their bytes out of the budget.
+    full.swap(empty);
+    EXPECT_EQ(budget.Rebalance().allocated_bytes,
+              empty.GetAllocatedMemorySize());
+  }
+  EXPECT_EQ(budget.Rebalance().tables, 1);
+  EXPECT_EQ(budget.Rebalance().allocated_bytes, full.GetAllocatedMemorySize());
+}
+
+namespace {
+template <bool kZero>
+struct PrefaultTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {
+  static constexpr bool kZeroIsEmpty = kZero;
+  static constexpr bool kPrefaultNextBuckets = true;
+};
+
+template <bool kZero> void TestPrefaultNextBuckets() {
+  using Set = yobiduck::internal::HashTable<PrefaultTraits<kZero>>;
+  // Big enough that the later bucket arrays are mmapped.
+  constexpr uint64_t N = 200000;
+  Set set;
+  size_t growths = 0, reused = 0;
+  for (uint64_t i = 0; i < N; ++i) {
+    const size_t capacity = set.capacity();
+    const size_t bytes = set.GetAllocatedMemorySize();
+    set.insert(i);
+    if (set.capacity() != capacity && capacity > 0) {
+      ++growths;
+      // The table grew into the array it had prefaulted, so it let go
+      // of only its old array.
+      reused += set.GetAllocatedMemorySize() < bytes;
+    }
+  }
+  set.Validate();
+  EXPECT_EQ(set.size(), N);
+  for (uint64_t i = 0; i < N; ++i) {
+    EXPECT_TRUE(set.contains(i)) << i;
+  }
+  EXPECT_GT(growths, 5);
+  EXPECT_EQ(reused, growths);
+  // Erasing shrinks the table, which lets go of any prefaulted array.
+  for (uint64_t i = 0; i < N; ++i) {
+    if (i % 64 != 0) {
+      set.erase(i);
+    }
+  }
+  set.Validate();
+  EXPECT_EQ(set.size(), N / 64);
+  Set copy(set), other;
+  copy.swap(other);
+  EXPECT_TRUE(copy.empty());
+  other.Validate();
+  EXPECT_EQ(other.size(), set.size());
+  set.clear();
+  EXPECT_EQ(set.GetAllocatedMemorySize(), 0);
+  set.insert(7);
+  EXPECT_THAT(set, UnorderedElementsAre(7));
+}
+}  // namespace
+
+TEST(GraveyardSet, PrefaultNextBuckets) {
+  TestPrefaultNextBuckets<false>();
+  TestPrefaultNextBuckets<true>();
+}
+
+namespace {
+struct BackgroundMapTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, uint64_t, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<std::pair<const uint64_t, uint64_t>>> {};
+}  // namespace
+
+TEST(GraveyardSet, BackgroundRehash) {
+  using Map = yobiduck::internal::BackgroundRehashTable<BackgroundMapTraits>;
+  absl::BitGen bitgen;
+  constexpr uint64_t N = 300000;
+  Map map(/*min_background_size=*/1000);
+  absl::flat_hash_map<uint64_t, uint64_t> fmap;
+  size_t rehashes = 0;
+  for (uint64_t i = 0; i < N; ++i) {
+    const uint64_t key = absl::Uniform<uint64_t>(bitgen, 0, N);
+    const bool was_rehashing = map.rehash_in_progress();
+    if (absl::Bernoulli(bitgen, 0.2)) {
+      EXPECT_EQ(map.erase(key), fmap.erase(key));
+    } else {
+      EXPECT_EQ(map.insert({key, i}), fmap.insert({key, i}).second);
+    }
+    rehashes += !was_rehashing && map.rehash_in_progress();
+    const uint64_t probe = absl::Uniform<uint64_t>(bitgen, 0, N);
+    const auto *found = map.find(probe);
+    auto it = fmap.find(probe);
+    ASSERT_EQ(found != nullptr, it != fmap.end()) << probe;
+    if (found != nullptr) {
+      EXPECT_EQ(found->second, it->second);
+    }
+    EXPECT_EQ(map.size(), fmap.size());
+    EXPECT_GE(map.rehash_progress(), 0);
+    EXPECT_LE(map.rehash_progress(), 1);
+  }
+  EXPECT_GT(rehashes, 0);
+  map.wait_for_rehash();
+  EXPECT_FALSE(map.rehash_in_progress());
+  EXPECT_EQ(map.side_log_size(), 0);
+  EXPECT_EQ(map.table().size(), fmap.size());
+  for (const auto &[key, value] : fmap) {
+    const auto *found = map.find(key);
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->second, value);
+  }
+  // An erased and reinserted key ends up with its new value.
+  uint64_t key = N;
+  while (!map.rehash_in_progress()) {
+    map.insert({++key, 0});
+  }
+  EXPECT_EQ(map.erase(N + 1), 1);
+  EXPECT_TRUE(map.insert({N + 1, 42}));
+  EXPECT_FALSE(map.insert({N + 1, 43}));
+  EXPECT_EQ(map.find(N + 1)->second, 42);
+  map.wait_for_rehash();
+  EXPECT_EQ(map.find(N + 1)->second, 42);
+  map.clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_FALSE(map.contains(N + 1));
+  // The copies have graveyard tombstones, and are valid.
+  yobiduck::internal::BackgroundRehashTable<OnlineProbeTraits> set(1000);
+  for (uint64_t i = 0; i < N; ++i) {
+    set.insert(i);
+  }
+  set.wait_for_rehash();
+  set.table().Validate();
+  EXPECT_EQ(set.table().size(), N);
+}
+
+TEST(GraveyardSet, SingleWriterTable) {
+  using Table = yobiduck::internal::SingleWriterTable<BackgroundMapTraits>;
+  constexpr uint64_t N = 200000;
+  Table table;
+  // The keys below `published` have been inserted, and those that are
+  // multiples of 4 erased again.
+  std::atomic<uint64_t> published{0};
+  std::atomic<bool> done{false};
+  std::atomic<size_t> finds{0};
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 3; ++r) {
+    readers.emplace_back([&]() {
+      Table::Reader reader = table.NewReader();
+      absl::BitGen bitgen;
+      while (!done.load(std::memory_order_relaxed)) {
+        const uint64_t upto = published.load(std::memory_order_acquire);
+        const uint64_t key = absl::Uniform<uint64_t>(bitgen, 0, N);
+        uint64_t value = 0;
+        const bool found = reader.find(key, &value);
+        if (found) {
+          EXPECT_EQ(value, 3 * key);
+        } else if (key < upto) {
+          EXPECT_EQ(key % 4, 0) << key;
+        }
+        finds.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (uint64_t key = 0; key < N; ++key) {
+    EXPECT_TRUE(table.insert({key, 3 * key}));
+    EXPECT_FALSE(table.insert({key, 0}));
+    if (key % 4 == 0) {
+      EXPECT_EQ(table.erase(key), 1);
+    }
+    published.store(key + 1, std::memory_order_release);
+  }
+  done.store(true);
+  for (std::thread &reader : readers) {
+    reader.join();
+  }
+  EXPECT_GT(finds.load(), 0);
+  EXPECT_EQ(table.size(), N - N / 4);
+  EXPECT_EQ(table.erase(4), 0);
+  table.Reclaim();
+  EXPECT_EQ(table.retired_count(), 0);
+  Table::Reader reader = table.NewReader();
+  for (uint64_t key = 0; key < N; ++key) {
+    EXPECT_EQ(reader.contains(key), key % 4 != 0) << key;
+  }
+}
+
+namespace {
+struct ConcurrentSetTraits
+    : public yobiduck::internal::HashTableTraits<
+          uint64_t, void, yobiduck::MixHash, std::equal_to<uint64_t>,
+          std::allocator<uint64_t>> {};
+}  // namespace
+
+TEST(GraveyardSet, ConcurrentInsert) {
+  using Table = yobiduck::internal::ConcurrentInsertTable<ConcurrentSetTraits>;
+  constexpr uint64_t N = 200000;
+  constexpr int kThreads = 4;
+  // Each is coprime to `N`, so each thread's order is a permutation.
+  constexpr uint64_t kMultipliers[kThreads] = {1, 3, 7, 9};
+  // Start small, so that the inserts race with many growths.
+  Table table(/*capacity=*/16);
+  const size_t initial_capacity = table.capacity();
+  std::atomic<size_t> inserted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      // Every thread inserts every key (in its own order), so each key
+      // is raced for.
+      size_t count = 0;
+      for (uint64_t i = 0; i < N; ++i) {
+        const uint64_t key = (i * kMultipliers[t] + t * 7919) % N;
+        count += table.insert(key);
+        EXPECT_TRUE(table.contains(key)) << key;
+        EXPECT_FALSE(table.insert(key)) << key;
+      }
+      inserted.fetch_add(count);
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(inserted.load(), N);
+  EXPECT_EQ(table.size(), N);
+  EXPECT_GT(table.capacity(), initial_capacity);
+  std::vector<int> seen(N);
+  table.for_each([&](uint64_t key) {
+    ASSERT_LT(key, N);
+    ++seen[key];
+  });
+  for (uint64_t key = 0; key < N; ++key) {
+    EXPECT_EQ(seen[key], 1) << key;
+    EXPECT_TRUE(table.contains(key)) << key;
+  }
+  for (uint64_t key = N; key < N + 1000; ++key) {
+    EXPECT_FALSE(table.contains(key)) << key;
+  }
+}
+
+TEST(GraveyardSet, BuildParallel) {
+  using Set = yobiduck::GraveyardSet<uint64_t, yobiduck::MixHash>;
+  absl::BitGen bitgen;
+  // With duplicates.
+  std::vector<uint64_t> values;
+  for (size_t i = 0; i < 200000; ++i) {
+    values.push_back(absl::Uniform<uint64_t>(bitgen, 0, 150000));
+  }
+  const absl::flat_hash_set<uint64_t> distinct(values.begin(), values.end());
+  Set sequential = Set::Build(values);
+  sequential.Validate(__LINE__);
+  EXPECT_EQ(sequential.size(), distinct.size());
+  for (uint64_t value : distinct) {
+    EXPECT_TRUE(sequential.contains(value)) << value;
+  }
+  const std::string layout = sequential.ToString();
+  // Many threads make many seams, some of which values spill across.
+  for (size_t threads : {2, 3, 16, 64}) {
+    Set parallel = Set::BuildParallel(values, threads);
+    parallel.Validate(__LINE__);
+    EXPECT_EQ(parallel.size(), distinct.size());
+    EXPECT_EQ(parallel.ToString(), layout) << threads;
+  }
+  EXPECT_TRUE(Set::BuildParallel({}, 4).empty());
+}
+
+// Dense keys with the identity hash all prefer bucket 0, which is too
+// many for the bulk layout.
+TEST(GraveyardSet, BuildClusteredHash) {
+  constexpr uint64_t N = 100000;
+  std::vector<uint64_t> values;
+  for (uint64_t i = 0; i < N; ++i) {
+    values.push_back(i);
+  }
+  // With the watchdog, the build falls back to inserts, which reseed.
+  for (size_t threads : {1, 4}) {
+    yobiduck::internal::HashTable<WatchdogTraits> table;
+    table.AssignBulkParallel(values, threads);
+    table.Validate(__LINE__);
+    EXPECT_EQ(table.size(), N);
+    for (uint64_t i = 0; i < N; ++i) {
+      ASSERT_TRUE(table.contains(i)) << i;
+    }
+  }
+  // Without it, the build fails as an insert would, rather than making
+  // a table that can't find its values.
+  using Set = yobiduck::GraveyardSet<uint64_t, yobiduck::IdentityHash>;
+  EXPECT_DEATH(Set::Build(values), "Too many keys hash to the same place");
+}
+
+TEST(GraveyardSet, SegmentedTable) {
+  using Table = yobiduck::internal::SegmentedTable<ConcurrentSetTraits>;
+  constexpr size_t kMaxSegmentSize = 1000;
+  Table table(kMaxSegmentSize);
+  EXPECT_EQ(table.segment_count(), 1);
+  absl::BitGen bitgen;
+  absl::flat_hash_set<uint64_t> reference;
+  for (size_t i = 0; i < 100000; ++i) {
+    // With duplicates.
+    const uint64_t key = absl::Uniform<uint64_t>(bitgen, 0, 80000);
+    auto [value, inserted] = table.insert(key);
+    EXPECT_EQ(inserted, reference.insert(key).second) << key;
+    EXPECT_EQ(*value, key);
+    if (i % 20000 == 0) {
+      table.Validate();
+    }
+  }
+  table.Validate();
+  EXPECT_EQ(table.size(), reference.size());
+  // Every segment split before it got past its maximum size.
+  EXPECT_GE(table.segment_count(), reference.size() / kMaxSegmentSize);
+  EXPECT_GE(size_t{1} << table.global_depth(), table.segment_count());
+  for (uint64_t key : reference) {
+    Table::pointer found = table.find(key);
+    ASSERT_NE(found, nullptr) << key;
+    EXPECT_EQ(*found, key);
+  }
+  EXPECT_FALSE(table.contains(80000));
+  size_t visited = 0;
+  table.for_each([&](uint64_t key) {
+    EXPECT_TRUE(reference.contains(key)) << key;
+    ++visited;
+  });
+  EXPECT_EQ(visited, reference.size());
+  for (uint64_t key = 0; key < 80000; key += 2) {
+    EXPECT_EQ(table.erase(key), reference.erase(key)) << key;
+  }
+  table.Validate();
+  EXPECT_EQ(table.size(), reference.size());
+  for (uint64_t key = 0; key < 80000; ++key) {
+    EXPECT_EQ(table.contains(key), reference.contains(key)) << key;
+  }
+  table.clear();
+  EXPECT_TRUE(table.empty());
+  EXPECT_EQ(table.segment_count(), 1);
+}
+
+TEST(GraveyardSet, SegmentedTablePoorHighBits) {
+  // The identity hash of small keys has all its high bits zero, so a
+  // split would send every value to the lower half.  Instead, the
+  // segment grows (and the watchdog reseeds it, since its values
+  // cluster in its first buckets too).
+  using Table = yobiduck::internal::SegmentedTable<WatchdogTraits>;
+  constexpr size_t kMaxSegmentSize = 1000;
+  {
+    Table table(kMaxSegmentSize);
+    for (uint64_t key = 0; key < 5000; ++key) {
+      EXPECT_TRUE(table.insert(key).second) << key;
+    }
+    table.Validate();
+    EXPECT_EQ(table.size(), 5000);
+    EXPECT_EQ(table.global_depth(), 0);
+    EXPECT_EQ(table.segment_count(), 1);
+    for (uint64_t key = 0; key < 5000; ++key) {
+      EXPECT_TRUE(table.contains(key)) << key;
+    }
+  }
+  // A few outliers, each of which differs from the rest in one more
+  // bit, let the big segment split one bit at a time (doubling the
+  // directory each time), but only to within a few bits of the depth
+  // that the values need.
+  Table table(kMaxSegmentSize);
+  std::vector<uint64_t> keys;
+  for (int bit = 63; bit >= 40; --bit) {
+    keys.push_back(uint64_t{1} << bit);
+  }
+  for (uint64_t key = 0; key < 5000; ++key) {
+    keys.push_back(key);
+  }
+  for (uint64_t key : keys) {
+    EXPECT_TRUE(table.insert(key).second) << key;
+  }
+  table.Validate();
+  EXPECT_EQ(table.size(), keys.size());
+  EXPECT_GT(table.global_depth(), 0);
+  EXPECT_LE(table.global_depth(), 10);
+  for (uint64_t key : keys) {
+    EXPECT_TRUE(table.contains(key)) << key;
+  }
+}
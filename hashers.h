@@ -0,0 +1,155 @@
+#ifndef _GRAVEYARD_HASHERS_H_
+#define _GRAVEYARD_HASHERS_H_
+
+// Hash functions tuned for the way the table uses a hash: H1 is the
+// high bits of `hash * logical_bucket_count` and H2 is the low 6 bits.
+// So a good hash here needs well-mixed high bits and low bits; the
+// middle bits matter less.
+//
+// For integers:
+//
+//   `IdentityHash`: Only for keys that are already random.
+//
+//   `FibonacciHash`: One multiply.  The high bits are good for
+//     sequential and strided keys, but the low bits (H2) only depend
+//     on the key's low bits, so keys that are multiples of 64 all get
+//     the same H2.
+//
+//   `MixHash`: Two 128-bit multiplies, each folded.  Good high and low
+//     bits for any keys.
+//
+// For strings, `StringHash` is in the style of wyhash: it multiplies
+// 64-bit words into 128-bit products and folds them.
+//
+// A hasher with a `kMultiplier` member promises that it computes
+// `key * kMultiplier` (modulo 2^64).  `contains_many` uses that to
+// hash eight keys at once in a vector register.
+//
+// See benchmark/hasher_benchmark.cc for speed and probe lengths.
+
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <cstring> // for memcpy
+#include <string_view>
+
+namespace yobiduck {
+
+// Returns the key.  The identity is only good for keys whose high bits
+// are already well distributed.
+struct IdentityHash {
+  static constexpr uint64_t kMultiplier = 1;
+  size_t operator()(uint64_t key) const { return key; }
+};
+
+// Multiplies by 2^64 divided by the golden ratio, which spreads out
+// sequential and strided keys in the high bits.
+struct FibonacciHash {
+  static constexpr uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+  size_t operator()(uint64_t key) const { return key * kMultiplier; }
+};
+
+namespace internal {
+
+// Returns the xor of the halves of the 128-bit product `a * b`.
+inline uint64_t MultiplyFold(uint64_t a, uint64_t b) {
+  const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(product) ^
+         static_cast<uint64_t>(product >> 64);
+}
+
+} // namespace internal
+
+// Like `FibonacciHash`, but folds the high half of the 128-bit product
+// into the low half, twice, so that every bit of the hash depends on
+// every bit of the key.  (One round isn't enough: for small keys the
+// high half of the product is small, so the high bits of the hash are
+// those of `FibonacciHash`.)
+struct MixHash {
+  size_t operator()(uint64_t key) const {
+    return internal::MultiplyFold(
+        internal::MultiplyFold(key, FibonacciHash::kMultiplier),
+        0xe7037ed1a0b428dbull);
+  }
+};
+
+// Hashes strings (and anything convertible to `std::string_view`).
+// Transparent, so sets of `std::string` can look up `string_view`s and
+// `const char *`s without constructing a string.
+struct StringHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return Hash(s.data(), s.size());
+  }
+
+  static uint64_t Hash(const char *p, size_t len) {
+    uint64_t seed = kSecret[0];
+    uint64_t a, b;
+    if (len <= 16) {
+      if (len >= 4) {
+        // Two overlapping pairs of 32-bit words cover all the bytes.
+        const size_t step = (len >> 3) << 2;
+        a = (Read32(p) << 32) | Read32(p + step);
+        b = (Read32(p + len - 4) << 32) | Read32(p + len - 4 - step);
+      } else if (len > 0) {
+        a = (uint64_t{static_cast<uint8_t>(p[0])} << 16) |
+            (uint64_t{static_cast<uint8_t>(p[len >> 1])} << 8) |
+            static_cast<uint8_t>(p[len - 1]);
+        b = 0;
+      } else {
+        a = b = 0;
+      }
+    } else {
+      size_t remaining = len;
+      if (remaining > 48) {
+        // Three independent lanes, so the multiplies overlap.
+        uint64_t seed1 = seed, seed2 = seed;
+        do {
+          seed = internal::MultiplyFold(Read64(p) ^ kSecret[1],
+                                        Read64(p + 8) ^ seed);
+          seed1 = internal::MultiplyFold(Read64(p + 16) ^ kSecret[2],
+                                         Read64(p + 24) ^ seed1);
+          seed2 = internal::MultiplyFold(Read64(p + 32) ^ kSecret[3],
+                                         Read64(p + 40) ^ seed2);
+          p += 48;
+          remaining -= 48;
+        } while (remaining > 48);
+        seed ^= seed1 ^ seed2;
+      }
+      while (remaining > 16) {
+        seed = internal::MultiplyFold(Read64(p) ^ kSecret[1],
+                                      Read64(p + 8) ^ seed);
+        p += 16;
+        remaining -= 16;
+      }
+      // The last 16 bytes (which may overlap bytes already hashed).
+      a = Read64(p + remaining - 16);
+      b = Read64(p + remaining - 8);
+    }
+    const unsigned __int128 product =
+        static_cast<unsigned __int128>(a ^ kSecret[1]) * (b ^ seed);
+    return internal::MultiplyFold(
+        static_cast<uint64_t>(product) ^ kSecret[0] ^ len,
+        static_cast<uint64_t>(product >> 64) ^ kSecret[1]);
+  }
+
+private:
+  // Odd constants with 32 bits set in each (from wyhash).
+  static constexpr uint64_t kSecret[4] = {
+      0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+      0x589965cc75374cc3ull};
+
+  static uint64_t Read64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static uint64_t Read32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+};
+
+} // namespace yobiduck
+
+#endif // _GRAVEYARD_HASHERS_H_
@@ -0,0 +1,208 @@
+#ifndef _GRAVEYARD_INTERNAL_BACKGROUND_REHASH_H_
+#define _GRAVEYARD_INTERNAL_BACKGROUND_REHASH_H_
+
+// A `HashTable` that grows on a background thread, for services that
+// can't afford the latency of a big table's rehash on a request.
+//
+// When an insert would grow a table of at least `min_background_size`
+// values, `BackgroundRehashTable` freezes the table and starts a worker
+// thread that copies it into a new, bigger table (see
+// `HashTable::AssignRehashedCopy`).  Meanwhile finds read the frozen
+// table, and inserts and erases go to a side log (a table of the
+// inserted values and a set of the erased keys) that finds check first.
+// The next insert or erase after the worker finishes replays the log
+// into the new table and swaps the two tables' pointers.
+//
+// So a growth costs the request thread only the replay, at the price of
+// holding both tables (and the log) while the worker copies.
+//
+// Like `HashTable`, a `BackgroundRehashTable` is used by one thread at a
+// time: the only concurrency is between its owner's finds and the
+// worker, which both only read the frozen table.  Values are found
+// through const pointers, so a map's values can't be modified in place
+// (insert a new value instead).
+
+#include <atomic>
+#include <cstddef> // for size_t
+#include <memory>  // for unique_ptr, allocator_traits
+#include <thread>
+
+#include "internal/hash_table.h"
+
+namespace yobiduck::internal {
+
+template <class Traits> class BackgroundRehashTable {
+public:
+  using Table = HashTable<Traits>;
+  using key_type = typename Traits::key_type;
+  using value_type = typename Traits::value_type;
+
+  // Tables smaller than this grow on the calling thread as usual.
+  static constexpr size_t kDefaultMinBackgroundSize = 1 << 16;
+
+  explicit BackgroundRehashTable(
+      size_t min_background_size = kDefaultMinBackgroundSize)
+      : min_background_size_(min_background_size),
+        table_(std::make_unique<Table>()) {}
+  BackgroundRehashTable(const BackgroundRehashTable &) = delete;
+  BackgroundRehashTable &operator=(const BackgroundRehashTable &) = delete;
+  ~BackgroundRehashTable() { wait_for_rehash(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the value whose key is `key`, or null.  The pointer is
+  // invalidated by the next insert or erase.
+  const value_type *find(const key_type &key) const {
+    if (rehash_in_progress()) {
+      if (auto it = inserted_.find(key); it != inserted_.end()) {
+        return &*it;
+      }
+      if (erased_.contains(key)) {
+        return nullptr;
+      }
+    }
+    // Through a const reference, since the worker may be reading it.
+    const Table &table = *table_;
+    auto it = table.find(key);
+    return it == table.end() ? nullptr : &*it;
+  }
+  bool contains(const key_type &key) const { return find(key) != nullptr; }
+
+  // Inserts `value` if its key isn't present.  Returns true if it
+  // inserted.
+  bool insert(const value_type &value) {
+    MaybeFinishRehash();
+    if (!rehash_in_progress()) {
+      if (size_ < min_background_size_ || !table_->WouldGrow(1)) {
+        const bool inserted = table_->insert(value).second;
+        size_ += inserted;
+        return inserted;
+      }
+      if (table_->contains(Traits::KeyOf(value))) {
+        return false;
+      }
+      StartRehash();
+    } else if (contains(Traits::KeyOf(value))) {
+      return false;
+    }
+    inserted_.insert(value);
+    ++size_;
+    return true;
+  }
+
+  // Erases the value whose key is `key`.  Returns the number erased.
+  size_t erase(const key_type &key) {
+    MaybeFinishRehash();
+    if (!rehash_in_progress()) {
+      const size_t erased = table_->erase(key);
+      size_ -= erased;
+      return erased;
+    }
+    if (!contains(key)) {
+      return 0;
+    }
+    inserted_.erase(key);
+    erased_.insert(key);
+    --size_;
+    return 1;
+  }
+
+  void clear() {
+    wait_for_rehash();
+    table_->clear();
+    size_ = 0;
+  }
+
+  bool rehash_in_progress() const { return worker_.joinable(); }
+
+  // The fraction of the frozen table that the worker has copied (1 if
+  // there's no rehash in progress).
+  double rehash_progress() const {
+    if (!rehash_in_progress() || table_->empty()) {
+      return 1;
+    }
+    return static_cast<double>(copied_.load(std::memory_order_relaxed)) /
+           table_->size();
+  }
+
+  // The number of inserts and erases waiting to be replayed.
+  size_t side_log_size() const { return inserted_.size() + erased_.size(); }
+
+  // Waits for the rehash in progress, if any, and finishes it.
+  void wait_for_rehash() {
+    if (rehash_in_progress()) {
+      FinishRehash();
+    }
+  }
+
+  // The table that finds read (frozen during a rehash).
+  const Table &table() const { return *table_; }
+
+private:
+  // A set of keys that hashes the way the table does.
+  using KeySetTraits = HashTableTraits<
+      key_type, void, typename Traits::hasher, typename Traits::key_equal,
+      typename std::allocator_traits<
+          typename Traits::allocator>::template rebind_alloc<key_type>>;
+
+  void StartRehash() {
+    next_ = std::make_unique<Table>();
+    copied_.store(0, std::memory_order_relaxed);
+    done_.store(false, std::memory_order_relaxed);
+    // The size an insert would have grown the table for.
+    const size_t count = table_->size() + 1;
+    worker_ = std::thread([this, count]() {
+      next_->AssignRehashedCopy(*table_, count, &copied_);
+      done_.store(true, std::memory_order_release);
+    });
+  }
+
+  void MaybeFinishRehash() {
+    if (rehash_in_progress() && done_.load(std::memory_order_acquire)) {
+      FinishRehash();
+    }
+  }
+
+  // Joins the worker, replays the side log, and swaps in the new table.
+  void FinishRehash() {
+    worker_.join();
+    for (const key_type &key : erased_) {
+      next_->erase(key);
+    }
+    if constexpr (Traits::is_map) {
+      // A key may have been erased and reinserted with a new value.
+      for (const value_type &value : inserted_) {
+        next_->erase(Traits::KeyOf(value));
+      }
+    }
+    // `merge` moves the values rather than copying them.  If they'd
+    // make `next_` grow, it streams both tables into one rehash;
+    // otherwise it inserts them one by one in `inserted_`'s order
+    // (which is hash order).  That order is harmless: which slots end
+    // up full, and so the total probe length, doesn't depend on the
+    // order of the inserts.
+    next_->merge(inserted_);
+    inserted_.clear();
+    erased_.clear();
+    table_.swap(next_);
+    next_.reset();
+  }
+
+  const size_t min_background_size_;
+  size_t size_ = 0;
+  // The table that finds read.
+  std::unique_ptr<Table> table_;
+  // During a rehash: the table the worker is copying into, and the
+  // side log.
+  std::unique_ptr<Table> next_;
+  Table inserted_;
+  HashTable<KeySetTraits> erased_;
+  std::thread worker_;
+  std::atomic<size_t> copied_{0};
+  std::atomic<bool> done_{false};
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_BACKGROUND_REHASH_H_
@@ -0,0 +1,113 @@
+#ifndef _GRAVEYARD_INTERNAL_BUCKET_POOL_H_
+#define _GRAVEYARD_INTERNAL_BUCKET_POOL_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace yobiduck::internal {
+
+// A per-thread cache of freed bucket arrays, keyed by their size in
+// bytes.  A table that is cleared (or destroyed) and then refilled to
+// the same size gets its old memory back without calling malloc and
+// without page faulting.
+//
+// All the arrays are allocated with `std::aligned_alloc(kAlignment,
+// bytes)`, so any array of the right size can be handed to any table.
+// The pool holds at most `max_bytes()` bytes.  Arrays that don't fit
+// are freed.
+//
+// Not thread safe: Each thread has its own pool (see `ThisThread()`).
+class BucketPool {
+public:
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kDefaultMaxBytes = size_t(64) << 20;
+
+  BucketPool() = default;
+  BucketPool(const BucketPool &) = delete;
+  BucketPool &operator=(const BucketPool &) = delete;
+  ~BucketPool() { Trim(0); }
+
+  // Returns the calling thread's pool, or `nullptr` if the thread is
+  // exiting and its pool has already been destroyed (in which case
+  // the caller should use `aligned_alloc` and `free` directly).
+  static BucketPool *ThisThread() {
+    thread_local bool destroyed = false;
+    thread_local struct Holder {
+      ~Holder() { destroyed = true; }
+      BucketPool pool;
+    } holder;
+    return destroyed ? nullptr : &holder.pool;
+  }
+
+  // Returns an array of `bytes` bytes, reusing a cached one if
+  // possible.
+  char *Allocate(size_t bytes) {
+    if (auto it = free_arrays_.find(bytes); it != free_arrays_.end()) {
+      char *result = it->second.back();
+      it->second.pop_back();
+      if (it->second.empty()) {
+        free_arrays_.erase(it);
+      }
+      cached_bytes_ -= bytes;
+      return result;
+    }
+    // `aligned_alloc` requires the size to be a multiple of the
+    // alignment.
+    return static_cast<char *>(
+        std::aligned_alloc(kAlignment, (bytes + kAlignment - 1) & -kAlignment));
+  }
+
+  // Gives back `data`, which must have at least `bytes` bytes and
+  // must have been allocated by `std::aligned_alloc(kAlignment, ...)`
+  // (for example by `Allocate`).  The pool either keeps it or frees
+  // it.
+  void Deallocate(char *data, size_t bytes) {
+    if (cached_bytes_ + bytes > max_bytes_) {
+      free(data);
+      return;
+    }
+    free_arrays_[bytes].push_back(data);
+    cached_bytes_ += bytes;
+  }
+
+  // Returns the number of bytes in the cached arrays.
+  size_t cached_bytes() const { return cached_bytes_; }
+
+  size_t max_bytes() const { return max_bytes_; }
+
+  // Sets the limit on `cached_bytes()`, freeing cached arrays as
+  // needed to get under the new limit.
+  void set_max_bytes(size_t max_bytes) {
+    max_bytes_ = max_bytes;
+    Trim(max_bytes);
+  }
+
+private:
+  // Frees cached arrays until `cached_bytes() <= max_bytes`.
+  void Trim(size_t max_bytes) {
+    for (auto it = free_arrays_.begin();
+         cached_bytes_ > max_bytes && it != free_arrays_.end();) {
+      while (cached_bytes_ > max_bytes && !it->second.empty()) {
+        free(it->second.back());
+        it->second.pop_back();
+        cached_bytes_ -= it->first;
+      }
+      if (it->second.empty()) {
+        free_arrays_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  size_t max_bytes_ = kDefaultMaxBytes;
+  size_t cached_bytes_ = 0;
+  absl::flat_hash_map<size_t, std::vector<char *>> free_arrays_;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_BUCKET_POOL_H_
@@ -0,0 +1,404 @@
+#ifndef _GRAVEYARD_INTERNAL_CONCURRENT_INSERT_TABLE_H_
+#define _GRAVEYARD_INTERNAL_CONCURRENT_INSERT_TABLE_H_
+
+// A graveyard bucket array that many threads can insert into at once
+// without locks, for high-ingest aggregation (e.g., collecting the
+// distinct keys of a stream on many threads).  It supports `insert` and
+// `contains`, but not erase.
+//
+// An insert claims a slot by a compare-and-swap of the slot's meta byte
+// from `kEmpty` to a "busy" byte (see `BasicMetaByte::Busy`), constructs
+// the value, raises its preferred bucket's search distance with an
+// atomic max, and then publishes the h2 with a release store.  A find
+// sees only published values.
+//
+// Since slots are never emptied, every insert of a key claims the first
+// empty slot in the same probe order (from the preferred bucket, slot by
+// slot), and checks every slot before it.  So two threads inserting the
+// same key race for the same slot, and the loser finds the key there.
+// An insert waits for a busy slot before it only if the busy byte
+// carries the same h2 (that is, while another thread constructs a value
+// that might have the same key).
+//
+// Growth is cooperative.  When the array is 9/10 full (or an insert
+// finds no free slot within the maximum search distance), one thread
+// allocates the next array, and every thread that then starts an
+// operation helps move the values, a chunk of `kChunkBuckets` buckets at
+// a time, after the operations already under way in the old array have
+// finished.  The thread that moves the last chunk frees the old
+// buckets and publishes the new array.  Operations announce themselves
+// in per-thread counters (`Stripe`), so that the common case touches no
+// cache line shared with other threads.
+
+#include <algorithm> // for max
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint8_t
+#include <memory>  // for unique_ptr
+#include <thread>  // for yield
+
+#include "absl/log/check.h"
+#include "internal/hash_table.h"
+
+namespace yobiduck::internal {
+
+template <class Traits> class ConcurrentInsertTable {
+  // The bucket pools are per thread, but the thread that frees an
+  // array isn't the one that allocated it.
+  static_assert(!Traits::kUseBucketPool);
+
+public:
+  using key_type = typename Traits::key_type;
+  using value_type = typename Traits::value_type;
+  using hasher = typename Traits::hasher;
+  using key_equal = typename Traits::key_equal;
+
+  explicit ConcurrentInsertTable(size_t capacity = 0,
+                                 const hasher &hash = hasher(),
+                                 const key_equal &key_eq = key_equal())
+      : hash_(hash), key_eq_(key_eq),
+        first_(std::make_unique<Array>(LogicalSizeFor(capacity))),
+        current_(first_.get()) {}
+  ConcurrentInsertTable(const ConcurrentInsertTable &) = delete;
+  ConcurrentInsertTable &operator=(const ConcurrentInsertTable &) = delete;
+
+  // Inserts `value` if its key isn't present.  Returns true if it
+  // inserted.
+  bool insert(const value_type &value) {
+    const key_type &key = Traits::KeyOf(value);
+    const size_t hash = hash_(key);
+    Stripe &stripe = ThisThreadStripe();
+    while (true) {
+      Array *array = Enter(stripe);
+      const InsertResult result = TryInsert(*array, value, hash);
+      Exit(stripe);
+      if (result == InsertResult::kPresent) {
+        return false;
+      }
+      if (result == InsertResult::kInserted) {
+        const size_t inserted =
+            stripe.inserted.fetch_add(1, std::memory_order_relaxed) + 1;
+        if ((inserted & array->check_mask) == 0 &&
+            size() >= array->grow_at) {
+          StartGrowth(array);
+        }
+        return true;
+      }
+      // No free slot within reach.
+      StartGrowth(array);
+      if (array->next.load(std::memory_order_acquire) == nullptr) {
+        // Another thread is allocating the next array.
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  bool contains(const key_type &key) const {
+    const size_t hash = hash_(key);
+    Stripe &stripe = ThisThreadStripe();
+    const Array *array = Enter(stripe);
+    const bool found = Find(*array, key, hash);
+    Exit(stripe);
+    return found;
+  }
+
+  // The number of values (exact when no inserts are under way).
+  size_t size() const {
+    size_t size = 0;
+    for (const Stripe &stripe : stripes_) {
+      size += stripe.inserted.load(std::memory_order_relaxed);
+    }
+    return size;
+  }
+  bool empty() const { return size() == 0; }
+
+  // The number of slots in the logical buckets of the current array.
+  size_t capacity() const {
+    return current_.load(std::memory_order_acquire)->buckets.logical_size() *
+           Traits::kSlotsPerBucket;
+  }
+
+  // Calls `f(value)` on every value.  Mustn't run concurrently with
+  // inserts.
+  template <class F> void for_each(F &&f) const {
+    const Array *array = current_.load(std::memory_order_acquire);
+    for (const Bucket<Traits> &bucket : array->buckets) {
+      for (unsigned int mask = bucket.FindNonEmpties(); mask;
+           mask &= mask - 1) {
+        f(bucket.slots[CountTrailingZeros(mask)].GetValue());
+      }
+    }
+  }
+
+private:
+  using MetaByte = typename Bucket<Traits>::MetaByte;
+
+  // Values are moved to the next array this many buckets at a time.
+  static constexpr size_t kChunkBuckets = 1024;
+  static constexpr size_t kStripes = 64;
+
+  // A bucket array, and the state of its growth into the next one.
+  struct Array {
+    explicit Array(size_t logical_size) : buckets(logical_size) {
+      if constexpr (!Traits::kZeroIsEmpty) {
+        for (Bucket<Traits> &bucket : buckets) {
+          bucket.Init();
+        }
+      }
+      buckets[buckets.physical_size() - 1].search_distance =
+          Traits::kSearchDistanceEndSentinal;
+      grow_at = logical_size * Traits::kSlotsPerBucket *
+                Traits::full_utilization_numerator /
+                Traits::full_utilization_denominator;
+      // Summing the stripes on every insert into a big array costs
+      // more than overshooting `grow_at` by a few thousand.
+      check_mask = grow_at >= kStripes * 1024 ? 63 : 0;
+      chunks = (buckets.physical_size() + kChunkBuckets - 1) / kChunkBuckets;
+    }
+
+    Buckets<Traits> buckets;
+    size_t grow_at;
+    size_t check_mask;
+    // Kept apart from `buckets`, which are freed while late helpers
+    // may still be looking for a chunk.
+    size_t chunks;
+    std::atomic<bool> growing{false};
+    // Set once the next array is ready to be filled.  Owned by
+    // `successor`.
+    std::atomic<Array *> next{nullptr};
+    std::unique_ptr<Array> successor;
+    std::atomic<size_t> next_chunk{0};
+    std::atomic<size_t> chunks_done{0};
+  };
+
+  // Counters of one thread (or of a few threads, if there are more
+  // than `kStripes`).
+  struct alignas(Traits::kCacheLineSize) Stripe {
+    // The number of operations under way in the current array.
+    std::atomic<size_t> active{0};
+    std::atomic<size_t> inserted{0};
+  };
+
+  enum class InsertResult { kInserted, kPresent, kFull };
+
+  static size_t LogicalSizeFor(size_t count) {
+    const size_t slots = Traits::kSlotsPerBucket *
+                         Traits::rehashed_utilization_numerator;
+    return std::max<size_t>(
+        2, (count * Traits::rehashed_utilization_denominator + slots - 1) /
+               slots);
+  }
+
+  Stripe &ThisThreadStripe() const {
+    static std::atomic<size_t> thread_count{0};
+    thread_local const size_t index =
+        thread_count.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripes_[index];
+  }
+
+  // Announces an operation and returns the array it may use, first
+  // helping with the growth in progress, if any.
+  Array *Enter(Stripe &stripe) const {
+    while (true) {
+      // Sequentially consistent, pairing with `HelpGrowth`: either the
+      // grower sees this operation as active, or this sees `next`.
+      stripe.active.fetch_add(1, std::memory_order_seq_cst);
+      Array *array = current_.load(std::memory_order_seq_cst);
+      if (array->next.load(std::memory_order_seq_cst) == nullptr) {
+        return array;
+      }
+      Exit(stripe);
+      HelpGrowth(array);
+    }
+  }
+  static void Exit(Stripe &stripe) {
+    stripe.active.fetch_sub(1, std::memory_order_release);
+  }
+
+  // Allocates the next array, unless another thread already is (or
+  // did).
+  void StartGrowth(Array *array) {
+    bool expected = false;
+    if (!array->growing.compare_exchange_strong(expected, true,
+                                                std::memory_order_acq_rel)) {
+      return;
+    }
+    // Grow as if full, even if a long probe ran out of room sooner.
+    array->successor = std::make_unique<Array>(
+        LogicalSizeFor(std::max(size(), array->grow_at) + 1));
+    array->next.store(array->successor.get(), std::memory_order_seq_cst);
+  }
+
+  // Waits for the operations under way in `array` to finish, then moves
+  // chunks of it into the next array until there are none left, and
+  // then waits for the next array to be published.
+  void HelpGrowth(Array *array) const {
+    Array *next = array->next.load(std::memory_order_acquire);
+    for (const Stripe &stripe : stripes_) {
+      while (stripe.active.load(std::memory_order_seq_cst) != 0) {
+        if (current_.load(std::memory_order_acquire) != array) {
+          // The growth finished (and those are operations on `next`).
+          return;
+        }
+        std::this_thread::yield();
+      }
+    }
+    const size_t chunks = array->chunks;
+    size_t moved = 0;
+    for (size_t chunk;
+         (chunk = array->next_chunk.fetch_add(1, std::memory_order_relaxed)) <
+         chunks;
+         ++moved) {
+      MoveChunk(*array, *next, chunk);
+    }
+    if (moved != 0 &&
+        array->chunks_done.fetch_add(moved, std::memory_order_acq_rel) +
+                moved ==
+            chunks) {
+      // The values were all moved out, so this just frees the memory.
+      array->buckets.clear();
+      current_.store(next, std::memory_order_release);
+      return;
+    }
+    while (current_.load(std::memory_order_acquire) == array) {
+      std::this_thread::yield();
+    }
+  }
+
+  void MoveChunk(Array &array, Array &next, size_t chunk) const {
+    const size_t end = std::min(array.buckets.physical_size(),
+                                (chunk + 1) * kChunkBuckets);
+    for (size_t i = chunk * kChunkBuckets; i < end; ++i) {
+      Bucket<Traits> &bucket = array.buckets[i];
+      for (unsigned int mask = bucket.FindNonEmpties(); mask;
+           mask &= mask - 1) {
+        const size_t idx = CountTrailingZeros(mask);
+        Move(next, bucket.slots[idx]);
+        bucket.h2[idx].SetEmpty();
+      }
+    }
+  }
+
+  // Moves a value into the first free slot of its probe.  No other
+  // thread inserts the same key, so there is no need to compare keys.
+  void Move(Array &array, typename Traits::Slot &from) const {
+    const size_t hash = hash_(Traits::KeyOf(from.GetValue()));
+    const uint8_t h2 = MetaByte::ComputeH2(hash);
+    const size_t h1 = array.buckets.H1(hash);
+    for (size_t i = 0; true; ++i) {
+      CHECK(i + 1 < Traits::kSearchDistanceEndSentinal &&
+            h1 + i < array.buckets.physical_size())
+          << "Too many keys hash to the same place";
+      Bucket<Traits> &bucket = array.buckets[h1 + i];
+      for (unsigned int empties = bucket.MatchingBytes(MetaByte::kEmpty);
+           empties; empties &= empties - 1) {
+        const size_t idx = CountTrailingZeros(empties);
+        if (bucket.h2[idx].TryClaim(h2)) {
+          bucket.slots[idx].Transfer(from);
+          RaiseSearchDistance(array.buckets[h1], i + 1);
+          bucket.h2[idx].Publish(h2);
+          return;
+        }
+      }
+    }
+  }
+
+  // Returns true if `key` has been published in `array`.
+  bool Find(const Array &array, const key_type &key, size_t hash) const {
+    const uint8_t h2 = MetaByte::ComputeH2(hash);
+    const size_t h1 = array.buckets.H1(hash);
+    const size_t distance = __atomic_load_n(
+        &array.buckets[h1].search_distance, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < distance; ++i) {
+      const Bucket<Traits> &bucket = array.buckets[h1 + i];
+      for (size_t matches = bucket.MatchingElementsMask(h2); matches;
+           matches &= matches - 1) {
+        const size_t idx = CountTrailingZeros(matches);
+        // Orders the read of the value after its publication.
+        bucket.h2[idx].LoadAcquire();
+        if (key_eq_(Traits::KeyOf(bucket.slots[idx].GetValue()), key)) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  InsertResult TryInsert(Array &array, const value_type &value,
+                         size_t hash) const {
+    const key_type &key = Traits::KeyOf(value);
+    const uint8_t h2 = MetaByte::ComputeH2(hash);
+    const uint8_t busy = MetaByte::Busy(h2);
+    const size_t h1 = array.buckets.H1(hash);
+    for (size_t i = 0; true; ++i) {
+      if (i + 1 >= Traits::kSearchDistanceEndSentinal ||
+          h1 + i >= array.buckets.physical_size()) {
+        return InsertResult::kFull;
+      }
+      Bucket<Traits> &bucket = array.buckets[h1 + i];
+      while (true) {
+        // The slots only go from empty to busy to full, so the slots
+        // before the first empty one stay non-empty.  The busy slots
+        // are found before the full ones, so that a slot published in
+        // between is seen as full.  (The fences keep the three loads in
+        // order.)
+        const unsigned int empties = bucket.MatchingBytes(MetaByte::kEmpty);
+        const unsigned int before_empty =
+            empties == 0 ? ~0u : (empties & -empties) - 1;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        for (unsigned int busies = bucket.MatchingBytes(busy) & before_empty;
+             busies; busies &= busies - 1) {
+          const size_t idx = CountTrailingZeros(busies);
+          while (bucket.h2[idx].LoadAcquire() == busy) {
+            std::this_thread::yield();
+          }
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        for (size_t matches = bucket.MatchingElementsMask(h2) & before_empty;
+             matches; matches &= matches - 1) {
+          const size_t idx = CountTrailingZeros(matches);
+          bucket.h2[idx].LoadAcquire();
+          if (key_eq_(Traits::KeyOf(bucket.slots[idx].GetValue()), key)) {
+            return InsertResult::kPresent;
+          }
+        }
+        if (empties == 0) {
+          break;
+        }
+        const size_t idx = CountTrailingZeros(empties);
+        if (bucket.h2[idx].TryClaim(h2)) {
+          bucket.slots[idx].Emplace(value);
+          RaiseSearchDistance(array.buckets[h1], i + 1);
+          bucket.h2[idx].Publish(h2);
+          return InsertResult::kInserted;
+        }
+        // Another thread claimed the slot first: look at this bucket
+        // again.
+      }
+    }
+  }
+
+  // An atomic `max` on the search distance.
+  static void RaiseSearchDistance(Bucket<Traits> &bucket, size_t distance) {
+    uint8_t old = __atomic_load_n(&bucket.search_distance, __ATOMIC_RELAXED);
+    while (old < distance &&
+           !__atomic_compare_exchange_n(&bucket.search_distance, &old,
+                                        static_cast<uint8_t>(distance),
+                                        /*weak=*/true, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+  }
+
+  const hasher hash_;
+  const key_equal key_eq_;
+  // The first array, which owns the later ones.
+  std::unique_ptr<Array> first_;
+  mutable std::atomic<Array *> current_;
+  mutable std::array<Stripe, kStripes> stripes_;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_CONCURRENT_INSERT_TABLE_H_
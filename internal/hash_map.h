@@ -14,6 +14,8 @@ class HashMap : public HashTable<Traits> {
   template <class K> using key_arg = typename Base::template key_arg<K>;
 
  public:
+  using Base::Base;
+
   using typename Base::key_type;
   using typename Base::value_type;
   using typename Base::const_iterator;
@@ -30,7 +32,8 @@ class HashMap : public HashTable<Traits> {
     // TODO: It looks like a bug here.  Shouldn't this be
     //  std::forward<key_arg<K>>(k)
     // This bug, if it is a bug, is from absl raw_hash_map.h line 125.
-    return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    return TryEmplace(Base::get_hasher_ref()(key), std::forward<K>(key),
+                      std::forward<Args>(args)...);
   }
 
   // Overload:
@@ -41,7 +44,8 @@ class HashMap : public HashTable<Traits> {
             K* = nullptr>
   std::pair<iterator, bool>
   try_emplace(const key_arg<K>& key, Args &&...args) {
-    return TryEmplace(key, std::forward<Args>(args)...);
+    return TryEmplace(Base::get_hasher_ref()(key), key,
+                      std::forward<Args>(args)...);
   }
 
   // Overload:
@@ -60,12 +64,32 @@ class HashMap : public HashTable<Traits> {
     return try_emplace(k, std::forward<Args>(args)...).first;
   }
 
+  // Same as `try_emplace(key, args...)`.  Requires: `hash` is the hash
+  // of `key`.
+  template <class K = key_type, class... Args,
+            typename std::enable_if_t<
+              !std::is_convertible_v<K, const_iterator>, int> = 0,
+            K* = nullptr>
+  std::pair<iterator, bool>
+  try_emplace_with_hash(size_t hash, key_arg<K>&& key, Args&&...args) {
+    return TryEmplace(hash, std::forward<K>(key), std::forward<Args>(args)...);
+  }
+
+  template <class K = key_type, class... Args,
+            typename std::enable_if_t<
+              !std::is_convertible_v<K, const_iterator>, int> = 0,
+            K* = nullptr>
+  std::pair<iterator, bool>
+  try_emplace_with_hash(size_t hash, const key_arg<K>& key, Args &&...args) {
+    return TryEmplace(hash, key, std::forward<Args>(args)...);
+  }
+
  private:
   using Base::PrepareInsert;
 
   template <class K = key_type, class... Args>
-  std::pair<iterator, bool> TryEmplace(K&& key, Args &&...args) {
-    auto prepare_result = PrepareInsert(key);
+  std::pair<iterator, bool> TryEmplace(size_t hash, K&& key, Args &&...args) {
+    auto prepare_result = PrepareInsert(key, hash);
     auto &[it, inserted] = prepare_result;
     if (inserted) {
       new (&*it) value_type(std::piecewise_construct,
@@ -3,21 +3,41 @@
 
 #include <malloc.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional> // for equal_to
 #include <iomanip>
+#include <limits>
 #include <new>
 #include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <utility> // for std::swap
+#include <vector>
 
+#include "absl/base/attributes.h"
 #include "absl/log/check.h"
+#include "absl/types/span.h"
+#include "hashers.h"
+#include "internal/bucket_pool.h"
+#include "internal/instrumentation.h"
+#include "internal/memory_budget.h"
+#include "internal/sampler.h"
 #include "internal/object_holder.h"
 #include "internal/map_slot.h"
+#include "internal/node_handle.h"
 #include "internal/set_slot.h"
 #include "internal/sse.h"
+#include "internal/work_stealing.h"
 
 
 // IWYU has some strange behavior around std::swap.  It wants to get
@@ -65,6 +85,13 @@ template <class T>
 struct IsTransparent<T, std::void_t<typename T::is_transparent>>
     : std::true_type {};
 
+// True if `Hash` computes `key * Hash::kMultiplier` (see hashers.h).
+template <class Hash, class = void>
+struct IsMultiplicativeHash : std::false_type {};
+template <class Hash>
+struct IsMultiplicativeHash<Hash, std::void_t<decltype(Hash::kMultiplier)>>
+    : std::true_type {};
+
 template <bool is_transparent> struct KeyArg {
   // Transparent. Forward `K`.
   template <typename K, typename key_type> using type = K;
@@ -75,6 +102,88 @@ template <> struct KeyArg<false> {
   template <typename K, typename key_type> using type = key_type;
 };
 
+// Key decomposition (like Abseil's `DecomposeValue`): finds the key
+// among the arguments to `emplace`, so that the table can be probed
+// before a value is constructed.  The key can be found when it's
+// passed as
+//
+//   set.emplace(key)
+//   map.emplace(key, mapped)
+//   map.emplace(pair)
+//   map.emplace(std::piecewise_construct, std::forward_as_tuple(key), ...)
+//
+// and `key` is a `key_type` (or, if the hasher and key_equal are
+// transparent, something they accept).
+template <class Traits> class KeyDecomposer {
+  using key_type = typename Traits::key_type;
+
+  template <class K> static constexpr bool IsKey() {
+    using Decayed = std::decay_t<K>;
+    if constexpr (std::is_same_v<Decayed, key_type>) {
+      return true;
+    } else if constexpr (IsTransparent<typename Traits::hasher>::value &&
+                         IsTransparent<typename Traits::key_equal>::value) {
+      return std::is_invocable_v<const typename Traits::hasher &,
+                                 const Decayed &> &&
+             std::is_invocable_v<const typename Traits::key_equal &,
+                                 const key_type &, const Decayed &>;
+    } else {
+      return false;
+    }
+  }
+
+  template <class T> struct IsPair : std::false_type {};
+  template <class T1, class T2>
+  struct IsPair<std::pair<T1, T2>> : std::true_type {};
+
+  template <class T> struct IsSingleTuple : std::false_type {};
+  template <class T> struct IsSingleTuple<std::tuple<T>> : std::true_type {};
+
+public:
+  template <class... Args> static constexpr bool CanDecompose() {
+    using Types = std::tuple<std::decay_t<Args>...>;
+    if constexpr (!Traits::is_map) {
+      if constexpr (sizeof...(Args) == 1) {
+        return IsKey<std::tuple_element_t<0, Types>>();
+      } else {
+        return false;
+      }
+    } else if constexpr (sizeof...(Args) == 1) {
+      using Arg = std::tuple_element_t<0, Types>;
+      if constexpr (IsPair<Arg>::value) {
+        return IsKey<typename Arg::first_type>();
+      } else {
+        return false;
+      }
+    } else if constexpr (sizeof...(Args) == 2) {
+      return IsKey<std::tuple_element_t<0, Types>>();
+    } else if constexpr (sizeof...(Args) == 3) {
+      using KeyTuple = std::tuple_element_t<1, Types>;
+      if constexpr (std::is_same_v<std::tuple_element_t<0, Types>,
+                                   std::piecewise_construct_t> &&
+                    IsSingleTuple<KeyTuple>::value) {
+        return IsKey<std::tuple_element_t<0, KeyTuple>>();
+      } else {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  // Returns the key.  Requires: `CanDecompose<Args...>()`.
+  template <class Arg, class... Args>
+  static const auto &Key(const Arg &arg, const Args &...args) {
+    if constexpr (!Traits::is_map || sizeof...(Args) == 1) {
+      return arg;
+    } else if constexpr (sizeof...(Args) == 0) {
+      return arg.first;
+    } else {
+      return std::get<0>(std::get<0>(std::forward_as_tuple(args...)));
+    }
+  }
+};
+
 struct NullRehashCallback {
   template <class Table> void operator()(Table &table, size_t slot_count) {
     table.rehash_internal(slot_count);
@@ -104,7 +213,7 @@ private:
 // Bit 7 (the high-order bit) "empty"
 //   1   the slot is empty (in which case the byte should be 0x80)
 //   0   the slot is full
-
+//
 // Bit 6 (the high-order bit) "ordered"
 //   0   the slot is possibly out of order
 //   1   the slot is in order (possibly empty)
@@ -115,15 +224,24 @@ private:
 // To determine if a value is present we must construct the vector
 // with all `~kOrderedMasks` in it, then use bitwise and to produce
 // the with the "ordered" bit cleared, then we can compare.
-
-class MetaByte {
+//
+// If `zero_is_empty` then the meaning of bit 7 is inverted (1 means
+// full) and an empty slot is 0x00.  Together with a search distance
+// of 0, that makes an all-zero bucket empty, so freshly mmapped (or
+// calloced) memory is a valid empty table and needs no
+// initialization.  _mm_movemask_epi8 then gives the full slots
+// instead of the empty ones.
+template <bool zero_is_empty> class BasicMetaByte {
  public:
-  static constexpr uint8_t kAbsentMask = 0x80u;
+  static constexpr bool kZeroIsEmpty = zero_is_empty;
+  // Bit 7 of a full slot.
+  static constexpr uint8_t kFullBit = zero_is_empty ? 0x80u : 0;
+  static constexpr uint8_t kEmptinessMask = 0x80u;
   static constexpr uint8_t kOrderedMask = 0x40u;
   static constexpr uint8_t kInvertOrderedMask = ~kOrderedMask;
   static constexpr uint8_t kMaxH2 = 0x3Fu;
-  static constexpr uint8_t kEmpty = kAbsentMask;
-  MetaByte() = delete;
+  static constexpr uint8_t kEmpty = zero_is_empty ? 0 : kEmptinessMask;
+  BasicMetaByte() = delete;
   void SetEmpty() {
     meta_byte_ = kEmpty;
   }
@@ -132,29 +250,64 @@ class MetaByte {
   }
   void SetOrderedValue(uint8_t v) {
     assert(v <= kMaxH2);
-    meta_byte_ = kOrderedMask | v;
+    meta_byte_ = kFullBit | kOrderedMask | v;
   }
   void SetUnorderedValue(uint8_t v) {
     assert(v <= kMaxH2);
-    meta_byte_ = v;
+    meta_byte_ = kFullBit | v;
   }
   constexpr uint8_t h2() const { return meta_byte_ & kMaxH2; }
   constexpr bool IsOrdered() const { return (meta_byte_ & kOrderedMask) != 0; }
   constexpr bool IsNonemptyAndDisordered() const {
-    return (meta_byte_ & (kOrderedMask | kAbsentMask)) == 0;
+    return (meta_byte_ & (kOrderedMask | kEmptinessMask)) == kFullBit;
   }
   constexpr bool IsNonemptyAndOrdered() const {
-    return (meta_byte_ & (kOrderedMask | kAbsentMask)) == kOrderedMask;
+    return (meta_byte_ & (kOrderedMask | kEmptinessMask)) ==
+           (kFullBit | kOrderedMask);
   }
   static constexpr size_t ComputeH2(size_t hash) {
     return hash & kMaxH2;
   }
+  // Returns the byte that a full slot with the given `h2` has after
+  // its ordered bit is cleared.
+  static constexpr uint8_t FullWithoutOrderedBit(uint8_t h2) {
+    return kFullBit | h2;
+  }
   constexpr uint8_t raw() const { return meta_byte_; }
+
+  // For concurrent inserts (see internal/concurrent_insert_table.h).
+  // A slot is claimed by changing its byte from `kEmpty` to
+  // `Busy(h2)`, and the h2 is published once the value is
+  // constructed.  A busy byte has the empty encoding's bit 7 (so
+  // `FindEmpties` counts it as empty) and the ordered bit, so it never
+  // matches an h2 and isn't `kEmpty`, and it records the h2 so that
+  // only inserts of keys with the same h2 need to wait for it.
+  static constexpr uint8_t Busy(uint8_t h2) {
+    return kEmpty | kOrderedMask | h2;
+  }
+  bool TryClaim(uint8_t h2) {
+    assert(h2 <= kMaxH2);
+    uint8_t expected = kEmpty;
+    return __atomic_compare_exchange_n(&meta_byte_, &expected, Busy(h2),
+                                       /*weak=*/false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_RELAXED);
+  }
+  void Publish(uint8_t h2) {
+    assert(h2 <= kMaxH2);
+    __atomic_store_n(&meta_byte_, kFullBit | h2, __ATOMIC_RELEASE);
+  }
+  uint8_t LoadAcquire() const {
+    return __atomic_load_n(&meta_byte_, __ATOMIC_ACQUIRE);
+  }
+
  private:
   uint8_t meta_byte_;
 };
 
-static_assert(std::is_trivially_destructible_v<MetaByte>);
+using MetaByte = BasicMetaByte<false>;
+
+static_assert(std::is_trivially_destructible_v<BasicMetaByte<false>>);
+static_assert(std::is_trivially_destructible_v<BasicMetaByte<true>>);
 
 template <class KeyType, class MappedTypeOrVoid, class Hash, class KeyEqual,
           class Allocator>
@@ -220,6 +373,81 @@ struct HashTableTraits {
 
   static constexpr size_t kMaxExtraBuckets = 5;
 
+  // When `size()` drops below this fraction of the logical slots, the
+  // next `erase(key)` or `Maintain()` shrinks the table back to the
+  // rehashed utilization.  A numerator of 0 means never shrink
+  // automatically.  The fraction must be well below the rehashed
+  // utilization so that shrinking and growing don't thrash.
+  static constexpr size_t shrink_utilization_numerator = 0;
+  static constexpr size_t shrink_utilization_denominator = 1;
+
+  // If true, bucket arrays are allocated from (and freed into) the
+  // calling thread's `BucketPool`, so that a table that is repeatedly
+  // destroyed and rebuilt (or rehashed back and forth) at the same
+  // size reuses its memory.
+  static constexpr bool kUseBucketPool = false;
+
+  // If true, use the encoding in which an all-zero bucket is empty
+  // (see `BasicMetaByte`).  Then big bucket arrays are mmapped and
+  // never explicitly initialized, so `reserve()` doesn't touch the
+  // memory and pages are faulted in when they're first used.
+  static constexpr bool kZeroIsEmpty = false;
+
+  // The number of values that are stored in the table object itself,
+  // so that a table holding that many or fewer values allocates no
+  // memory (a "small object optimization").  Must be at most
+  // `kSlotsPerBucket`.  0 means there is no inline storage.
+  static constexpr size_t kInlineCapacity = 0;
+
+  // If true, the table has a hash-quality watchdog.  Each insert notes
+  // the search distance of its preferred bucket.  If that distance
+  // exceeds `kWatchdogSearchDistance`, or the moving average of the
+  // distances (over roughly the last 64 inserts) exceeds
+  // `kWatchdogAverageSearchDistance`, the hash is presumed weak or
+  // attacked, and the table is rehashed with a random seed mixed into
+  // the hash (see `HashTable::Reseed`).  With a good hash the
+  // distances stay well below these (at 9/10 utilization the average
+  // stays below 8 and the maximum below 130).  0 disables a check.
+  //
+  // The watchdog costs 16 bytes in the table object.  Without it, an
+  // insert that finds no free slot within the maximum search distance
+  // fails a CHECK.
+  static constexpr bool kHashWatchdog = false;
+  static constexpr size_t kWatchdogSearchDistance = 192;
+  static constexpr size_t kWatchdogAverageSearchDistance = 32;
+
+  // If true, the process-wide `TableSampler` (see internal/sampler.h)
+  // samples about one in `sample_rate()` of these tables when they're
+  // constructed, and a sampled table records its size, memory, probe
+  // lengths, and rehashes for `TableSampler::Dump`.  Costs 8 bytes in
+  // the table object, and a test of a pointer on each change.
+  static constexpr bool kSample = false;
+
+  // If true, the table keeps the sums behind `GetProbeStatistics`'s
+  // successful and unsuccessful probe lengths (the distance of each
+  // value from its preferred bucket, and the search distances of the
+  // logical buckets) up to date as values come and go, so that
+  // `GetOnlineProbeStatistics` costs O(1).  Costs 16 bytes in the
+  // table object, and an erase hashes the erased key.
+  static constexpr bool kOnlineProbeStatistics = false;
+
+  // If true, the table registers with the process-wide `MemoryBudget`
+  // (see internal/memory_budget.h), which may advise it to run
+  // spacious or dense instead of at the utilizations above.  Costs 8
+  // bytes in the table object, and a find counts itself.
+  static constexpr bool kMemoryBudget = false;
+
+  // If true, once the table is `prefault_utilization` of the way to
+  // its next growth, each insert allocates (the first time) and
+  // touches a few more pages of the bucket array that the growth will
+  // need, so that the growing insert only moves the values.  If the
+  // table ends up growing to some other size (e.g., after erases or a
+  // `reserve`), the array is freed.  Costs 24 bytes in the table
+  // object, and the array's memory is held early.
+  static constexpr bool kPrefaultNextBuckets = false;
+  static constexpr size_t prefault_utilization_numerator = 19;
+  static constexpr size_t prefault_utilization_denominator = 20;
+
   //  // The hash tables range from 3/4 full to 7/8 full (unless there are erase
   //  // operations, in which case a table might be less than 3/4 full).
   //  // TODO: Make these be "kConstant".
@@ -233,9 +461,16 @@ struct HashTableTraits {
   // and call it with the table and the size.  This allows code to
   // instrument a table just before or just after a rehash.
   using rehash_callback = NullRehashCallback;
+
+  // The table holds an `instrumentation` and calls its hooks on every
+  // find, insert, and rehash (see internal/instrumentation.h).  Use
+  // `CountingInstrumentation` to get the counts from
+  // `GetInstrumentationSnapshot()`.
+  using instrumentation = NullInstrumentation;
 };
 
 template <class Traits> struct Bucket {
+  using MetaByte = BasicMetaByte<Traits::kZeroIsEmpty>;
   using key_type = typename Traits::key_type;
 
   template <class K> using key_arg = typename Traits::template key_arg<K>;
@@ -246,16 +481,34 @@ template <class Traits> struct Bucket {
   // constructor, move assignment, and destructor.
 
   void Init() {
-    search_distance = 0;
-    for (size_t i = 0; i < Traits::kSlotsPerBucket; ++i)
-      h2[i].SetEmpty();
+    if constexpr (kHaveSse2 && Traits::kSlotsPerBucket < 16 &&
+                  alignof(typename Traits::Slot) > 1) {
+      // The slots are aligned, so `h2`, `search_distance` and the
+      // padding after them fill at least 16 bytes.  Set them all with
+      // one store.
+      static constexpr auto kInitialBytes = []() {
+        std::array<uint8_t, 16> bytes{};
+        for (size_t i = 0; i < Traits::kSlotsPerBucket; ++i) {
+          bytes[i] = MetaByte::kEmpty;
+        }
+        return bytes;
+      }();
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i *>(&h2[0]),
+          _mm_loadu_si128(
+              reinterpret_cast<const __m128i *>(kInitialBytes.data())));
+    } else {
+      search_distance = 0;
+      for (size_t i = 0; i < Traits::kSlotsPerBucket; ++i)
+        h2[i].SetEmpty();
+    }
   }
 
   size_t PortableMatchingElements(uint8_t value) const {
     assert(value <= MetaByte::kMaxH2);
     int result = 0;
     for (size_t i = 0; i < Traits::kSlotsPerBucket; ++i) {
-      if (h2[i].h2() == value) {
+      if (!h2[i].IsEmpty() && h2[i].h2() == value) {
         result |= (1 << i);
       }
     }
@@ -278,7 +531,8 @@ template <class Traits> struct Bucket {
           _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h2[0]));
       __m128i clear_ordered = _mm_set1_epi8(MetaByte::kInvertOrderedMask);
       __m128i haystack = _mm_and_si128(haystack_with_ordered, clear_ordered);
-      __m128i needles = _mm_set1_epi8(needle);
+      __m128i needles =
+          _mm_set1_epi8(MetaByte::FullWithoutOrderedBit(needle));
       int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(needles, haystack));
       mask &= (1 << Traits::kSlotsPerBucket) - 1;
       // assert(static_cast<size_t>(mask) == matching);
@@ -301,17 +555,62 @@ template <class Traits> struct Bucket {
     return Traits::kSlotsPerBucket;
   }
 
+  // Returns a bitmask of the slots whose meta byte is exactly `raw`.
+  unsigned int MatchingBytes(uint8_t raw) const {
+    if constexpr (kHaveSse2) {
+      __m128i h2s =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h2[0]));
+      unsigned int mask =
+          _mm_movemask_epi8(_mm_cmpeq_epi8(h2s, _mm_set1_epi8(raw)));
+      return mask & ((1u << Traits::kSlotsPerBucket) - 1);
+    }
+    unsigned int mask = 0;
+    for (size_t i = 0; i < Traits::kSlotsPerBucket; ++i) {
+      if (h2[i].raw() == raw) {
+        mask |= 1u << i;
+      }
+    }
+    return mask;
+  }
+
   // Returns an integer bitmask indicating which slots are empty.
   unsigned int FindEmpties() const {
-    static_assert(MetaByte::kEmpty == 0x80ul);
-    // We can special case in the event that the empty value has the
-    // high-order bit set.
+    static_assert(MetaByte::kEmptinessMask == 0x80ul);
+    // We can special case in the event that the emptiness bit is the
+    // high-order bit.
     __m128i h2s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h2[0]));
     unsigned int empties = _mm_movemask_epi8(h2s);
+    if constexpr (MetaByte::kZeroIsEmpty) {
+      // The high-order bit is set for the full slots.
+      empties = ~empties;
+    }
     empties &= (1 << Traits::kSlotsPerBucket) - 1;
     return empties;
   }
 
+  // Returns `{MatchingElementsMask(needle), FindEmpties()}`, computed
+  // from a single load of the meta bytes.
+  std::pair<unsigned int, unsigned int>
+  MatchesAndEmpties(uint8_t needle) const {
+    constexpr unsigned int kSlotMask = (1u << Traits::kSlotsPerBucket) - 1;
+    if constexpr (kHaveSse2) {
+      __m128i h2s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&h2[0]));
+      __m128i haystack =
+          _mm_and_si128(h2s, _mm_set1_epi8(MetaByte::kInvertOrderedMask));
+      __m128i needles =
+          _mm_set1_epi8(MetaByte::FullWithoutOrderedBit(needle));
+      unsigned int matches =
+          _mm_movemask_epi8(_mm_cmpeq_epi8(needles, haystack));
+      unsigned int empties = _mm_movemask_epi8(h2s);
+      if constexpr (MetaByte::kZeroIsEmpty) {
+        empties = ~empties;
+      }
+      return {matches & kSlotMask, empties & kSlotMask};
+    }
+    return {static_cast<unsigned int>(PortableMatchingElements(needle)),
+            FindEmpties()};
+  }
+
   // Returns an empty slot number in this bucket, if it exists.  Else
   // returns Traits::kSlotsPerBucket.
   size_t FindEmpty() const {
@@ -351,8 +650,7 @@ public:
   // Deallocate the memory in this.  Requires that none of the slots
   // contain values.
   void Deallocate() {
-    free(data_);
-    data_ = nullptr;
+    FreeData();
     logical_size_ = 0;
   }
 
@@ -361,7 +659,8 @@ public:
   // Constructs a `Buckets` that has the given logical bucket size (which must
   // be positive).
   //
-  // The buckets aren't initialized.
+  // The buckets aren't initialized, except that if `Traits::kZeroIsEmpty`
+  // then they are all zero (and hence empty).
   explicit Buckets(size_t logical_size) : logical_size_(logical_size) {
     assert(logical_size_ > 0);
     size_t physical = physical_size();
@@ -370,8 +669,7 @@ public:
     // is.  But we aren't supposed to modify those bytes (it will mess up
     // tools such as address sanitizer or valgrind).  So we realloc the
     // pointer to the actual size.
-    data_ = static_cast<char *>(std::aligned_alloc(
-        Traits::kCacheLineSize, physical * sizeof(Bucket<Traits>)));
+    data_ = AllocateData(physical * sizeof(Bucket<Traits>));
     assert(data_ != nullptr);
     if (0) {
       // It turns out that for libc malloc, the extra usable size usually just
@@ -392,6 +690,31 @@ public:
   void clear() {
     assert((logical_size() == 0) == (data_ == nullptr));
     if (data_ != nullptr) {
+      DestroyValues();
+      FreeData();
+    }
+    logical_size_ = 0;
+  }
+
+  // Destroys all the values and makes every bucket empty, keeping the
+  // allocation.  Doesn't set the end sentinel.
+  void Reset() {
+    DestroyValues();
+    const size_t bytes = physical_size() * sizeof(Bucket<Traits>);
+    if (IsMmapped(bytes)) {
+      // The pages come back zeroed (that is, empty) when they are
+      // next touched.
+      madvise(data_, bytes, MADV_DONTNEED);
+    } else {
+      for (Bucket<Traits> &bucket : *this) {
+        bucket.Init();
+      }
+    }
+  }
+
+  // Runs the destructor of every value.  Leaves the meta bytes alone.
+  void DestroyValues() {
+    if constexpr (!std::is_trivially_destructible_v<value_type>) {
       for (Bucket<Traits> &bucket : *this) {
         for (size_t slot = 0; slot < Traits::kSlotsPerBucket; ++slot) {
           if (!bucket.h2[slot].IsEmpty()) {
@@ -399,10 +722,7 @@ public:
           }
         }
       }
-      free(data_);
-      data_ = nullptr;
     }
-    logical_size_ = 0;
   }
 
   void swap(Buckets &other) {
@@ -411,21 +731,68 @@ public:
     swap(data_, other.data_);
   }
 
+  // Returns true if the allocation can be shrunk in place to
+  // `logical_size` buckets.  (An mmapped allocation can't become a
+  // malloced one.)
+  bool CanShrinkInPlace(size_t logical_size) const {
+    return IsMmapped(PhysicalSize(logical_size) * sizeof(Bucket<Traits>)) ==
+           IsMmapped(physical_size() * sizeof(Bucket<Traits>));
+  }
+
+  // Shrinks the logical size to `logical_size` while keeping the same
+  // allocation.  The caller is responsible for moving the values into
+  // the smaller table (see `HashTable::ShrinkInPlace`) and then calling
+  // `ReleaseTail`.
+  void SetLogicalSizeInPlace(size_t logical_size) {
+    assert(0 < logical_size && logical_size <= logical_size_);
+    assert(CanShrinkInPlace(logical_size));
+    logical_size_ = logical_size;
+  }
+
+  // Gives the whole pages between the end of the (shrunk) buckets and
+  // the end of the original `old_physical_size` buckets back to the
+  // operating system.  A malloced allocation keeps its size, so it's
+  // still freed with the rest of `data_`.  An mmapped allocation is
+  // unmapped down to the new size.
+  void ReleaseTail(size_t old_physical_size) {
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t tail_begin = reinterpret_cast<uintptr_t>(end());
+    uintptr_t tail_end = reinterpret_cast<uintptr_t>(begin() + old_physical_size);
+    tail_begin = (tail_begin + page_size - 1) & ~(page_size - 1);
+    if (IsMmapped(physical_size() * sizeof(Bucket<Traits>))) {
+      if (tail_begin < tail_end) {
+        munmap(reinterpret_cast<void *>(tail_begin), tail_end - tail_begin);
+      }
+      return;
+    }
+    tail_end = tail_end & ~(page_size - 1);
+    if (tail_begin < tail_end) {
+#ifdef MADV_FREE
+      madvise(reinterpret_cast<void *>(tail_begin), tail_end - tail_begin,
+              MADV_FREE);
+#else
+      madvise(reinterpret_cast<void *>(tail_begin), tail_end - tail_begin,
+              MADV_DONTNEED);
+#endif
+    }
+  }
+
   size_t logical_size() const { return logical_size_; }
-  size_t physical_size() const {
-    // Add 5 buckets if logical_size_ >= 6.
-    // Add 4 buckets if logical_size_ == 5.
-    // Add 3 buckets if logical_size_ == 4.
-    // Add 2 buckets if logical_size_ == 3.
-    // Add 1 bucket if logical_size_ from 1 to 2.
-    // Add 0 bucketrs if logical_size_ == 0;
+  size_t physical_size() const { return PhysicalSize(logical_size_); }
+  static size_t PhysicalSize(size_t logical_size) {
+    // Add 5 buckets if logical_size >= 6.
+    // Add 4 buckets if logical_size == 5.
+    // Add 3 buckets if logical_size == 4.
+    // Add 2 buckets if logical_size == 3.
+    // Add 1 bucket if logical_size from 1 to 2.
+    // Add 0 bucketrs if logical_size == 0;
     // TODO: We'd like to add 0 buckets if the logical_bucket_count == 1.
-    size_t extra_buckets = (logical_size_ > Traits::kMaxExtraBuckets)
+    size_t extra_buckets = (logical_size > Traits::kMaxExtraBuckets)
                                ? Traits::kMaxExtraBuckets
-                           : (logical_size_ > 2) ? logical_size_ - 1
-                           : (logical_size_ > 0) ? 1
-                                                 : 0;
-    return logical_size() + extra_buckets;
+                           : (logical_size > 2) ? logical_size - 1
+                           : (logical_size > 0) ? 1
+                                                : 0;
+    return logical_size + extra_buckets;
   }
   bool empty() const { return logical_size() == 0; }
   Bucket<Traits> &operator[](size_t index) {
@@ -447,9 +814,12 @@ public:
   const Bucket<Traits> *cend() const { return cbegin() + physical_size(); }
 
   // Returns the preferred bucket number, also known as the H1 hash.
-  size_t H1(size_t hash) const {
+  size_t H1(size_t hash) const { return H1(hash, logical_size()); }
+  // Returns the preferred bucket number in a table with `logical_size`
+  // buckets.
+  static size_t H1(size_t hash, size_t logical_size) {
     // TODO: Use the absl version.
-    return size_t((__int128(hash) * __int128(logical_size())) >> 64);
+    return size_t((__int128(hash) * __int128(logical_size)) >> 64);
   }
 
   // Returns the H2 hash, used by vector instructions to filter out most of the
@@ -461,6 +831,61 @@ private:
 
   using value_type = typename Traits::value_type;
 
+  // Under the zero-is-empty encoding, arrays at least this big are
+  // mmapped, so that they start out zeroed without touching any
+  // pages.
+  static constexpr size_t kMmapThresholdBytes = size_t(1) << 20;
+
+  static bool IsMmapped(size_t bytes) {
+    return Traits::kZeroIsEmpty && bytes >= kMmapThresholdBytes;
+  }
+
+  static char *AllocateData(size_t bytes) {
+    if (IsMmapped(bytes)) {
+      void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      return data == MAP_FAILED ? nullptr : static_cast<char *>(data);
+    }
+    char *data = nullptr;
+    if constexpr (Traits::kUseBucketPool) {
+      static_assert(Traits::kCacheLineSize <= BucketPool::kAlignment);
+      if (BucketPool *pool = BucketPool::ThisThread()) {
+        data = pool->Allocate(bytes);
+      }
+    }
+    if (data == nullptr) {
+      // `aligned_alloc` requires the size to be a multiple of the
+      // alignment.
+      data = static_cast<char *>(std::aligned_alloc(
+          Traits::kCacheLineSize,
+          (bytes + Traits::kCacheLineSize - 1) & -Traits::kCacheLineSize));
+    }
+    if constexpr (Traits::kZeroIsEmpty) {
+      memset(data, 0, bytes);
+    }
+    return data;
+  }
+
+  // Frees `data_`.  If the buckets were shrunk in place, the
+  // allocation is bigger than `physical_size()` buckets, but the
+  // pool only needs a lower bound.
+  void FreeData() {
+    if (IsMmapped(physical_size() * sizeof(Bucket<Traits>))) {
+      munmap(data_, physical_size() * sizeof(Bucket<Traits>));
+      data_ = nullptr;
+      return;
+    }
+    if constexpr (Traits::kUseBucketPool) {
+      if (BucketPool *pool = BucketPool::ThisThread()) {
+        pool->Deallocate(data_, physical_size() * sizeof(Bucket<Traits>));
+        data_ = nullptr;
+        return;
+      }
+    }
+    free(data_);
+    data_ = nullptr;
+  }
+
   // For computing the index from the hash.  The actual buckets vector is longer
   // (`physical_size_`) so that we can overflow simply by going off the end.
   //
@@ -469,6 +894,301 @@ private:
   char *data_ = nullptr;
 };
 
+// Storage for up to `Traits::kInlineCapacity` values inside the table
+// object.  It's laid out like the beginning of a `Bucket` (all the
+// meta bytes and the search distance, but only `kInlineCapacity`
+// slots), and it is accessed as a `Bucket` whose search distance is
+// the end sentinel, so the lookup code and the iterators treat it as a
+// one-bucket table.  The meta bytes after `kInlineCapacity` are always
+// empty.
+template <class Traits, bool = (Traits::kInlineCapacity > 0)>
+class InlineBucket {
+public:
+  static constexpr size_t kCapacity = Traits::kInlineCapacity;
+  static_assert(kCapacity <= Traits::kSlotsPerBucket);
+
+  InlineBucket() { Init(); }
+  InlineBucket(const InlineBucket &) = delete;
+  InlineBucket &operator=(const InlineBucket &) = delete;
+  ~InlineBucket() { DestroyValues(); }
+
+  // Destroys the values and makes the bucket empty.
+  void clear() {
+    DestroyValues();
+    Init();
+  }
+
+  Bucket<Traits> &bucket() {
+    return *std::launder(reinterpret_cast<Bucket<Traits> *>(data_));
+  }
+  const Bucket<Traits> &bucket() const {
+    return *std::launder(reinterpret_cast<const Bucket<Traits> *>(data_));
+  }
+
+private:
+  void Init() {
+    bucket().Init();
+    bucket().search_distance = Traits::kSearchDistanceEndSentinal;
+  }
+
+  void DestroyValues() {
+    if constexpr (!std::is_trivially_destructible_v<
+                      typename Traits::value_type>) {
+      for (size_t i = 0; i < kCapacity; ++i) {
+        if (!bucket().h2[i].IsEmpty()) {
+          bucket().slots[i].Destroy();
+        }
+      }
+    }
+  }
+
+  // The SIMD code loads 16 bytes of meta bytes.
+  static constexpr size_t kBytes = std::max<size_t>(
+      16, sizeof(Bucket<Traits>) - (Traits::kSlotsPerBucket - kCapacity) *
+                                       sizeof(typename Traits::Slot));
+  alignas(Bucket<Traits>) char data_[kBytes];
+};
+
+template <class Traits> class InlineBucket<Traits, false> {};
+
+// The state of the hash-quality watchdog (see `Traits::kHashWatchdog`).
+template <class Traits, bool = Traits::kHashWatchdog> class HashWatchdog {
+public:
+  // The seed mixed into the hash (see `HashTable::SeededHash`): 0
+  // until the table is reseeded, and odd after.
+  size_t seed() const { return seed_; }
+  void set_seed(size_t seed) { seed_ = seed; }
+
+  // Notes an insert into a table of `size` values that leaves its
+  // preferred bucket with search distance `distance`.  Returns true if
+  // the probe lengths are pathological and the watchdog is armed.
+  bool Fires(size_t distance, size_t size) {
+    average_ = average_ - (average_ >> 6) + distance;
+    const bool pathological =
+        (Traits::kWatchdogSearchDistance != 0 &&
+         distance > Traits::kWatchdogSearchDistance) ||
+        (Traits::kWatchdogAverageSearchDistance != 0 &&
+         average_ > 64 * Traits::kWatchdogAverageSearchDistance);
+    return pathological && Armed(size);
+  }
+
+  // Returns true unless the table has been reseeded since it had half
+  // of `size` values.  (So reseeding costs amortized constant time per
+  // insert.)
+  bool Armed(size_t size) const { return (size >> size_log_) != 0; }
+
+  // Picks a new seed for a table of `size` values, and disarms the
+  // watchdog until the table doubles.
+  void Reseed(size_t size) {
+    std::random_device random;
+    seed_ = ((uint64_t{random()} << 32) | random()) | 1;
+    average_ = 0;
+    // One more than the number of bits in `size`.
+    size_log_ = std::numeric_limits<size_t>::digits + 1 -
+                __builtin_clzll(uint64_t{size} | 1);
+  }
+
+  void Reset() { *this = HashWatchdog(); }
+
+private:
+  size_t seed_ = 0;
+  // 64 times the moving average of the search distances.
+  uint32_t average_ = 0;
+  // Armed once the size reaches `2^size_log_`.
+  uint8_t size_log_ = 0;
+};
+
+// Without the watchdog the hash is used as is.
+template <class Traits> class HashWatchdog<Traits, false> {
+public:
+  static constexpr size_t seed() { return 0; }
+  void set_seed(size_t) {}
+  static constexpr bool Fires(size_t, size_t) { return false; }
+  static constexpr bool Armed(size_t) { return false; }
+  void Reseed(size_t) {}
+  void Reset() {}
+};
+
+// The sums behind the online probe statistics (see
+// `Traits::kOnlineProbeStatistics`).
+template <class Traits, bool = Traits::kOnlineProbeStatistics>
+class ProbeSums {
+public:
+  // The sum, over the values, of the number of buckets a successful
+  // find visits.
+  uint64_t successful() const { return successful_; }
+  // The sum, over the logical buckets, of the search distance.
+  uint64_t search_distance() const { return search_distance_; }
+
+  void AddValue(size_t probe_length) { successful_ += probe_length; }
+  void RemoveValue(size_t probe_length) { successful_ -= probe_length; }
+  void AddSearchDistance(size_t increase) { search_distance_ += increase; }
+  void Reset() { *this = ProbeSums(); }
+
+private:
+  uint64_t successful_ = 0;
+  uint64_t search_distance_ = 0;
+};
+
+template <class Traits> class ProbeSums<Traits, false> {
+public:
+  void AddValue(size_t) {}
+  void RemoveValue(size_t) {}
+  void AddSearchDistance(size_t) {}
+  void Reset() {}
+};
+
+// The bucket array for the table's next growth, allocated and faulted
+// in a little at a time (see `Traits::kPrefaultNextBuckets`).  Its
+// buckets hold no values.
+template <class Traits, bool = Traits::kPrefaultNextBuckets>
+class NextBuckets {
+public:
+  NextBuckets() = default;
+  // The array belongs to this table's size.
+  NextBuckets(const NextBuckets &) {}
+  NextBuckets &operator=(const NextBuckets &) {
+    Free();
+    return *this;
+  }
+  ~NextBuckets() { Free(); }
+
+  void swap(NextBuckets &other) {
+    buckets_.swap(other.buckets_);
+    std::swap(prefaulted_, other.prefaulted_);
+  }
+
+  // Makes progress toward having `logical_size` buckets allocated and
+  // faulted in by the time `inserts_left` more inserts have happened.
+  void Advance(size_t logical_size, size_t inserts_left) {
+    if (buckets_.logical_size() != logical_size) {
+      Free();
+      Buckets<Traits> buckets(logical_size);
+      buckets_.swap(buckets);
+    }
+    const size_t physical_size = buckets_.physical_size();
+    if (prefaulted_ == physical_size) {
+      return;
+    }
+    // Enough buckets to finish in time, and at least a page's worth.
+    constexpr size_t kMinStep =
+        std::max<size_t>(1, 4096 / sizeof(Bucket<Traits>));
+    const size_t step = std::max(
+        kMinStep, (physical_size - prefaulted_) / (inserts_left + 1) + 1);
+    const size_t end = std::min(physical_size, prefaulted_ + step);
+    for (; prefaulted_ < end; ++prefaulted_) {
+      if constexpr (Traits::kZeroIsEmpty) {
+        // Write a zero to fault in the page (the buckets are zero,
+        // which is empty, already).
+        *reinterpret_cast<volatile uint8_t *>(&buckets_[prefaulted_]) = 0;
+      } else {
+        buckets_[prefaulted_].Init();
+      }
+    }
+  }
+
+  // Moves the array into `buckets` if it has `logical_size` buckets.
+  // Otherwise frees it and returns false.
+  bool Take(size_t logical_size, Buckets<Traits> &buckets) {
+    if (buckets_.logical_size() != logical_size) {
+      Free();
+      return false;
+    }
+    buckets.swap(buckets_);
+    prefaulted_ = 0;
+    return true;
+  }
+
+  size_t allocated_bytes() const {
+    return buckets_.physical_size() * sizeof(Bucket<Traits>);
+  }
+
+  void Free() {
+    // The buckets hold no values, and may not be initialized.
+    if (!buckets_.empty()) {
+      buckets_.Deallocate();
+    }
+    prefaulted_ = 0;
+  }
+
+private:
+  Buckets<Traits> buckets_;
+  // Buckets `[0, prefaulted_)` have been faulted in.
+  size_t prefaulted_ = 0;
+};
+
+template <class Traits> class NextBuckets<Traits, false> {
+public:
+  void swap(NextBuckets &) {}
+  bool Take(size_t, Buckets<Traits> &) { return false; }
+  static constexpr size_t allocated_bytes() { return 0; }
+  void Free() {}
+};
+
+// A table's entry in the `MemoryBudget` (see `Traits::kMemoryBudget`).
+// A copy of a table is a new table, so it registers afresh; assigning
+// to a table keeps its entry; swapping tables swaps their entries.
+template <class Traits, bool = Traits::kMemoryBudget> class BudgetHandle {
+public:
+  BudgetHandle()
+      : entry_(MemoryBudget::Global().Register(MemoryBudget::AverageUtilization(
+            {Traits::full_utilization_numerator,
+             Traits::full_utilization_denominator},
+            {Traits::rehashed_utilization_numerator,
+             Traits::rehashed_utilization_denominator}))) {}
+  BudgetHandle(const BudgetHandle &) : BudgetHandle() {}
+  BudgetHandle &operator=(const BudgetHandle &) { return *this; }
+  ~BudgetHandle() { MemoryBudget::Global().Unregister(entry_); }
+
+  void swap(BudgetHandle &other) { std::swap(entry_, other.entry_); }
+
+  LoadPolicy policy() const { return entry_->policy(); }
+  BudgetEntry &entry() const { return *entry_; }
+
+private:
+  BudgetEntry *entry_;
+};
+
+template <class Traits> class BudgetHandle<Traits, false> {
+public:
+  static constexpr LoadPolicy policy() { return LoadPolicy::kDefault; }
+  void swap(BudgetHandle &) {}
+};
+
+// A table's handle on its `TableSample` (see `Traits::kSample`), or
+// null if the table isn't sampled.  A copy of a table is a new table,
+// so it's sampled (or not) afresh; assigning to a table keeps its
+// sample; swapping tables swaps their samples.
+template <class Traits, bool = Traits::kSample> class SampleHandle {
+public:
+  SampleHandle()
+      : sample_(TableSampler::Global().MaybeSample(
+            sizeof(typename Traits::value_type))) {}
+  SampleHandle(const SampleHandle &) : SampleHandle() {}
+  SampleHandle &operator=(const SampleHandle &) { return *this; }
+  ~SampleHandle() {
+    if (sample_ != nullptr) {
+      TableSampler::Global().Unregister(sample_);
+    }
+  }
+
+  void swap(SampleHandle &other) { std::swap(sample_, other.sample_); }
+
+  // Returns the sample, or nullptr.
+  TableSample *get() const { return sample_; }
+
+private:
+  TableSample *sample_;
+};
+
+template <class Traits> class SampleHandle<Traits, false> {
+public:
+  void swap(SampleHandle &) {}
+};
+
+// The operations done by `HashTable::AssignSetOperation`.
+enum class SetOperation { kUnion, kIntersection, kDifference };
+
 struct ProbeStatistics {
   // How many buckets do we look in, on average, for a successful
   // lookup?  To compute this, we iterate over all the keys currently
@@ -486,15 +1206,39 @@ struct ProbeStatistics {
   double insert;
 };
 
+// Estimates of the `ProbeStatistics` from a sample of the buckets (see
+// `HashTable::EstimateProbeStatistics`).
+struct ProbeStatisticsEstimate {
+  ProbeStatistics mean;
+  // The half-widths of approximate 95% confidence intervals around
+  // `mean`.
+  ProbeStatistics error;
+};
+
 // The hash table
 template <class Traits>
 class HashTable : private ObjectHolder<'H', typename Traits::hasher>,
                   private ObjectHolder<'E', typename Traits::key_equal>,
-                  private ObjectHolder<'A', typename Traits::allocator> {
+                  private ObjectHolder<'A', typename Traits::allocator>,
+                  private ObjectHolder<'I', InlineBucket<Traits>>,
+                  private ObjectHolder<'W', HashWatchdog<Traits>>,
+                  private ObjectHolder<'N', typename Traits::instrumentation>,
+                  private ObjectHolder<'S', SampleHandle<Traits>>,
+                  private ObjectHolder<'P', ProbeSums<Traits>>,
+                  private ObjectHolder<'B', BudgetHandle<Traits>>,
+                  private ObjectHolder<'F', NextBuckets<Traits>> {
 private:
   using HasherHolder = ObjectHolder<'H', typename Traits::hasher>;
   using KeyEqualHolder = ObjectHolder<'E', typename Traits::key_equal>;
   using AllocatorHolder = ObjectHolder<'A', typename Traits::allocator>;
+  using InlineHolder = ObjectHolder<'I', InlineBucket<Traits>>;
+  using WatchdogHolder = ObjectHolder<'W', HashWatchdog<Traits>>;
+  using InstrumentationHolder =
+      ObjectHolder<'N', typename Traits::instrumentation>;
+  using SampleHolder = ObjectHolder<'S', SampleHandle<Traits>>;
+  using ProbeSumsHolder = ObjectHolder<'P', ProbeSums<Traits>>;
+  using BudgetHolder = ObjectHolder<'B', BudgetHandle<Traits>>;
+  using NextBucketsHolder = ObjectHolder<'F', NextBuckets<Traits>>;
 
 public:
   using key_type = typename Traits::key_type;
@@ -520,7 +1264,7 @@ public:
   HashTable();
   explicit HashTable(size_t initial_capacity, hasher const &hash = hasher(),
                      key_equal const &key_eq = key_equal(),
-                     allocator_type const &allocator = allocator_type());
+                     allocator_type const &alloc = allocator_type());
   // Copy constructor
   explicit HashTable(const HashTable &other);
   HashTable(const HashTable &other, const allocator_type &a);
@@ -551,8 +1295,8 @@ public:
   const_iterator cbegin() const;
   const_iterator cend() const;
 
-  // node_type not implemented
-  // insert_return_type not implemented
+  using node_type = NodeHandle<Traits>;
+  using insert_return_type = InsertReturnType<iterator, node_type>;
 
   // Note: The use of noexcept is not consistent.  Sometimes it's
   // there, but sometimes not, for now good reason.
@@ -562,8 +1306,70 @@ public:
   bool empty() const noexcept { return size() == 0; }
 
   void clear();
+  // Erases all the values, but keeps the allocated buckets so that
+  // refilling the table to the same size needs no allocation or
+  // rehash.
+  void clear_keep_capacity();
   std::pair<iterator, bool> insert(const value_type &value);
-  template <class... Args> std::pair<iterator, bool> emplace(Args &&...args);
+  // Requires: `hash` is the hash of the key of `value` (as for the
+  // overloads below and `find(key, hash)`).
+  std::pair<iterator, bool> insert(const value_type &value, size_t hash);
+  // Inserts the value owned by `node`, if its key isn't already
+  // present.  If the key is present, the returned `node` still owns
+  // the value.
+  insert_return_type insert(node_type &&node);
+  // Ignores the hint.
+  iterator insert(const_iterator, node_type &&node) {
+    return insert(std::move(node)).position;
+  }
+  // If the key can be found in `args` (see `KeyDecomposer`), probes
+  // for it first, and constructs the value only if the key is not
+  // present.
+  template <class... Args> std::pair<iterator, bool> emplace(Args &&...args) {
+    return Emplace(
+        [this](const auto &key) { return get_hasher_ref()(key); },
+        std::forward<Args>(args)...);
+  }
+  // Same as `emplace(args...)`.  Requires: `hash` is the hash of the
+  // key of the value constructed from `args`.  (The hash comes first
+  // since `args` is variadic.)
+  template <class... Args>
+  std::pair<iterator, bool> emplace_with_hash(size_t hash, Args &&...args) {
+    return Emplace([hash](const auto &) { return hash; },
+                   std::forward<Args>(args)...);
+  }
+
+  // Passed to the function given to `lazy_emplace`, which must call it
+  // once with arguments that construct a value with key equal to the
+  // key given to `lazy_emplace`.
+  class constructor {
+  public:
+    template <class... Args> void operator()(Args &&...args) const {
+      slot_->Emplace(std::forward<Args>(args)...);
+    }
+
+  private:
+    friend class HashTable;
+    explicit constructor(typename Traits::Slot *slot) : slot_(slot) {}
+    typename Traits::Slot *slot_;
+  };
+
+  // If `key` is present, returns an iterator to it.  Otherwise
+  // reserves a slot for it, calls `f(constructor)` to construct the
+  // value in the slot, and returns an iterator to the new value.
+  // Nothing is constructed if `key` is present.
+  template <class K = key_type, class F>
+  iterator lazy_emplace(const key_arg<K> &key, F &&f) {
+    return lazy_emplace(key, get_hasher_ref()(key), std::forward<F>(f));
+  }
+  template <class K = key_type, class F>
+  iterator lazy_emplace(const key_arg<K> &key, size_t hash, F &&f) {
+    auto [it, inserted] = PrepareInsert(key, hash);
+    if (inserted) {
+      std::forward<F>(f)(constructor(&it.bucket_->slots[it.index_]));
+    }
+    return it;
+  }
 
  public:
 
@@ -574,19 +1380,78 @@ public:
   void erase(iterator pos);
   void erase(const_iterator pos);
   iterator erase(const_iterator first, const_iterator last);
-  template <class K = key_type> size_t erase(const key_arg<K> &key);
+  template <class K = key_type> size_t erase(const key_arg<K> &key) {
+    return erase(key, get_hasher_ref()(key));
+  }
+  template <class K = key_type>
+  size_t erase(const key_arg<K> &key, size_t hash);
   void swap(HashTable &other) noexcept;
 
+  // Removes the value at `pos` from the table and returns it in a
+  // node.
+  node_type extract(const_iterator pos);
+  node_type extract(iterator pos) { return extract(const_iterator(pos)); }
+  // Removes the value with `key` (if any) from the table and returns
+  // it in a node.  Returns an empty node if `key` isn't present.
+  template <class K = key_type> node_type extract(const key_arg<K> &key) {
+    return extract(key, get_hasher_ref()(key));
+  }
+  template <class K = key_type>
+  node_type extract(const key_arg<K> &key, size_t hash);
+
+  // Moves each value of `other` whose key isn't in `*this` into
+  // `*this`.  The values whose keys are already present stay in
+  // `other`.
+  //
+  // If `*this` must grow to hold the values, then both tables are
+  // read in hash order and merged into the new buckets in one linear
+  // pass (rather than doing one random insert for each value).
+  void merge(HashTable &other);
+  void merge(HashTable &&other) { merge(other); }
+
+  // Makes `*this` hold `a op b`:
+  //
+  //  kUnion:        the values whose keys are in `a` or `b`.
+  //  kIntersection: the values whose keys are in both.
+  //  kDifference:   the values whose keys are in `a` but not `b`.
+  //
+  // A key in both `a` and `b` gets the value `combine(a_value,
+  // b_value)`.
+  //
+  // Both tables are read in hash order (like two sorted runs) and the
+  // result is written in hash order in one pass, so no lookups are
+  // done.  (Unless the hasher is stateful or one of the tables is
+  // inline, in which case it falls back to lookups.)
+  //
+  // Requires: `*this` is neither `a` nor `b`.
+  template <SetOperation op, class Combine>
+  void AssignSetOperation(const HashTable &a, const HashTable &b,
+                          Combine combine);
+
+  // Returns true if `*this` and `other` have the same values
+  // (compared with `operator==`).  Runs in linear time without
+  // lookups (under the same conditions as `AssignSetOperation`).
+  bool Equals(const HashTable &other) const;
+
   // Similarly to abseil, the API of find() has two extensions.
   //
   // 1) The hash can be passed by the user.  It must be equal to the
   //    hash of the key.
   //
   // 2) Support C++20-style heterogeneous lookup.
+  //
+  // The other lookup and mutating operations that take a key also
+  // have overloads that take its hash (`emplace_with_hash` for
+  // `emplace`), so that a key hashed once can be used with several
+  // tables that have the same hasher.
 
   template <class K = key_type> size_t count(const key_arg<K> &key) const {
     return find(key) == end() ? 0 : 1;
   }
+  template <class K = key_type>
+  size_t count(const key_arg<K> &key, size_t hash) const {
+    return find(key, hash) == end() ? 0 : 1;
+  }
 
   template <class K = key_type>
   iterator find(const key_arg<K> &key, size_t hash);
@@ -609,6 +1474,54 @@ public:
 
   template <class K = key_type> bool contains(const key_arg<K> &key) const;
 
+  // Sets `found[i] = contains(keys[i])` for each `i` in `[0, n)`.
+  //
+  // The keys are hashed and their buckets prefetched eight at a time,
+  // so the cache misses overlap.  For sets of 64-bit integers with a
+  // multiplicative hasher (see hashers.h), when compiled with
+  // AVX-512, eight keys are looked up at once in vector registers: a
+  // key whose candidates all lie in its preferred bucket is resolved
+  // without leaving them.
+  template <class K = key_type>
+  void contains_many(const key_arg<K> *keys, size_t n, bool *found) const;
+  template <class K = key_type>
+  bool contains(const key_arg<K> &key, size_t hash) const {
+    return find(key, hash) != end();
+  }
+
+  // Prefetches the memory that a lookup or insert of a key with hash
+  // `hash` touches first: the preferred bucket's meta bytes and its
+  // first slots.  Issue it a stage ahead of the operation (e.g., while
+  // working on the previous key) to overlap the cache miss with other
+  // work.  Doesn't change the table.
+  void prefetch(size_t hash) const {
+    if (buckets_.empty()) {
+      return;
+    }
+    const Bucket<Traits> *bucket =
+        buckets_.begin() + buckets_.H1(SeededHash(hash));
+    __builtin_prefetch(&bucket->h2);
+    __builtin_prefetch(&bucket->slots[0]);
+  }
+
+  // Calls `f(value)` for each value in the table.  Rather than
+  // stepping an iterator slot by slot, each bucket's occupied slots are
+  // found with one SIMD mask of its meta bytes.  `f` gets a `const
+  // value_type &` for a set or a const table, and a `value_type &` for
+  // a map (so that it can change the mapped values).  `f` mustn't
+  // insert or erase.
+  template <class F> void for_each(F &&f);
+  template <class F> void for_each(F &&f) const;
+
+  // Same as `for_each`, done by `threads` threads.  The buckets are cut
+  // into chunks of `kForEachChunkBuckets`, which the threads take from
+  // a work-stealing scheduler (see internal/work_stealing.h), so a
+  // thread that's descheduled, or whose values are slow to visit,
+  // doesn't hold up the rest.  `f` is called concurrently and in no
+  // particular order.
+  template <class F> void parallel_for_each(F &&f, size_t threads);
+  template <class F> void parallel_for_each(F &&f, size_t threads) const;
+
   template <class K = key_type>
   std::pair<iterator, iterator> equal_range(const key_arg<K> &key) {
     auto it = find(key);
@@ -646,6 +1559,9 @@ public:
   // Returns the actual size of the buckets (in slots) including the
   // overflow buckets.
   size_t bucket_count() const {
+    if (IsInline()) {
+      return Traits::kInlineCapacity;
+    }
     return buckets_.physical_size() * Traits::kSlotsPerBucket;
   }
   size_t capacity() const { return bucket_count(); }
@@ -654,7 +1570,8 @@ public:
   //
   // Effect: Returns the memory allocated in this table (not including `*this`).
   size_t GetAllocatedMemorySize() const {
-    return buckets_.physical_size() * sizeof(*buckets_.begin());
+    return buckets_.physical_size() * sizeof(*buckets_.begin()) +
+           next_buckets().allocated_bytes();
   }
 
   // Rehashes the table so that we can hold at least `count` without
@@ -673,7 +1590,104 @@ private:
 public:
   void reserve(size_t count);
 
+  // Returns true if inserting `count` more values would grow the
+  // table.
+  bool WouldGrow(size_t count) const { return NeedsRehash(size_ + count); }
+
+  // Makes `*this` a copy of `other`, sized (like a rehash) for `count`
+  // values, with graveyard tombstones.  This is the copying half of a
+  // rehash done on another thread (see internal/background_rehash.h):
+  // `other` is only read, so its owner may keep finding in it
+  // meanwhile.  Stores the number of values copied so far into
+  // `*copied` every few thousand values.
+  void AssignRehashedCopy(const HashTable &other, size_t count,
+                          std::atomic<size_t> *copied);
+
+  // Makes `*this` hold the values of `values` (the first of any equal
+  // keys), sized like a rehash.  The values are sorted by hash and
+  // written in hash order with graveyard tombstones, so nothing is
+  // probed.  (An inline table just inserts them.)
+  void AssignBulk(absl::Span<const value_type> values);
+
+  // Same as `AssignBulk`, done by `threads` threads.  The hashes are
+  // radix-partitioned by their high bits (which choose contiguous
+  // ranges of preferred buckets) and each partition is sorted on its
+  // own.  Then each thread writes ranges of buckets.  A range may
+  // start with values that spilled over from the range before, so the
+  // positions where the ranges start are worked out first, looking at
+  // just the values near the seams.  The result is identical to
+  // `AssignBulk`'s.
+  void AssignBulkParallel(absl::Span<const value_type> values,
+                          size_t threads);
+
+  // For `SegmentedTable` (see internal/segmented_table.h).  Moves the
+  // values of `source` into `*this` and `upper`, which must be empty: a
+  // value goes to `upper` if the top bit of its hash (by `source`'s
+  // hasher) is set, and to `*this` otherwise.  The hashers of `*this`
+  // and `upper` must put the values of their halves in the same order
+  // as `source`'s hasher does (e.g., by shifting out the top bit).
+  // Then `source` is read in hash order, as a rehash reads it, and each
+  // half is written in hash order, with no probing.  Leaves `source`
+  // empty.
+  void SplitFrom(HashTable &source, HashTable &upper);
+
+  // For finds that race with a single writer (see
+  // internal/single_writer_table.h), which need to know which buckets
+  // each operation touches.  Buckets are numbered physically, and the
+  // table must have buckets (`capacity() > 0`) and not be inline.
+  //
+  // The bucket that a key with `hash` prefers.  A find reads
+  // `max(SearchDistance(bucket), 1)` buckets starting there.
+  size_t PreferredBucket(size_t hash) const {
+    return buckets_.H1(SeededHash(hash));
+  }
+  size_t SearchDistance(size_t bucket) const {
+    return buckets_[bucket].search_distance;
+  }
+  // The bucket that an insert of a new key preferring `bucket` writes
+  // its value into (the insert also writes `bucket`'s search
+  // distance), or `capacity() / kSlotsPerBucket` if the insert would
+  // have to reseed instead.
+  size_t InsertBucket(size_t bucket) const {
+    for (size_t i = 0; i + 1 < Traits::kSearchDistanceEndSentinal &&
+                       bucket + i < buckets_.physical_size();
+         ++i) {
+      if (buckets_[bucket + i].FindEmpties() != 0) {
+        return bucket + i;
+      }
+    }
+    return buckets_.physical_size();
+  }
+  // The bucket that `it` is in.
+  size_t BucketNumber(const_iterator it) const {
+    return it.bucket_ - buckets_.begin();
+  }
+
+  // Performs maintenance that `erase(iterator)` defers (since it must
+  // not invalidate other iterators).  Currently, if the Traits specify
+  // a shrink policy and the table has become too empty, shrinks the
+  // table; and if the table has a memory budget, resizes it to the
+  // budget's advised load policy.  Invalidates iterators if it does
+  // anything.
+  void Maintain();
+
   ProbeStatistics GetProbeStatistics() const;
+  // Returns the successful and unsuccessful probe lengths of
+  // `GetProbeStatistics` in O(1) time, from sums kept up to date by
+  // every change.  (The insert probe length isn't kept, since an erase
+  // can shorten the insert probe of many buckets; it's NaN.)
+  //
+  // Requires: `Traits::kOnlineProbeStatistics`.
+  ProbeStatistics GetOnlineProbeStatistics() const;
+  // Estimates `GetProbeStatistics` from `sample_buckets` logical
+  // buckets chosen at random (with a generator seeded with `seed`), in
+  // O(`sample_buckets`) time.
+  ProbeStatisticsEstimate EstimateProbeStatistics(size_t sample_buckets,
+                                                  uint64_t seed = 0) const;
+  // Returns the counts kept by `Traits::instrumentation` (all zero for
+  // `NullInstrumentation`), and the current maximum search distance
+  // (which takes a pass over the buckets' meta data).
+  InstrumentationSnapshot GetInstrumentationSnapshot() const;
   size_t GetSuccessfulProbeLength(const value_type &value) const;
   size_t GetInsertProbeLength(const size_t logical_bucket_number) const;
 
@@ -698,6 +1712,22 @@ private:
     __builtin_prefetch(buckets_.begin(), 0, 1);
   }
 
+  // True if `contains_many` can use `ContainsManyAvx512` for keys of
+  // type `K`.
+  template <class K>
+  static constexpr bool kCanVectorizeContains =
+      kHaveAvx512 && !Traits::is_map && std::is_same_v<K, key_type> &&
+      std::is_integral_v<key_type> && sizeof(key_type) == 8 &&
+      IsMultiplicativeHash<hasher>::value &&
+      std::is_same_v<key_equal, std::equal_to<key_type>>;
+
+#if YOBIDUCK_HAVE_AVX512
+  // Does `contains_many` for the first `n - n % 8` keys.  Requires
+  // `kCanVectorizeContains`, allocated buckets, no seed, and a logical
+  // size less than 2^32.
+  void ContainsManyAvx512(const key_type *keys, size_t n, bool *found) const;
+#endif
+
   // Checks that `*this` is valid.  Requires that a rehash or initial
   // construction has just occurred.  Specifically checks that the graveyard
   // tombstones are present.
@@ -707,10 +1737,280 @@ private:
   // `target_size` elements.
   bool NeedsRehash(size_t target_size) const;
 
-  // The number of slots that we are aiming for, not counting the overflow slots
-  // at the end.  This value is used to compute the H1 hash (which maps from T
-  // to Z/LogicalSlotCount().)
-  size_t LogicalSlotCount() const;
+  // `find` with the instrumentation's hooks, for a sampled find.  Out of
+  // line, so that `find` stays small enough to inline.
+  template <class K>
+  iterator FindInstrumented(const key_arg<K> &key, size_t seeded_hash);
+  // `find` after the hash is seeded, calling `hooks`' `OnFind` and
+  // `OnFalsePositive`.
+  template <class K, class Instrumentation>
+  iterator FindSeeded(const key_arg<K> &key, size_t seeded_hash,
+                      const Instrumentation &hooks);
+
+  typename Traits::instrumentation &instrumentation() {
+    return *static_cast<InstrumentationHolder &>(*this);
+  }
+  const typename Traits::instrumentation &instrumentation() const {
+    return *static_cast<const InstrumentationHolder &>(*this);
+  }
+
+  HashWatchdog<Traits> &watchdog() {
+    return *static_cast<WatchdogHolder &>(*this);
+  }
+  const HashWatchdog<Traits> &watchdog() const {
+    return *static_cast<const WatchdogHolder &>(*this);
+  }
+
+  ProbeSums<Traits> &probe_sums() {
+    return *static_cast<ProbeSumsHolder &>(*this);
+  }
+  const ProbeSums<Traits> &probe_sums() const {
+    return *static_cast<const ProbeSumsHolder &>(*this);
+  }
+  // Notes that the value in `bucket`, whose seeded hash is
+  // `seeded_hash`, is leaving the table.
+  void RemoveFromProbeSums(const Bucket<Traits> *bucket, size_t seeded_hash) {
+    if constexpr (Traits::kOnlineProbeStatistics) {
+      if (!IsInline()) {
+        probe_sums().RemoveValue(bucket -
+                                 &buckets_[buckets_.H1(seeded_hash)] + 1);
+      }
+    }
+  }
+  // Computes the probe sums from scratch, in O(n) time.
+  ProbeSums<Traits> ComputeProbeSums() const;
+
+  BudgetHandle<Traits> &budget() {
+    return *static_cast<BudgetHolder &>(*this);
+  }
+  const BudgetHandle<Traits> &budget() const {
+    return *static_cast<const BudgetHolder &>(*this);
+  }
+
+  // The load policy: the table grows when more than
+  // `FullUtilization()` of its logical slots would be full, to
+  // `RehashedUtilization()`.  From the traits, unless the
+  // `MemoryBudget` advises otherwise.
+  Utilization FullUtilization() const {
+    switch (budget().policy()) {
+    case LoadPolicy::kSpacious:
+      return kSpaciousFullUtilization;
+    case LoadPolicy::kDense:
+      return kDenseFullUtilization;
+    default:
+      return {Traits::full_utilization_numerator,
+              Traits::full_utilization_denominator};
+    }
+  }
+  Utilization RehashedUtilization() const {
+    switch (budget().policy()) {
+    case LoadPolicy::kSpacious:
+      return kSpaciousRehashedUtilization;
+    case LoadPolicy::kDense:
+      return kDenseRehashedUtilization;
+    default:
+      return {Traits::rehashed_utilization_numerator,
+              Traits::rehashed_utilization_denominator};
+    }
+  }
+  // The number of slots that hold `count` values at the rehashed
+  // utilization.
+  size_t RehashedSlotCount(size_t count) const {
+    const Utilization rehashed = RehashedUtilization();
+    return ceil(count * rehashed.denominator, rehashed.numerator);
+  }
+
+  NextBuckets<Traits> &next_buckets() {
+    return *static_cast<NextBucketsHolder &>(*this);
+  }
+  const NextBuckets<Traits> &next_buckets() const {
+    return *static_cast<const NextBucketsHolder &>(*this);
+  }
+
+  // After an insert: if the table is close to growing, allocates and
+  // faults in some more of the bucket array it will grow into.
+  void AdvanceNextBuckets() {
+    if constexpr (Traits::kPrefaultNextBuckets) {
+      const Utilization full = FullUtilization();
+      // The largest size before the table grows.
+      const size_t rehash_point =
+          LogicalSlotCount() * full.numerator / full.denominator;
+      if (size_ * Traits::prefault_utilization_denominator <
+              rehash_point * Traits::prefault_utilization_numerator ||
+          size_ > rehash_point) {
+        return;
+      }
+      // What `rehash_internal` will compute when the insert after the
+      // rehash point calls `rehash(RehashedSlotCount(rehash_point + 1))`.
+      const size_t slot_count =
+          std::max(RehashedSlotCount(rehash_point + 1),
+                   ceil(rehash_point * full.denominator, full.numerator));
+      next_buckets().Advance(ceil(slot_count, Traits::kSlotsPerBucket),
+                             rehash_point - size_);
+    }
+  }
+
+  SampleHandle<Traits> &sample_handle() {
+    return *static_cast<SampleHolder &>(*this);
+  }
+
+  // Brings the table's sample (if it's sampled) and its budget entry
+  // (if it has one) up to date after a change.
+  void UpdateObservers() {
+    if constexpr (Traits::kSample) {
+      if (TableSample *sample = sample_handle().get()) {
+        sample->Update(size_, capacity(), GetAllocatedMemorySize());
+        if (sample->CountChange()) {
+          RecordProbeLengths(*sample);
+        }
+      }
+    }
+    if constexpr (Traits::kMemoryBudget) {
+      budget().entry().Update(size_, capacity(), GetAllocatedMemorySize());
+    }
+  }
+  // After an insert that visited `probe_length` buckets.
+  void ObserveInsert(size_t probe_length) {
+    if constexpr (Traits::kSample) {
+      if (TableSample *sample = sample_handle().get()) {
+        sample->RecordInsert(probe_length);
+      }
+    }
+    UpdateObservers();
+  }
+  // After a rehash that started at `start_nanoseconds` (which is 0
+  // unless the table is sampled).
+  void ObserveRehash(uint64_t start_nanoseconds) {
+    if constexpr (Traits::kSample) {
+      if (TableSample *sample = sample_handle().get()) {
+        sample->RecordRehash(TableSample::NowNanoseconds() - start_nanoseconds,
+                             capacity());
+        RecordProbeLengths(*sample);
+      }
+    }
+    UpdateObservers();
+  }
+  // Records the lookup probe lengths in `sample`: exactly with online
+  // probe statistics, and otherwise estimated from a few buckets.
+  void RecordProbeLengths(TableSample &sample) const {
+    ProbeStatistics statistics;
+    if constexpr (Traits::kOnlineProbeStatistics) {
+      statistics = size_ == 0 ? ProbeStatistics{.successful = 1,
+                                                .unsuccessful = 1,
+                                                .insert = 1}
+                              : GetOnlineProbeStatistics();
+    } else {
+      statistics =
+          EstimateProbeStatistics(/*sample_buckets=*/64, /*seed=*/size_).mean;
+    }
+    sample.RecordProbeLengths(statistics.successful, statistics.unsuccessful);
+  }
+  uint64_t SampleRehashBegin() {
+    if constexpr (Traits::kSample) {
+      if (sample_handle().get() != nullptr) {
+        return TableSample::NowNanoseconds();
+      }
+    }
+    return 0;
+  }
+
+  // Returns the hash that places a key whose hasher's hash is `hash`:
+  // `hash` itself, unless the watchdog has reseeded the table, in
+  // which case `hash` remixed with the seed.  (A remix can't separate
+  // keys with equal hashes, but a weak hash's near collisions, which
+  // share the high bits that choose the bucket, are spread out.)
+  size_t SeededHash(size_t hash) const {
+    const size_t seed = watchdog().seed();
+    if (seed == 0) {
+      return hash;
+    }
+    return MultiplyFold(MultiplyFold(hash ^ seed, FibonacciHash::kMultiplier),
+                        seed);
+  }
+  template <class K> size_t SeededHashOf(const K &key) const {
+    return SeededHash(get_hasher_ref()(key));
+  }
+
+  // Rehashes the values into enough buckets to hold one more value,
+  // and at least as many as now, with a new seed.  Since the old
+  // buckets aren't in the new hash order, the values are sorted by
+  // their new hashes first (as in `MoveFromInline`).
+  void Reseed();
+
+  // Returns true if the values are in the table object's inline
+  // storage rather than in `buckets_`.  That is the case whenever
+  // `Traits::kInlineCapacity > 0` and no buckets are allocated.
+  bool IsInline() const {
+    if constexpr (Traits::kInlineCapacity > 0) {
+      return buckets_.empty();
+    } else {
+      return false;
+    }
+  }
+
+  // Requires `Traits::kInlineCapacity > 0`.
+  InlineBucket<Traits> &inline_storage() {
+    return *static_cast<InlineHolder &>(*this);
+  }
+  const InlineBucket<Traits> &inline_storage() const {
+    return *static_cast<const InlineHolder &>(*this);
+  }
+
+  // Moves the values from `buckets_` into the inline storage and
+  // frees `buckets_`.  Requires `size() <= Traits::kInlineCapacity`.
+  void MoveToInline();
+
+  // Moves the values from the inline storage into newly allocated
+  // buckets with `logical_size` logical buckets.
+  void MoveFromInline(size_t logical_size);
+
+  // Copies the values of `other` into the inline storage.  Requires
+  // `*this` to be empty and inline, and `other.size()` to fit.
+  void CopyToInline(const HashTable &other);
+
+  // Swaps the contents of the inline storages.
+  void SwapInline(HashTable &other);
+
+  static_assert(Traits::shrink_utilization_numerator *
+                        Traits::rehashed_utilization_denominator <
+                    Traits::rehashed_utilization_numerator *
+                        Traits::shrink_utilization_denominator,
+                "The shrink utilization must be less than the rehashed "
+                "utilization, or the table would shrink right after growing.");
+  // Nor under the spacious policy that the memory budget may advise.
+  static_assert(!Traits::kMemoryBudget ||
+                    Traits::shrink_utilization_numerator *
+                            kSpaciousRehashedUtilization.denominator <
+                        kSpaciousRehashedUtilization.numerator *
+                            Traits::shrink_utilization_denominator,
+                "The shrink utilization must be less than the spacious "
+                "rehashed utilization.");
+
+  // Returns true if the Traits have a shrink policy and `size()` has
+  // fallen below the shrink utilization.
+  bool NeedsShrink() const;
+
+  // If the table is smaller at the rehashed utilization, rehash to
+  // that size.
+  void Shrink();
+
+  // Moves all the values into the first buckets of the current
+  // allocation, which becomes a table with `logical_size` logical
+  // buckets, and releases the pages after those buckets.
+  //
+  // Works front to back: Buckets are emptied (their values are moved
+  // into a spill buffer) just before they are overwritten.  Since each
+  // value moves to an earlier bucket, the spill buffer holds only
+  // about a search window's worth of values, rather than a copy of
+  // the table.
+  //
+  // Requires: `0 < logical_size < buckets_.logical_size()`.
+  void ShrinkInPlace(size_t logical_size);
+
+  // The number of slots that we are aiming for, not counting the overflow slots
+  // at the end.  This value is used to compute the H1 hash (which maps from T
+  // to Z/LogicalSlotCount().)
+  size_t LogicalSlotCount() const;
 
   struct InsertResults {
     iterator it;
@@ -726,35 +2026,73 @@ private:
   // `true.  (And increments `size_`.)  The slot's item remains
   // "unconstructed".
   template <class K = key_type>
-  std::pair<iterator, bool> PrepareInsert(const key_arg<K>& key);
+  std::pair<iterator, bool> PrepareInsert(const key_arg<K>& key) {
+    return PrepareInsert(key, get_hasher_ref()(key));
+  }
+
+  // Same as `PrepareInsert(key)`.  Requires: `hash` is the hash of
+  // `key`.
+  template <class K = key_type>
+  std::pair<iterator, bool> PrepareInsert(const key_arg<K>& key, size_t hash);
+
+  // Implements `emplace` and `emplace_with_hash`: `get_hash(key)`
+  // returns the hash of `key`.
+  template <class GetHash, class... Args>
+  std::pair<iterator, bool> Emplace(GetHash get_hash, Args &&...args);
 
  private:
-  // A reference to a disordered value, suitable to put into a heap.
-  // When it's in the heap, the value has logically been removed from
-  // its source (the meta_byte is set empty), but it hasn't actually
-  // been moved yet.  `slot` points to its location.
-  template <bool non_const>
-  struct DisorderedItem {
+  // Visits the values in `buckets` in increasing hash order (which is
+  // the order that `InsertAscending` needs).  The ordered values come
+  // straight from the buckets, and the disordered ones go through a
+  // min-heap.
+  //
+  // The reader doesn't modify `buckets`, but if `is_mutable` then the
+  // caller may move the current value out of its slot and mark its
+  // `meta_byte()` empty before calling `Next()`.
+  template <bool is_mutable> class OrderedReader;
+
+  // Returns the hash of the value in `node`.  The node's cached hash
+  // is used only if the hasher is stateless (and so the table that
+  // the node came from hashes the same way that `*this` does).
+  size_t NodeHash(const node_type &node) const {
+    if constexpr (std::is_empty_v<hasher>) {
+      if (node.hash_.has_value()) {
+        return *node.hash_;
+      }
+    }
+    return get_hasher_ref()(Traits::KeyOf(*node.value_));
+  }
+
+  // Does `merge(other)` by reading both tables in hash order and
+  // inserting them into a new array of buckets big enough for both.
+  void MergeByRehashing(HashTable &other);
+
+  // Returns true if `*this` and `other` can be read together with
+  // `OrderedReader`s: they must hash the same way (so have the same
+  // seed) and not be inline.
+  bool CanStreamWith(const HashTable &other) const {
+    if constexpr (!std::is_empty_v<hasher>) {
+      return false;
+    } else if constexpr (Traits::kInlineCapacity > 0) {
+      return watchdog().seed() == other.watchdog().seed() && !IsInline() &&
+             !other.IsInline();
+    } else {
+      return watchdog().seed() == other.watchdog().seed();
+    }
+  }
+
+
+  // A value that `ShrinkInPlace` has moved into `spilled[index]`,
+  // suitable to put into a heap.
+  struct SpilledItem {
     size_t hash;
-    std::conditional_t<non_const, typename Traits::Slot, const typename Traits::Slot> *slot;
-    friend bool operator<(const DisorderedItem& a, const DisorderedItem& b) {
+    size_t index;
+    friend bool operator<(const SpilledItem &a, const SpilledItem &b) {
       // We want a min-heap ordered by hash, so define 'operator<' to be '>'.
       return a.hash > b.hash;
     }
   };
 
-  // Scan forward from bucket number `disordered_bucket` (increasing
-  // `disordered_bucket`) as far as the search distance for
-  // `buckets[bucket_number]` says to search.  Put each discovered
-  // disordered value into heap and if `destroy_source` then mark its
-  // meta_byte as empty.
-  template<bool destroy_source>
-  void GetDisorderedValues(std::conditional_t<destroy_source, Buckets<Traits>, const Buckets<Traits>> &buckets,
-                           size_t bucket_number,
-                           size_t &disordered_bucket,
-                           std::vector<DisorderedItem<destroy_source>> &heap);
-
-
   // Inserts value into the table.  The values are inserted in
   // monotonically increasing hash order.  The value must be inserted
   // at `insert_bucket, insert_slot` or later.  Updates
@@ -762,14 +2100,147 @@ private:
   //
   // Invariant: The buckets up to `insert_bucket` are initialized, the
   // ones after are not.
-  template<bool insert_tombstones, class GetValueAndStore>
+  //
+  // If `concurrent`, other threads are inserting the values of other
+  // preferred buckets: all the buckets were initialized beforehand,
+  // and the probe sums aren't kept (the caller recomputes them).
+  template <bool insert_tombstones, bool concurrent = false,
+            class GetValueAndStore>
   void InsertAscending(size_t &insert_bucket, size_t &insert_slot,
                        GetValueAndStore get_value_and_store, size_t hash);
 
+  // Moves `insert_bucket, insert_slot` to the start of the next
+  // bucket, as `InsertAscending` does.
+  template <bool insert_tombstones>
+  static void NextInsertBucket(size_t &insert_bucket, size_t &insert_slot);
+
+  // Moves `insert_bucket, insert_slot` past where `InsertAscending`
+  // (with tombstones) would put a value preferring bucket `h1`,
+  // without inserting it.
+  static void SkipAscending(size_t &insert_bucket, size_t &insert_slot,
+                            size_t h1) {
+    while (insert_bucket < h1) {
+      NextInsertBucket<true>(insert_bucket, insert_slot);
+    }
+    if (++insert_slot == Traits::kSlotsPerBucket) {
+      NextInsertBucket<true>(insert_bucket, insert_slot);
+    }
+  }
+
+  // Returns true if `InsertAscending`, at `insert_bucket`, can put a
+  // value preferring bucket `h1` before the last bucket (so that the
+  // next one can be initialized) and within the search distance that a
+  // bucket can record.  Too many values preferring the same place (from
+  // a bad hash) make it false.
+  bool FitsAscending(size_t insert_bucket, size_t h1) const {
+    const size_t target = std::max(insert_bucket, h1);
+    return target + 1 < buckets_.physical_size() &&
+           target - h1 + 1 < Traits::kSearchDistanceEndSentinal;
+  }
+
+  // Called by a bulk build whose values don't fit (see
+  // `FitsAscending`): discards the buckets, whose values must all have
+  // been stored or made empty, and inserts the values one at a time,
+  // which reseeds (with `kHashWatchdog`) or `CHECK`-fails as an insert
+  // does.
+  void AssignByInserting(absl::Span<const value_type> values) {
+    clear();
+    for (const value_type &value : values) {
+      insert(value);
+    }
+  }
+
+  // Replaces the buckets by empty ones sized for `count` values.  The
+  // buckets are uninitialized (as for `BeginInsertAscending`).
+  void AllocateForBulk(size_t count) {
+    Buckets<Traits> buckets(
+        ceil(RehashedSlotCount(count), Traits::kSlotsPerBucket));
+    buckets_.swap(buckets);
+  }
+
+  // Sorts the `(hash, index into values)` pairs in `[first, last)`,
+  // whose hashes all have the same top `known_bits` bits.  It's a
+  // most-significant-digit radix sort: counting passes on the next bits
+  // of the hashes split the pairs into ever smaller parts, which are
+  // finally sorted by comparison.  `scratch` has room for as many
+  // pairs.
+  static void SortByHash(std::pair<size_t, size_t> *first,
+                         std::pair<size_t, size_t> *last,
+                         std::pair<size_t, size_t> *scratch, int known_bits);
+  static void SortByHash(std::pair<size_t, size_t> *first,
+                         std::pair<size_t, size_t> *last, int known_bits) {
+    std::vector<std::pair<size_t, size_t>> scratch(last - first);
+    SortByHash(first, last, scratch.data(), known_bits);
+  }
+
+  // Removes from the `(hash, index into values)` pairs in `[first,
+  // last)`, which are sorted, those whose key equals an earlier one's.
+  // Returns the new end.
+  std::pair<size_t, size_t> *
+  UniqueByKey(absl::Span<const value_type> values,
+              std::pair<size_t, size_t> *first,
+              std::pair<size_t, size_t> *last) const;
+
+  // The type that `for_each` hands out for a table that isn't const.
+  using visited_type =
+      std::conditional_t<Traits::is_map, value_type, const value_type>;
+
+  // How many buckets each task of `parallel_for_each` visits.
+  static constexpr size_t kForEachChunkBuckets = 256;
+
+  // Calls `f` on the values in `[first, last)`.
+  template <class BucketType, class F>
+  static void VisitBuckets(BucketType *first, BucketType *last, F &f) {
+    for (; first != last; ++first) {
+      for (unsigned int full = first->FindNonEmpties(); full != 0;
+           full &= full - 1) {
+        f(first->slots[CountTrailingZeros(full)].GetValue());
+      }
+    }
+  }
+
+  // Calls `f` on the values in the buckets, on `threads` threads.
+  template <class BucketType, class F>
+  static void ParallelVisitBuckets(BucketType *first, BucketType *last, F &f,
+                                   size_t threads);
+
+  // How many values ahead `AssignBulk` prefetches.
+  static constexpr size_t kBulkPrefetchDistance = 16;
+
+  // Calls `f(t)` for each `t` in `[0, threads)`, each on its own
+  // thread (`f(0)` on the calling one).
+  template <class F> static void RunOnThreads(size_t threads, F f) {
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; ++t) {
+      workers.emplace_back(f, t);
+    }
+    f(0);
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
   // Finishes the rehash or copy by initializing all the
   // buckets after `insert_bucket`.
   void FinishInsertAscending(size_t insert_bucket);
 
+  // Starts a sequence of `InsertAscending`s into empty buckets.
+  void BeginInsertAscending() {
+    probe_sums().Reset();
+    InitForInsertAscending(buckets_[0]);
+  }
+
+  // Initializes a bucket that `InsertAscending` is about to use.
+  // Under the zero-is-empty encoding the buckets are already empty
+  // (freshly allocated memory is zero, and `ShrinkInPlace` cleans
+  // each bucket as it empties it), so this does nothing, and pages
+  // are faulted in only when a value is stored in them.
+  static void InitForInsertAscending(Bucket<Traits> &bucket) {
+    if constexpr (!Traits::kZeroIsEmpty) {
+      bucket.Init();
+    }
+  }
+
   // Arrange for the values in `buckets` to be inserted into `*this`
   // (incrementing `size_` for every insert).
   //
@@ -778,9 +2249,15 @@ private:
   //
   // If `is_rehash` then tombstones are inserted and buckets are
   // destroyed.  In that case, this code may move the values from
-  // `buckets` instead of copying them.
-  template<bool is_rehash>
-  void RehashOrCopyFrom(std::conditional_t<is_rehash, Buckets<Traits>, const Buckets<Traits>> &buckets);
+  // `buckets` instead of copying them.  (`insert_tombstones` makes a
+  // copy insert tombstones too.)
+  //
+  // If `copied` isn't null, stores `size_` into it every 4096 values.
+  template <bool is_rehash, bool insert_tombstones = is_rehash>
+  void RehashOrCopyFrom(
+      std::conditional_t<is_rehash, Buckets<Traits>, const Buckets<Traits>>
+          &buckets,
+      std::atomic<size_t> *copied = nullptr);
 
   // Does `RehashOrCopyFrom<false>(buckets)`.
   void CopyFrom(const Buckets<Traits> &buckets);
@@ -798,8 +2275,8 @@ HashTable<Traits>::HashTable()
 template <class Traits>
 HashTable<Traits>::HashTable(size_t initial_capacity, hasher const &hash,
                              key_equal const &key_eq,
-                             allocator_type const &allocator)
-    : HasherHolder(hash), KeyEqualHolder(key_eq), AllocatorHolder(allocator) {
+                             allocator_type const &alloc)
+    : HasherHolder(hash), KeyEqualHolder(key_eq), AllocatorHolder(alloc) {
   reserve(initial_capacity);
 }
 
@@ -820,21 +2297,44 @@ HashTable<Traits>::HashTable(const HashTable &other, const allocator_type &a)
   // TODO: We could conceivably squeeze the table even more, and
   // reduce the table size by the number of tombstones we didn't
   // place
+  watchdog().set_seed(other.watchdog().seed());
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      CopyToInline(other);
+      UpdateObservers();
+      return;
+    }
+  }
   size_ = other.size_;
   CopyFrom(other.buckets_);
+  UpdateObservers();
 }
 
 template <class Traits>
 HashTable<Traits> &HashTable<Traits>::operator=(const HashTable &other) {
   clear();
+  watchdog().set_seed(other.watchdog().seed());
   reserve(other.size_);
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      CopyToInline(other);
+      UpdateObservers();
+      return *this;
+    }
+  }
   size_ = other.size_;
   CopyFrom(other.buckets_);
+  UpdateObservers();
   return *this;
 }
 
 template <class Traits>
 typename HashTable<Traits>::iterator HashTable<Traits>::begin() {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      return iterator(&inline_storage().bucket(), 0).SkipEmpty();
+    }
+  }
   auto it = iterator(buckets_.begin(), 0);
   if (!buckets_.empty()) {
     it.SkipEmpty();
@@ -844,6 +2344,11 @@ typename HashTable<Traits>::iterator HashTable<Traits>::begin() {
 
 template <class Traits>
 typename HashTable<Traits>::const_iterator HashTable<Traits>::cbegin() const {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      return const_iterator(&inline_storage().bucket(), 0).SkipEmpty();
+    }
+  }
   auto it = const_iterator(buckets_.cbegin(), 0);
   if (!buckets_.empty()) {
     it.SkipEmpty();
@@ -851,13 +2356,26 @@ typename HashTable<Traits>::const_iterator HashTable<Traits>::cbegin() const {
   return it;
 }
 
+// For the inline storage, the end iterator is one past its bucket,
+// just as it is one past the last bucket of `buckets_`.
+
 template <class Traits>
 typename HashTable<Traits>::iterator HashTable<Traits>::end() {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      return iterator(&inline_storage().bucket() + 1, 0);
+    }
+  }
   return iterator(buckets_.end(), 0);
 }
 
 template <class Traits>
 typename HashTable<Traits>::const_iterator HashTable<Traits>::cend() const {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      return const_iterator(&inline_storage().bucket() + 1, 0);
+    }
+  }
   return const_iterator(buckets_.cend(), 0);
 }
 
@@ -953,8 +2471,33 @@ template <class Traits> size_t HashTable<Traits>::size() const noexcept {
 }
 
 template <class Traits> void HashTable<Traits>::clear() {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      inline_storage().clear();
+    }
+  }
   size_ = 0;
   buckets_.clear();
+  next_buckets().Free();
+  watchdog().Reset();
+  probe_sums().Reset();
+  UpdateObservers();
+}
+
+template <class Traits> void HashTable<Traits>::clear_keep_capacity() {
+  if (buckets_.empty()) {
+    // Either there is nothing, or the values are inline.
+    clear();
+    return;
+  }
+  buckets_.Reset();
+  buckets_[buckets_.physical_size() - 1].search_distance =
+      Traits::kSearchDistanceEndSentinal;
+  size_ = 0;
+  next_buckets().Free();
+  watchdog().Reset();
+  probe_sums().Reset();
+  UpdateObservers();
 }
 
 static constexpr void maxf(uint8_t &v1, uint8_t v2) { v1 = std::max(v1, v2); }
@@ -962,39 +2505,170 @@ static constexpr void maxf(uint8_t &v1, uint8_t v2) { v1 = std::max(v1, v2); }
 template <class Traits>
 template <class K>
 std::pair<typename HashTable<Traits>::iterator, bool>
-HashTable<Traits>::PrepareInsert(const key_arg<K> &key) {
+HashTable<Traits>::PrepareInsert(const key_arg<K> &key, size_t hash) {
+  const size_t seeded_hash = SeededHash(hash);
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      // Look for the key before deciding to move to the heap, so that
+      // a full inline table doesn't allocate for a duplicate.
+      Bucket<Traits> &bucket = inline_storage().bucket();
+      const size_t h2 = buckets_.H2(seeded_hash);
+      size_t idx = bucket.FindElement(h2, key, get_key_eq_ref());
+      if (idx < Traits::kSlotsPerBucket) {
+        return {iterator{&bucket, idx}, false};
+      }
+      if (size_ < Traits::kInlineCapacity) {
+        size_t empties =
+            bucket.FindEmpties() & ((1u << Traits::kInlineCapacity) - 1);
+        assert(empties != 0);
+        idx = CountTrailingZeros(empties);
+        bucket.h2[idx].SetOrderedValue(h2);
+        ++size_;
+        instrumentation().OnInsert(1);
+        ObserveInsert(1);
+        return {iterator(&bucket, idx), true};
+      }
+    }
+  }
+  // Probe for the key and for a free slot in the same pass: each
+  // bucket's meta bytes are loaded once, yielding both the H2 matches
+  // and the empties.  The first empty slot is remembered while the
+  // duplicate check continues to the end of the search window.
+  const size_t h2 = buckets_.H2(seeded_hash);
+  Bucket<Traits> *empty_bucket = nullptr;
+  unsigned int empty_mask = 0;
+  size_t empty_distance = 0;
+  size_t preferred_bucket = 0;
+  size_t distance = 0;
+  if (!buckets_.empty()) {
+    preferred_bucket = buckets_.H1(seeded_hash);
+    distance = buckets_[preferred_bucket].search_distance;
+    for (size_t i = 0; i < distance; ++i) {
+      // Don't use operator[], since that Buckets::operator[] has a bounds
+      // check.
+      __builtin_prefetch(&(buckets_.begin() + preferred_bucket + i + 1)->h2);
+      assert(preferred_bucket + i < buckets_.physical_size());
+      Bucket<Traits> &bucket = buckets_[preferred_bucket + i];
+      auto [matches, empties] = bucket.MatchesAndEmpties(h2);
+      while (matches) {
+        size_t idx = CountTrailingZeros(matches);
+        if (get_key_eq_ref()(Traits::KeyOf(bucket.slots[idx].GetValue()),
+                             key)) {
+          return {iterator{&bucket, idx}, false};
+        }
+        if (instrumentation().SampleFind()) {
+          instrumentation().OnFalsePositive();
+        }
+        matches &= (matches - 1);
+      }
+      if (empty_bucket == nullptr && empties != 0) {
+        empty_bucket = &bucket;
+        empty_mask = empties;
+        empty_distance = i;
+      }
+    }
+  }
+  // The key isn't present, so now it's safe to grow.  (Checking first
+  // would rehash on a duplicate insert into a table at the threshold.)
   if (NeedsRehash(size_ + 1)) {
-    rehash(ceil((size_ + 1) * Traits::rehashed_utilization_denominator,
-                Traits::rehashed_utilization_numerator));
-  }
-  // TODO: Use the Hash in OLP.
-  const size_t hash = get_hasher_ref()(key);
-  const size_t preferred_bucket = buckets_.H1(hash);
-  const size_t h2 = buckets_.H2(hash);
-  const size_t distance = buckets_[preferred_bucket].search_distance;
-  for (size_t i = 0; i < distance; ++i) {
-    // Don't use operator[], since that Buckets::operator[] has a bounds check.
-    __builtin_prefetch(&(buckets_.begin() + preferred_bucket + i + 1)->h2);
-    assert(preferred_bucket + i < buckets_.physical_size());
-    Bucket<Traits> &bucket = buckets_[preferred_bucket + i];
-    size_t idx = bucket.FindElement(h2, key, get_key_eq_ref());
-    if (idx < Traits::kSlotsPerBucket) {
-      return {iterator{&bucket, idx}, false};
+    rehash(RehashedSlotCount(size_ + 1));
+    preferred_bucket = buckets_.H1(seeded_hash);
+    empty_bucket = nullptr;
+    distance = 0;
+  }
+  if (empty_bucket == nullptr) {
+    // No room within the search window: keep looking past it.
+    for (size_t i = distance; true; ++i) {
+      if (i + 1 >= Traits::kSearchDistanceEndSentinal ||
+          preferred_bucket + i >= buckets_.physical_size()) {
+        // There's no free slot within reach, which a sane hash makes
+        // vanishingly unlikely.  Reseed, unless that was just tried.
+        CHECK(watchdog().Armed(size_))
+            << "Too many keys hash to the same place (even after reseeding, "
+               "if the Traits have kHashWatchdog)";
+        Reseed();
+        return PrepareInsert(key, hash);
+      }
+      Bucket<Traits> &bucket = buckets_[preferred_bucket + i];
+      unsigned int empties = bucket.FindEmpties();
+      if (empties != 0) {
+        empty_bucket = &bucket;
+        empty_mask = empties;
+        empty_distance = i;
+        break;
+      }
     }
   }
-  for (size_t i = 0; true; ++i) {
-    assert(i < Traits::kSearchDistanceEndSentinal);
-    assert(preferred_bucket + i < buckets_.physical_size());
-    Bucket<Traits> &bucket = buckets_[preferred_bucket + i];
-    size_t matches = bucket.FindEmpties();
-    if (matches != 0) {
-      size_t idx = CountTrailingZeros(matches);
-      bucket.h2[idx].SetUnorderedValue(h2);
-      ++size_;
-      maxf(buckets_[preferred_bucket].search_distance, i + 1);
-      return {iterator(&bucket, idx), true};
+  // Check the probe lengths before claiming the slot, so that a
+  // reseed doesn't have to move an unconstructed value.
+  if (watchdog().Fires(std::max<size_t>(
+                            buckets_[preferred_bucket].search_distance,
+                            empty_distance + 1),
+                        size_)) {
+    Reseed();
+    return PrepareInsert(key, hash);
+  }
+  // The fused loop visited the whole search window.
+  const size_t probe_length = std::max(distance, empty_distance + 1);
+  instrumentation().OnInsert(probe_length);
+  size_t idx = CountTrailingZeros(empty_mask);
+  empty_bucket->h2[idx].SetUnorderedValue(h2);
+  ++size_;
+  const uint8_t old_search_distance = buckets_[preferred_bucket].search_distance;
+  maxf(buckets_[preferred_bucket].search_distance, empty_distance + 1);
+  probe_sums().AddSearchDistance(buckets_[preferred_bucket].search_distance -
+                                 old_search_distance);
+  probe_sums().AddValue(empty_distance + 1);
+  AdvanceNextBuckets();
+  ObserveInsert(probe_length);
+  return {iterator(empty_bucket, idx), true};
+}
+
+template <class Traits> void HashTable<Traits>::Reseed() {
+  // Grow too if the table is past the rehashed utilization (as when a
+  // good hash at a high load sets off the watchdog).
+  const size_t logical_size = std::max(
+      buckets_.logical_size(),
+      ceil(RehashedSlotCount(size_ + 1), Traits::kSlotsPerBucket));
+  const auto start = instrumentation().OnRehashBegin();
+  const uint64_t sample_start = SampleRehashBegin();
+  Buckets<Traits> buckets(logical_size);
+  buckets.swap(buckets_);
+  watchdog().Reseed(size_);
+  struct Item {
+    size_t hash;
+    Bucket<Traits> *bucket;
+    size_t slot;
+  };
+  std::vector<Item> order;
+  order.reserve(size_);
+  for (Bucket<Traits> &bucket : buckets) {
+    for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
+      if (!bucket.h2[j].IsEmpty()) {
+        order.push_back(
+            {SeededHashOf(Traits::KeyOf(bucket.slots[j].GetValue())), &bucket,
+             j});
+      }
     }
   }
+  std::sort(order.begin(), order.end(),
+            [](const Item &a, const Item &b) { return a.hash < b.hash; });
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  for (const Item &item : order) {
+    CHECK(FitsAscending(insert_bucket, buckets_.H1(item.hash)))
+        << "Too many keys hash to the same place, even after reseeding";
+    auto store = [&item](typename Traits::Slot &dest_slot) {
+      dest_slot.Transfer(item.bucket->slots[item.slot]);
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                store, item.hash);
+    item.bucket->h2[item.slot].SetEmpty();
+  }
+  FinishInsertAscending(insert_bucket);
+  instrumentation().OnRehashEnd(start, size_ * sizeof(value_type));
+  ObserveRehash(sample_start);
 }
 
 // TODO: Deal with the &&value_type insert.
@@ -1002,7 +2676,13 @@ HashTable<Traits>::PrepareInsert(const key_arg<K> &key) {
 template <class Traits>
 std::pair<typename HashTable<Traits>::iterator, bool>
 HashTable<Traits>::insert(const value_type &value) {
-  auto [it, inserted] = PrepareInsert(Traits::KeyOf(value));
+  return insert(value, get_hasher_ref()(Traits::KeyOf(value)));
+}
+
+template <class Traits>
+std::pair<typename HashTable<Traits>::iterator, bool>
+HashTable<Traits>::insert(const value_type &value, size_t hash) {
+  auto [it, inserted] = PrepareInsert(Traits::KeyOf(value), hash);
   if (!inserted) {
     return {it, false};
   }
@@ -1011,24 +2691,366 @@ HashTable<Traits>::insert(const value_type &value) {
 }
 
 template <class Traits>
-template <class... Args>
+template <class GetHash, class... Args>
 std::pair<typename HashTable<Traits>::iterator, bool>
-HashTable<Traits>::emplace(Args &&...args) {
-  typename Traits::Slot::StoredType
-      value{std::forward<Args>(args)...};
-  auto& key = Traits::KeyOf(value);
-  auto prepare_result = PrepareInsert(key);
-  auto &[it, inserted] = prepare_result;
-  if (inserted) {
-    it.bucket_->slots[it.index_].Store(std::move(value));
+HashTable<Traits>::Emplace(GetHash get_hash, Args &&...args) {
+  if constexpr (KeyDecomposer<Traits>::template CanDecompose<Args...>()) {
+    const auto &key = KeyDecomposer<Traits>::Key(args...);
+    auto prepare_result = PrepareInsert(key, get_hash(key));
+    auto &[it, inserted] = prepare_result;
+    if (inserted) {
+      it.bucket_->slots[it.index_].Emplace(std::forward<Args>(args)...);
+    }
+    return prepare_result;
+  } else {
+    typename Traits::Slot::StoredType value{std::forward<Args>(args)...};
+    auto &key = Traits::KeyOf(value);
+    auto prepare_result = PrepareInsert(key, get_hash(key));
+    auto &[it, inserted] = prepare_result;
+    if (inserted) {
+      it.bucket_->slots[it.index_].Store(std::move(value));
+    }
+    return prepare_result;
+  }
+}
+
+template <class Traits>
+typename HashTable<Traits>::insert_return_type
+HashTable<Traits>::insert(node_type &&node) {
+  if (node.empty()) {
+    return {end(), false, node_type()};
+  }
+  auto [it, inserted] =
+      PrepareInsert(Traits::KeyOf(*node.value_), NodeHash(node));
+  if (!inserted) {
+    return {it, false, std::move(node)};
+  }
+  it.bucket_->slots[it.index_].Store(std::move(*node.value_));
+  node.value_.reset();
+  return {it, true, node_type()};
+}
+
+template <class Traits>
+typename HashTable<Traits>::node_type
+HashTable<Traits>::extract(const_iterator pos) {
+  Bucket<Traits> *bucket = const_cast<Bucket<Traits> *>(pos.bucket_);
+  size_t index = pos.index_;
+  assert(!bucket->h2[index].IsEmpty());
+  assert(size_ > 0);
+  auto &slot = bucket->slots[index];
+  node_type node;
+  node.hash_ = get_hasher_ref()(Traits::KeyOf(slot.GetValue()));
+  RemoveFromProbeSums(bucket, SeededHash(*node.hash_));
+  node.value_.emplace(slot.MoveAndDestroy());
+  bucket->h2[index].SetEmpty();
+  --size_;
+  UpdateObservers();
+  return node;
+}
+
+template <class Traits>
+template <class K>
+typename HashTable<Traits>::node_type
+HashTable<Traits>::extract(const key_arg<K> &key, size_t hash) {
+  auto it = find(key, hash);
+  if (it == end()) {
+    return node_type();
+  }
+  node_type node;
+  node.hash_ = hash;
+  RemoveFromProbeSums(it.bucket_, SeededHash(hash));
+  node.value_.emplace(it.bucket_->slots[it.index_].MoveAndDestroy());
+  it.bucket_->h2[it.index_].SetEmpty();
+  --size_;
+  if (NeedsShrink()) {
+    Shrink();
+  }
+  UpdateObservers();
+  return node;
+}
+
+template <class Traits> void HashTable<Traits>::merge(HashTable &other) {
+  if (&other == this || other.empty()) {
+    return;
+  }
+  if (CanStreamWith(other) && NeedsRehash(size_ + other.size_)) {
+    MergeByRehashing(other);
+    return;
+  }
+  for (auto it = other.begin(); it != other.end(); ++it) {
+    auto &slot = it.bucket_->slots[it.index_];
+    const key_type &key = Traits::KeyOf(slot.GetValue());
+    auto [pos, inserted] = PrepareInsert(key, get_hasher_ref()(key));
+    if (inserted) {
+      other.RemoveFromProbeSums(it.bucket_, other.SeededHashOf(key));
+      pos.bucket_->slots[pos.index_].Transfer(slot);
+      it.bucket_->h2[it.index_].SetEmpty();
+      --other.size_;
+    }
+  }
+  other.UpdateObservers();
+}
+
+template <class Traits>
+void HashTable<Traits>::MergeByRehashing(HashTable &other) {
+  // Size the new buckets as `PrepareInsert` would if there were no
+  // duplicates.
+  const size_t slot_count = RehashedSlotCount(size_ + other.size_);
+  Buckets<Traits> buckets(ceil(slot_count, Traits::kSlotsPerBucket));
+  buckets.swap(buckets_);
+  OrderedReader<true> mine(*this, buckets);
+  OrderedReader<true> theirs(other, other.buckets_);
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  // The values inserted so far whose hash is `run_hash`.  A value from
+  // `other` can only be a duplicate of one of these.  On equal hashes
+  // our values are taken first.
+  std::vector<const value_type *> run;
+  size_t run_hash = 0;
+  auto transfer = [&](auto &reader) {
+    auto &slot = reader.slot();
+    const size_t hash = reader.hash();
+    if (run.empty() || run_hash != hash) {
+      run.clear();
+      run_hash = hash;
+    }
+    auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
+      dest_slot.Transfer(slot);
+      run.push_back(&dest_slot.GetValue());
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                get_value_and_store, hash);
+    reader.meta_byte().SetEmpty();
+  };
+  while (!mine.done() || !theirs.done()) {
+    if (!mine.done() && (theirs.done() || mine.hash() <= theirs.hash())) {
+      transfer(mine);
+      mine.Next();
+      continue;
+    }
+    const key_type &key = Traits::KeyOf(theirs.slot().GetValue());
+    bool duplicate = false;
+    if (!run.empty() && run_hash == theirs.hash()) {
+      for (const value_type *value : run) {
+        if (get_key_eq_ref()(Traits::KeyOf(*value), key)) {
+          duplicate = true;
+          break;
+        }
+      }
+    }
+    if (!duplicate) {
+      transfer(theirs);
+      ++size_;
+      --other.size_;
+    }
+    theirs.Next();
+  }
+  FinishInsertAscending(insert_bucket);
+  // Removing `other`'s values one at a time would need their
+  // preferred buckets in `other`.
+  if constexpr (Traits::kOnlineProbeStatistics) {
+    other.probe_sums() = other.ComputeProbeSums();
+  }
+  UpdateObservers();
+  other.UpdateObservers();
+}
+
+template <class Traits>
+template <SetOperation op, class Combine>
+void HashTable<Traits>::AssignSetOperation(const HashTable &a,
+                                           const HashTable &b,
+                                           Combine combine) {
+  assert(this != &a && this != &b);
+  clear();
+  // When `a` and `b` are streamed, the values are written in the order
+  // of their seed, so `*this` must hash with it too.
+  watchdog().set_seed(a.watchdog().seed());
+  const size_t max_size = op == SetOperation::kUnion ? a.size() + b.size()
+                          : op == SetOperation::kIntersection
+                              ? std::min(a.size(), b.size())
+                              : a.size();
+  if (max_size == 0) {
+    return;
+  }
+  if (!a.CanStreamWith(b)) {
+    reserve(max_size);
+    for (const value_type &value : a) {
+      auto it = b.find(Traits::KeyOf(value));
+      if (it == b.end()) {
+        if (op != SetOperation::kIntersection) {
+          insert(value);
+        }
+      } else if (op != SetOperation::kDifference) {
+        insert(combine(value, *it));
+      }
+    }
+    if constexpr (op == SetOperation::kUnion) {
+      for (const value_type &value : b) {
+        if (!a.contains(Traits::KeyOf(value))) {
+          insert(value);
+        }
+      }
+    }
+    return;
+  }
+  const size_t slot_count =
+      RehashedSlotCount(max_size);
+  {
+    Buckets<Traits> buckets(ceil(slot_count, Traits::kSlotsPerBucket));
+    buckets.swap(buckets_);
+  }
+  OrderedReader<false> a_reader(a, a.buckets_);
+  OrderedReader<false> b_reader(b, b.buckets_);
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  auto emit = [&](const auto &value, size_t hash) {
+    ++size_;
+    auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
+      dest_slot.Store(value);
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                get_value_and_store, hash);
+  };
+  // Equal keys have equal hashes, so when the hashes are equal the
+  // values are matched up one run of equal hashes at a time.  The runs
+  // are almost always of length 1.
+  std::vector<const value_type *> a_run;
+  std::vector<const value_type *> b_run;
+  std::vector<bool> b_matched;
+  auto get_run = [](OrderedReader<false> &reader, size_t hash,
+                    std::vector<const value_type *> &run) {
+    run.clear();
+    for (; !reader.done() && reader.hash() == hash; reader.Next()) {
+      run.push_back(&reader.slot().GetValue());
+    }
+  };
+  while (!a_reader.done() &&
+         (op != SetOperation::kIntersection || !b_reader.done())) {
+    if (b_reader.done() || a_reader.hash() < b_reader.hash()) {
+      if (op != SetOperation::kIntersection) {
+        emit(a_reader.slot().GetValue(), a_reader.hash());
+      }
+      a_reader.Next();
+      continue;
+    }
+    if (b_reader.hash() < a_reader.hash()) {
+      if (op == SetOperation::kUnion) {
+        emit(b_reader.slot().GetValue(), b_reader.hash());
+      }
+      b_reader.Next();
+      continue;
+    }
+    const size_t hash = a_reader.hash();
+    get_run(a_reader, hash, a_run);
+    get_run(b_reader, hash, b_run);
+    b_matched.assign(b_run.size(), false);
+    for (const value_type *a_value : a_run) {
+      const value_type *match = nullptr;
+      for (size_t i = 0; i < b_run.size(); ++i) {
+        if (!b_matched[i] && get_key_eq_ref()(Traits::KeyOf(*a_value),
+                                              Traits::KeyOf(*b_run[i]))) {
+          b_matched[i] = true;
+          match = b_run[i];
+          break;
+        }
+      }
+      if (match == nullptr) {
+        if (op != SetOperation::kIntersection) {
+          emit(*a_value, hash);
+        }
+      } else if (op != SetOperation::kDifference) {
+        emit(combine(*a_value, *match), hash);
+      }
+    }
+    if constexpr (op == SetOperation::kUnion) {
+      for (size_t i = 0; i < b_run.size(); ++i) {
+        if (!b_matched[i]) {
+          emit(*b_run[i], hash);
+        }
+      }
+    }
+  }
+  if constexpr (op == SetOperation::kUnion) {
+    for (; !b_reader.done(); b_reader.Next()) {
+      emit(b_reader.slot().GetValue(), b_reader.hash());
+    }
+  }
+  FinishInsertAscending(insert_bucket);
+  // The buckets were sized for `max_size`.  Give back the memory if
+  // the result is much smaller.  (Shrinking costs another pass, so
+  // don't bother for a factor of 2.)
+  const size_t wanted_slot_count =
+      RehashedSlotCount(size_);
+  if (4 * ceil(wanted_slot_count, Traits::kSlotsPerBucket) <=
+      buckets_.logical_size()) {
+    rehash(wanted_slot_count);
+  }
+  UpdateObservers();
+}
+
+template <class Traits>
+bool HashTable<Traits>::Equals(const HashTable &other) const {
+  if (size_ != other.size_) {
+    return false;
+  }
+  if (!CanStreamWith(other)) {
+    for (const value_type &value : *this) {
+      auto it = other.find(Traits::KeyOf(value));
+      if (it == other.end() || !(*it == value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  OrderedReader<false> reader(*this, buckets_);
+  OrderedReader<false> other_reader(other, other.buckets_);
+  std::vector<const value_type *> run;
+  while (!reader.done()) {
+    if (other_reader.done() || reader.hash() != other_reader.hash()) {
+      return false;
+    }
+    const size_t hash = reader.hash();
+    run.clear();
+    for (; !other_reader.done() && other_reader.hash() == hash;
+         other_reader.Next()) {
+      run.push_back(&other_reader.slot().GetValue());
+    }
+    for (; !reader.done() && reader.hash() == hash; reader.Next()) {
+      const value_type &value = reader.slot().GetValue();
+      auto it = std::find_if(run.begin(), run.end(),
+                             [&](const value_type *other_value) {
+                               return *other_value == value;
+                             });
+      if (it == run.end()) {
+        return false;
+      }
+      run.erase(it);
+    }
+    if (!run.empty()) {
+      return false;
+    }
   }
-  return prepare_result;
+  return other_reader.done();
 }
 
 template <class Traits>
 void HashTable<Traits>::swap(HashTable &other) noexcept {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    SwapInline(other);
+  }
   std::swap(size_, other.size_);
   buckets_.swap(other.buckets_);
+  // The values are placed by their hasher, so it goes with them.
+  using std::swap;
+  swap(get_hasher_ref(), other.get_hasher_ref());
+  swap(get_key_eq_ref(), other.get_key_eq_ref());
+  std::swap(watchdog(), other.watchdog());
+  sample_handle().swap(other.sample_handle());
+  budget().swap(other.budget());
+  std::swap(probe_sums(), other.probe_sums());
+  next_buckets().swap(other.next_buckets());
 }
 
 template <class Traits> void HashTable<Traits>::erase(iterator pos) {
@@ -1041,10 +3063,14 @@ template <class Traits> void HashTable<Traits>::erase(const_iterator pos) {
   // We can assume that it's a valid iterator.
   assert(!bucket->h2[index].IsEmpty());
   assert(size_ > 0);
+  if constexpr (Traits::kOnlineProbeStatistics) {
+    RemoveFromProbeSums(bucket,
+                        SeededHashOf(Traits::KeyOf(bucket->slots[index].GetValue())));
+  }
   bucket->h2[index].SetEmpty();
   bucket->slots[index].Destroy();
   --size_;
-  return;
+  UpdateObservers();
 }
 
 template <class Traits>
@@ -1058,22 +3084,62 @@ HashTable<Traits>::erase(const_iterator first, const_iterator last) {
 
 template <class Traits>
 template <class K>
-size_t HashTable<Traits>::erase(const key_arg<K> &key) {
-  auto it = find(key);
+size_t HashTable<Traits>::erase(const key_arg<K> &key, size_t hash) {
+  auto it = find(key, hash);
   if (it == end()) {
     return 0;
   }
   erase(it);
+  if (NeedsShrink()) {
+    Shrink();
+  }
   return 1;
 }
 
 template <class Traits>
 template <class K>
-typename HashTable<Traits>::iterator
+inline typename HashTable<Traits>::iterator
 HashTable<Traits>::find(const key_arg<K> &key, size_t hash) {
+  const size_t seeded_hash = SeededHash(hash);
+  if constexpr (Traits::kMemoryBudget) {
+    budget().entry().CountLookups(1);
+  }
+  if constexpr (Traits::instrumentation::kEnabled) {
+    if (instrumentation().SampleFind()) {
+      return FindInstrumented<K>(key, seeded_hash);
+    }
+  }
+  return FindSeeded<K>(key, seeded_hash, NullInstrumentation());
+}
+
+template <class Traits>
+template <class K>
+ABSL_ATTRIBUTE_NOINLINE typename HashTable<Traits>::iterator
+HashTable<Traits>::FindInstrumented(const key_arg<K> &key,
+                                    size_t seeded_hash) {
+  return FindSeeded<K>(key, seeded_hash, instrumentation());
+}
+
+template <class Traits>
+template <class K, class Instrumentation>
+inline typename HashTable<Traits>::iterator
+HashTable<Traits>::FindSeeded(const key_arg<K> &key, size_t seeded_hash,
+                              const Instrumentation &hooks) {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      Bucket<Traits> &bucket = inline_storage().bucket();
+      size_t idx =
+          bucket.FindElement(buckets_.H2(seeded_hash), key, get_key_eq_ref());
+      hooks.OnFind(1, idx < Traits::kSlotsPerBucket);
+      if (idx < Traits::kSlotsPerBucket) {
+        return iterator{&bucket, idx};
+      }
+      return end();
+    }
+  }
   if (size_ != 0) {
-    const size_t h1 = buckets_.H1(hash);
-    const size_t h2 = buckets_.H2(hash);
+    const size_t h1 = buckets_.H1(seeded_hash);
+    const size_t h2 = buckets_.H2(seeded_hash);
     const size_t distance = buckets_[h1].search_distance;
     //__builtin_prefetch(&buckets_[h1].h2[0]);
     ////__builtin_prefetch(&buckets_[h1 + 1].h2[0]);
@@ -1099,23 +3165,270 @@ HashTable<Traits>::find(const key_arg<K> &key, size_t hash) {
        while (matches) {
         size_t idx = CountTrailingZeros(matches);
         if (get_key_eq_ref()(Traits::KeyOf(bucket.slots[idx].GetValue()), key)) {
+          hooks.OnFind(i + 1, true);
           return iterator{&bucket, idx};
         }
-        matches &= (matches - 1);
+        hooks.OnFalsePositive();
+        matches &= (matches - 1);
+      }
+      ++i;
+    } while (i < distance);
+    hooks.OnFind(i, false);
+    return end();
+  }
+  hooks.OnFind(0, false);
+  return end();
+}
+
+template <class Traits>
+template <class K>
+inline bool HashTable<Traits>::contains(const key_arg<K> &value) const {
+  return find(value) != end();
+}
+
+template <class Traits>
+template <class F>
+void HashTable<Traits>::for_each(F &&f) {
+  auto visit = [&f](visited_type &value) { f(value); };
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      VisitBuckets(&inline_storage().bucket(), &inline_storage().bucket() + 1,
+                   visit);
+      return;
+    }
+  }
+  VisitBuckets(buckets_.begin(), buckets_.end(), visit);
+}
+
+template <class Traits>
+template <class F>
+void HashTable<Traits>::for_each(F &&f) const {
+  auto visit = [&f](const value_type &value) { f(value); };
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      VisitBuckets(&inline_storage().bucket(), &inline_storage().bucket() + 1,
+                   visit);
+      return;
+    }
+  }
+  VisitBuckets(buckets_.cbegin(), buckets_.cend(), visit);
+}
+
+template <class Traits>
+template <class F>
+void HashTable<Traits>::parallel_for_each(F &&f, size_t threads) {
+  if (IsInline() || buckets_.physical_size() <= kForEachChunkBuckets) {
+    for_each(f);
+    return;
+  }
+  auto visit = [&f](visited_type &value) { f(value); };
+  ParallelVisitBuckets(buckets_.begin(), buckets_.end(), visit, threads);
+}
+
+template <class Traits>
+template <class F>
+void HashTable<Traits>::parallel_for_each(F &&f, size_t threads) const {
+  if (IsInline() || buckets_.physical_size() <= kForEachChunkBuckets) {
+    for_each(f);
+    return;
+  }
+  auto visit = [&f](const value_type &value) { f(value); };
+  ParallelVisitBuckets(buckets_.cbegin(), buckets_.cend(), visit, threads);
+}
+
+template <class Traits>
+template <class BucketType, class F>
+void HashTable<Traits>::ParallelVisitBuckets(BucketType *first,
+                                             BucketType *last, F &f,
+                                             size_t threads) {
+  const size_t bucket_count = last - first;
+  const size_t chunk_count =
+      ceil(bucket_count, kForEachChunkBuckets);
+  threads = std::max(size_t{1}, std::min(threads, chunk_count));
+  WorkStealingRanges chunks(chunk_count, threads);
+  RunOnThreads(threads, [&](size_t t) {
+    size_t chunk;
+    while (chunks.Next(t, chunk)) {
+      BucketType *begin = first + chunk * kForEachChunkBuckets;
+      VisitBuckets(begin,
+                   first + std::min(bucket_count,
+                                    (chunk + 1) * kForEachChunkBuckets),
+                   f);
+    }
+  });
+}
+
+template <class Traits>
+template <class K>
+void HashTable<Traits>::contains_many(const key_arg<K> *keys, size_t n,
+                                      bool *found) const {
+  size_t i = 0;
+#if YOBIDUCK_HAVE_AVX512
+  if constexpr (kCanVectorizeContains<K>) {
+    if (!buckets_.empty() && watchdog().seed() == 0 &&
+        buckets_.logical_size() <= std::numeric_limits<uint32_t>::max()) {
+      ContainsManyAvx512(keys, n, found);
+      i = n - n % 8;
+      if constexpr (Traits::instrumentation::kEnabled) {
+        // The kernel doesn't count probes, so call them all one.
+        for (size_t j = 0; j < i; ++j) {
+          if (instrumentation().SampleFind()) {
+            instrumentation().OnFind(1, found[j]);
+          }
+        }
       }
-      ++i;
-    } while (i < distance);
+      if constexpr (Traits::kMemoryBudget) {
+        budget().entry().CountLookups(i);
+      }
+    }
+  }
+#endif
+  constexpr size_t kGroup = 8;
+  for (; i < n; i += kGroup) {
+    const size_t group = std::min(kGroup, n - i);
+    size_t hashes[kGroup];
+    for (size_t j = 0; j < group; ++j) {
+      hashes[j] = get_hasher_ref()(keys[i + j]);
+      prefetch(hashes[j]);
+    }
+    for (size_t j = 0; j < group; ++j) {
+      found[i + j] = find(keys[i + j], hashes[j]) != end();
+    }
   }
-  return end();
 }
 
+#if YOBIDUCK_HAVE_AVX512
 template <class Traits>
-template <class K>
-bool HashTable<Traits>::contains(const key_arg<K> &value) const {
-  return find(value) != end();
+void HashTable<Traits>::ContainsManyAvx512(const key_type *keys, size_t n,
+                                           bool *found) const {
+  using BucketMetaByte = typename Bucket<Traits>::MetaByte;
+  const char *base = reinterpret_cast<const char *>(buckets_.begin());
+  const __m512i multiplier = _mm512_set1_epi64(hasher::kMultiplier);
+  const __m512i logical_size = _mm512_set1_epi64(buckets_.logical_size());
+  const __m512i bucket_size = _mm512_set1_epi64(sizeof(Bucket<Traits>));
+  const __m512i slots_offset = _mm512_set1_epi64(
+      reinterpret_cast<const char *>(&buckets_.begin()->slots[0]) - base);
+  const __m512i h2_mask = _mm512_set1_epi64(BucketMetaByte::kMaxH2);
+  const __m512i full_bit = _mm512_set1_epi64(BucketMetaByte::kFullBit);
+  const __m512i clear_ordered =
+      _mm512_set1_epi8(BucketMetaByte::kInvertOrderedMask);
+  // Shuffle indices that copy byte 0 of each 64-bit lane to the lane's
+  // other bytes.
+  constexpr long long kByte8 = 0x0808080808080808ll;
+  const __m512i broadcast_low_byte =
+      _mm512_set_epi64(kByte8, 0, kByte8, 0, kByte8, 0, kByte8, 0);
+  const __m512i one_per_byte = _mm512_set1_epi8(1);
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i one = _mm512_set1_epi64(1);
+  // A bucket's meta bytes are read as two 64-bit words.  Bytes 0-5 of
+  // the second word are slots 8-13, byte 6 is the search distance.
+  static_assert(Traits::kSlotsPerBucket == 14);
+  constexpr __mmask64 kHighSlotBytes = 0x3F3F3F3F3F3F3F3Full;
+  // Returns the slot number of the lowest nonzero byte of each lane
+  // (each byte of `bits` is 0 or 1).
+  auto lowest_slot = [&](__m512i bits) {
+    __m512i lowest = _mm512_and_si512(bits, _mm512_sub_epi64(zero, bits));
+    return _mm512_srli_epi64(
+        _mm512_sub_epi64(_mm512_set1_epi64(63), _mm512_lzcnt_epi64(lowest)),
+        3);
+  };
+  // The lanes that the vector code can't resolve are finished with
+  // `find` after each chunk of keys, so that the vector loop has no
+  // data-dependent branches and the gathers of successive iterations
+  // overlap.
+  constexpr size_t kChunk = 256;
+  uint32_t unresolved[kChunk];
+  const __m512i lane_index =
+      _mm512_set_epi32(0, 0, 0, 0, 0, 0, 0, 0, 7, 6, 5, 4, 3, 2, 1, 0);
+  const size_t vector_end = n - n % 8;
+  for (size_t chunk = 0; chunk < vector_end; chunk += kChunk) {
+    const size_t chunk_end = std::min(chunk + kChunk, vector_end);
+    size_t unresolved_count = 0;
+    for (size_t i = chunk; i < chunk_end; i += 8) {
+      const __m512i key = _mm512_loadu_si512(keys + i);
+      const __m512i hash = _mm512_mullo_epi64(key, multiplier);
+      // H1 is the high 64 bits of `hash * logical_size`, where
+      // `logical_size < 2^32`.
+      const __m512i high =
+          _mm512_mul_epu32(_mm512_srli_epi64(hash, 32), logical_size);
+      const __m512i low = _mm512_mul_epu32(hash, logical_size);
+      const __m512i h1 = _mm512_srli_epi64(
+          _mm512_add_epi64(high, _mm512_srli_epi64(low, 32)), 32);
+      const __m512i offset = _mm512_mullo_epi64(h1, bucket_size);
+      const __m512i needle = _mm512_shuffle_epi8(
+          _mm512_or_si512(_mm512_and_si512(hash, h2_mask), full_bit),
+          broadcast_low_byte);
+      const __m512i meta_low = _mm512_i64gather_epi64(offset, base, 1);
+      const __m512i meta_high = _mm512_i64gather_epi64(offset, base + 8, 1);
+      const __mmask64 match_low = _mm512_cmpeq_epi8_mask(
+          _mm512_and_si512(meta_low, clear_ordered), needle);
+      const __mmask64 match_high = _mm512_mask_cmpeq_epi8_mask(
+          kHighSlotBytes, _mm512_and_si512(meta_high, clear_ordered), needle);
+      const __m512i bits_low = _mm512_maskz_mov_epi8(match_low, one_per_byte);
+      const __m512i bits_high =
+          _mm512_maskz_mov_epi8(match_high, one_per_byte);
+      const __mmask8 has_low = _mm512_test_epi64_mask(bits_low, bits_low);
+      const __mmask8 has_high = _mm512_test_epi64_mask(bits_high, bits_high);
+      // Compare the key with the first candidate.
+      const __mmask8 candidate = has_low | has_high;
+      const __m512i slot = _mm512_mask_blend_epi64(
+          has_low,
+          _mm512_add_epi64(lowest_slot(bits_high), _mm512_set1_epi64(8)),
+          lowest_slot(bits_low));
+      const __m512i slot_offset =
+          _mm512_add_epi64(_mm512_add_epi64(offset, slots_offset),
+                           _mm512_slli_epi64(slot, 3));
+      const __m512i candidate_key =
+          _mm512_mask_i64gather_epi64(zero, candidate, slot_offset, base, 1);
+      const __mmask8 equal =
+          _mm512_mask_cmpeq_epu64_mask(candidate, candidate_key, key);
+      // Otherwise the key is absent if there are no other candidates
+      // (clearing the lowest bit of each lane leaves the others) and no
+      // other buckets to search.  Searching a second bucket in vector
+      // registers too was slower: it costs every lane two more gathers.
+      const __m512i rest = _mm512_or_si512(
+          _mm512_and_si512(bits_low, _mm512_sub_epi64(bits_low, one)),
+          _mm512_and_si512(bits_high, _mm512_sub_epi64(bits_high, one)));
+      const __mmask8 more_candidates =
+          _mm512_test_epi64_mask(rest, rest) | (has_low & has_high);
+      const __m512i search_distance = _mm512_and_si512(
+          _mm512_srli_epi64(meta_high, 48), _mm512_set1_epi64(0xFF));
+      const __mmask8 absent =
+          _mm512_cmple_epu64_mask(search_distance, one) & ~more_candidates;
+      _mm_storel_epi64(
+          reinterpret_cast<__m128i *>(found + i),
+          _mm512_cvtepi64_epi8(_mm512_maskz_mov_epi64(equal, one)));
+      const __mmask16 lanes = ~(equal | absent) & 0xFF;
+      _mm512_mask_compressstoreu_epi32(
+          unresolved + unresolved_count, lanes,
+          _mm512_add_epi32(lane_index, _mm512_set1_epi32(i - chunk)));
+      unresolved_count += __builtin_popcount(lanes);
+    }
+    for (size_t u = 0; u < unresolved_count; ++u) {
+      const key_type &key = keys[chunk + unresolved[u]];
+      found[chunk + unresolved[u]] = find(key, get_hasher_ref()(key)) != end();
+    }
+  }
 }
+#endif
 
 template <class Traits> std::string HashTable<Traits>::ToString() const {
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      std::stringstream result;
+      result << "{size=" << size_ << " inline:";
+      for (size_t j = 0; j < Traits::kInlineCapacity; ++j) {
+        result << " [" << j << "]=";
+        if (inline_storage().bucket().h2[j].IsEmpty()) {
+          result << "_";
+        } else {
+          result << inline_storage().bucket().slots[j].GetValue();
+        }
+      }
+      result << "}";
+      return result.str();
+    }
+  }
   return ToStringInternal(buckets_.physical_size() - 1);
 }
 
@@ -1134,7 +3447,7 @@ template <class Traits> std::string HashTable<Traits>::ToStringInternal(size_t m
       if (bucket->h2[j].IsEmpty()) {
         result << "_";
       } else {
-        size_t hash = get_hasher_ref()(Traits::KeyOf(bucket->slots[j].GetValue()));
+        size_t hash = SeededHashOf(Traits::KeyOf(bucket->slots[j].GetValue()));
         result << "h<" << buckets_.H1(hash) << ","
                << size_t{bucket->h2[j].h2()} << "," << std::hex << std::setw(16) << hash << std::dec << ">";
         if (!bucket->h2[j].IsOrdered()) {
@@ -1155,8 +3468,27 @@ template <class Traits> std::string HashTable<Traits>::ToStringInternal(size_t m
 
 template <class Traits>
 void HashTable<Traits>::Validate(int line_number) const {
-  CHECK_LE(size(), LogicalSlotCount() * Traits::full_utilization_numerator /
-                       Traits::full_utilization_denominator);
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (IsInline()) {
+      const Bucket<Traits> &bucket = inline_storage().bucket();
+      CHECK_EQ(bucket.search_distance, Traits::kSearchDistanceEndSentinal);
+      size_t actual_size = 0;
+      for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
+        if (!bucket.h2[j].IsEmpty()) {
+          CHECK_LT(j, Traits::kInlineCapacity) << "line=" << line_number;
+          size_t hash = SeededHashOf(Traits::KeyOf(bucket.slots[j].GetValue()));
+          CHECK_EQ(bucket.h2[j].h2(), buckets_.H2(hash));
+          ++actual_size;
+        }
+      }
+      CHECK_EQ(actual_size, size());
+      return;
+    }
+  }
+  // The budget's advice may have changed since the last rehash.
+  const Utilization full =
+      Traits::kMemoryBudget ? kDenseFullUtilization : FullUtilization();
+  CHECK_LE(size(), LogicalSlotCount() * full.numerator / full.denominator);
   for (size_t i = 0; i < buckets_.logical_size(); ++i) {
     // Verify that the search distances don't go off the end of the bucket
     // array.
@@ -1184,7 +3516,7 @@ void HashTable<Traits>::Validate(int line_number) const {
       if (!buckets_[i].h2[j].IsEmpty()) {
         assert(buckets_[i].h2[j].h2() <= MetaByte::kMaxH2);
         ++actual_size;
-        size_t hash = get_hasher_ref()(Traits::KeyOf(buckets_[i].slots[j].GetValue()));
+        size_t hash = SeededHashOf(Traits::KeyOf(buckets_[i].slots[j].GetValue()));
         size_t h1 = buckets_.H1(hash);
         CHECK_LE(h1, i);
         CHECK_LT(h1, buckets_.logical_size());
@@ -1196,12 +3528,19 @@ void HashTable<Traits>::Validate(int line_number) const {
     }
   }
   CHECK_EQ(actual_size, size());
+  if constexpr (Traits::kOnlineProbeStatistics) {
+    const ProbeSums<Traits> sums = ComputeProbeSums();
+    CHECK_EQ(probe_sums().successful(), sums.successful())
+        << "line=" << line_number;
+    CHECK_EQ(probe_sums().search_distance(), sums.search_distance())
+        << "line=" << line_number;
+  }
   // Verify that the ordered elements are sorted.
   std::optional<size_t> previous_hash = std::nullopt;
   for (const Bucket<Traits> &bucket : buckets_) {
     for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
       if (bucket.h2[j].IsNonemptyAndOrdered()) {
-        size_t hash = get_hasher_ref()(Traits::KeyOf(bucket.slots[j].GetValue()));
+        size_t hash = SeededHashOf(Traits::KeyOf(bucket.slots[j].GetValue()));
         if (previous_hash.has_value()) {
           CHECK_LE(*previous_hash, hash);
         }
@@ -1270,60 +3609,180 @@ static constexpr bool BucketGetsTombstone(size_t bucket_number) {
 
 template <class Traits>
 void HashTable<Traits>::CopyFrom(const Buckets<Traits> &buckets) {
+  if (buckets_.empty()) {
+    // Copying an empty table, so `reserve` didn't allocate anything.
+    assert(size_ == 0);
+    return;
+  }
   RehashOrCopyFrom</*is_rehash=*/false>(buckets);
 }
 
-template<class Traits>
-template<bool destroy_source>
-void HashTable<Traits>::GetDisorderedValues(std::conditional_t<destroy_source, Buckets<Traits>, const Buckets<Traits>> &buckets,
-                                            size_t bucket_number,
-                                            size_t &disordered_bucket,
-                                            std::vector<DisorderedItem<destroy_source>> &heap) {
-  assert(bucket_number < buckets.logical_size());
-  size_t search_distance = buckets[bucket_number].search_distance;
-  for (size_t offset = 0; offset < search_distance ; ++offset) {
-    if (disordered_bucket <= bucket_number + offset) {
-      disordered_bucket = bucket_number + offset;
-      auto &bucket = buckets[disordered_bucket];
-      for (size_t slot_number = 0; slot_number < Traits::kSlotsPerBucket; ++ slot_number) {
-        auto &meta_byte = bucket.h2[slot_number];
-        if (meta_byte.IsNonemptyAndDisordered()) {
-          auto &slot = bucket.slots[slot_number];
-          heap.push_back(DisorderedItem<destroy_source>{
-              .hash = get_hasher_ref()(Traits::KeyOf(slot.GetValue())),
-              .slot = &slot});
-          std::push_heap(heap.begin(), heap.end());
-          if constexpr (destroy_source) {
-            meta_byte.SetEmpty();
+template <class Traits>
+template <bool is_mutable>
+class HashTable<Traits>::OrderedReader {
+  using BucketsType =
+      std::conditional_t<is_mutable, Buckets<Traits>, const Buckets<Traits>>;
+  using SlotType = std::conditional_t<is_mutable, typename Traits::Slot,
+                                      const typename Traits::Slot>;
+  using MetaByteType =
+      std::conditional_t<is_mutable, typename Bucket<Traits>::MetaByte,
+                         const typename Bucket<Traits>::MetaByte>;
+
+public:
+  // Reads `buckets`, which `table` hashes into.
+  OrderedReader(const HashTable &table, BucketsType &buckets)
+      : table_(table), source_(buckets) {
+    Advance();
+  }
+
+  bool done() const { return !from_heap_ && !have_ordered_; }
+
+  // The hash, slot, and meta byte of the current value.  Requires:
+  // `!done()`.
+  size_t hash() const { return from_heap_ ? heap_.front().hash : ordered_hash_; }
+  SlotType &slot() const {
+    return from_heap_ ? *heap_.front().slot
+                      : source_[bucket_number_].slots[slot_number_];
+  }
+  MetaByteType &meta_byte() const {
+    return from_heap_ ? *heap_.front().meta_byte
+                      : source_[bucket_number_].h2[slot_number_];
+  }
+
+  void Next() {
+    if (from_heap_) {
+      std::pop_heap(heap_.begin(), heap_.end());
+      heap_.pop_back();
+    } else {
+      have_ordered_ = false;
+      ++slot_number_;
+    }
+    Advance();
+  }
+
+private:
+  // A reference to a disordered value, suitable to put into a heap.
+  struct DisorderedItem {
+    size_t hash;
+    SlotType *slot;
+    MetaByteType *meta_byte;
+    friend bool operator<(const DisorderedItem &a, const DisorderedItem &b) {
+      // We want a min-heap ordered by hash, so define 'operator<' to be '>'.
+      return a.hash > b.hash;
+    }
+  };
+
+  // Finds the next ordered value (if any), and decides whether the
+  // current value is that one or the top of the heap.
+  void Advance() {
+    while (!have_ordered_ && bucket_number_ < source_.physical_size()) {
+      if (slot_number_ == 0 && bucket_number_ < source_.logical_size()) {
+        // Don't need to get the disordered values after the logical
+        // size, since we'll pick them all up starting from a logical
+        // bucket.
+        GetDisorderedValues();
+      }
+      // TODO: In the case where there are a *lot* of disordered slots
+      // (which can happen due to a reserve occuring), we want to
+      // avoid filling up the heap.
+      auto &bucket = source_[bucket_number_];
+      for (; slot_number_ < Traits::kSlotsPerBucket; ++slot_number_) {
+        if (bucket.h2[slot_number_].IsNonemptyAndOrdered()) {
+          have_ordered_ = true;
+          ordered_hash_ = table_.SeededHashOf(
+              Traits::KeyOf(bucket.slots[slot_number_].GetValue()));
+          break;
+        }
+      }
+      if (!have_ordered_) {
+        ++bucket_number_;
+        slot_number_ = 0;
+      }
+    }
+    from_heap_ = !heap_.empty() &&
+                 (!have_ordered_ || heap_.front().hash < ordered_hash_);
+  }
+
+  // Scan forward from bucket number `disordered_bucket_` (increasing
+  // `disordered_bucket_`) as far as the search distance for
+  // `source_[bucket_number_]` says to search.  `disordered_bucket_`
+  // is the first bucket that hasn't been scanned yet, so no bucket is
+  // scanned twice.  Put each discovered disordered value into the
+  // heap.
+  void GetDisorderedValues() {
+    size_t search_distance = source_[bucket_number_].search_distance;
+    for (size_t offset = 0; offset < search_distance; ++offset) {
+      if (disordered_bucket_ <= bucket_number_ + offset) {
+        auto &bucket = source_[bucket_number_ + offset];
+        disordered_bucket_ = bucket_number_ + offset + 1;
+        for (size_t slot_number = 0; slot_number < Traits::kSlotsPerBucket;
+             ++slot_number) {
+          auto &meta_byte = bucket.h2[slot_number];
+          if (meta_byte.IsNonemptyAndDisordered()) {
+            auto &slot = bucket.slots[slot_number];
+            heap_.push_back(DisorderedItem{
+                .hash = table_.SeededHashOf(Traits::KeyOf(slot.GetValue())),
+                .slot = &slot,
+                .meta_byte = &meta_byte});
+            std::push_heap(heap_.begin(), heap_.end());
           }
         }
       }
     }
   }
+
+  const HashTable &table_;
+  BucketsType &source_;
+  std::vector<DisorderedItem> heap_;
+  size_t disordered_bucket_ = 0;
+  // The position of the next ordered value.
+  size_t bucket_number_ = 0;
+  size_t slot_number_ = 0;
+  // True if there is an ordered value at `bucket_number_,
+  // slot_number_`, whose hash is `ordered_hash_`.
+  bool have_ordered_ = false;
+  size_t ordered_hash_ = 0;
+  // True if the current value is the top of the heap.
+  bool from_heap_ = false;
+};
+
+template <class Traits>
+template <bool insert_tombstones>
+void HashTable<Traits>::NextInsertBucket(size_t &insert_bucket,
+                                         size_t &insert_slot) {
+  ++insert_bucket;
+  insert_slot = 0;
+  if constexpr (insert_tombstones && Traits::kTombstoneRatio.has_value()) {
+    if (BucketGetsTombstone<Traits>(insert_bucket)) {
+      ++insert_slot;
+    }
+  }
 }
 
 template <class Traits>
-template <bool insert_tombstones, class GetValueAndStore>
+template <bool insert_tombstones, bool concurrent, class GetValueAndStore>
 void HashTable<Traits>::InsertAscending(size_t &insert_bucket, size_t &insert_slot,
                                         GetValueAndStore get_value_and_store, size_t hash) {
   assert(insert_bucket < buckets_.physical_size());
   assert(insert_slot < Traits::kSlotsPerBucket);
   size_t h1 = buckets_.H1(hash);
   auto next_bucket = [&]() {
-    ++insert_bucket;
-    insert_slot = 0;
-    buckets_[insert_bucket].Init();
-    if constexpr (insert_tombstones && Traits::kTombstoneRatio.has_value()) {
-      if (BucketGetsTombstone<Traits>(insert_bucket)) {
-        ++insert_slot;
-      }
+    NextInsertBucket<insert_tombstones>(insert_bucket, insert_slot);
+    if constexpr (!concurrent) {
+      InitForInsertAscending(buckets_[insert_bucket]);
     }
   };
   while (insert_bucket < h1) {
     next_bucket();
   }
   Bucket<Traits> &bucket = buckets_[insert_bucket];
+  const uint8_t old_search_distance = buckets_[h1].search_distance;
   maxf(buckets_[h1].search_distance, insert_bucket - h1 + 1);
+  if constexpr (!concurrent) {
+    probe_sums().AddSearchDistance(buckets_[h1].search_distance -
+                                   old_search_distance);
+    probe_sums().AddValue(insert_bucket - h1 + 1);
+  }
   assert(bucket.h2[insert_slot].IsEmpty());
   bucket.h2[insert_slot].SetOrderedValue(buckets_.H2(hash));
   get_value_and_store(bucket.slots[insert_slot]);
@@ -1336,8 +3795,10 @@ void HashTable<Traits>::InsertAscending(size_t &insert_bucket, size_t &insert_sl
 template <class Traits>
 void HashTable<Traits>::FinishInsertAscending(size_t insert_bucket) {
   ++insert_bucket;
-  for (; insert_bucket < buckets_.physical_size(); ++insert_bucket) {
-    buckets_[insert_bucket].Init();
+  if constexpr (!Traits::kZeroIsEmpty) {
+    for (; insert_bucket < buckets_.physical_size(); ++insert_bucket) {
+      buckets_[insert_bucket].Init();
+    }
   }
   buckets_[buckets_.physical_size() - 1].search_distance = Traits::kSearchDistanceEndSentinal;
 }
@@ -1345,91 +3806,453 @@ void HashTable<Traits>::FinishInsertAscending(size_t insert_bucket) {
 // DONT FORGET TO MADVISE
 
 template <class Traits>
-template <bool is_rehash>
-void HashTable<Traits>::RehashOrCopyFrom(std::conditional_t<is_rehash, Buckets<Traits>, const Buckets<Traits>> &buckets) {
-  std::vector<DisorderedItem<is_rehash>> heap;
-  size_t disordered_bucket = 0;
+template <bool is_rehash, bool insert_tombstones>
+void HashTable<Traits>::RehashOrCopyFrom(
+    std::conditional_t<is_rehash, Buckets<Traits>, const Buckets<Traits>>
+        &buckets,
+    std::atomic<size_t> *copied) {
+  OrderedReader<is_rehash> reader(*this, buckets);
   size_t insert_bucket = 0;
   size_t insert_slot = 0;
-  buckets_[0].Init();
+  BeginInsertAscending();
   size_ = 0;
-  auto insert_and_copy_or_move_and_destroy = [&](auto &slot, size_t hash) {
+  for (; !reader.done(); reader.Next()) {
     ++size_;
+    auto &slot = reader.slot();
     if constexpr (is_rehash) {
       auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
         dest_slot.Transfer(slot);
       };
-      InsertAscending<is_rehash>(insert_bucket, insert_slot, get_value_and_store, hash);
+      InsertAscending<is_rehash>(insert_bucket, insert_slot, get_value_and_store, reader.hash());
+      reader.meta_byte().SetEmpty();
     } else {
       // TODO: Use a hypothetical dest_slot.Copy(slot) to reduce the
       // number of moves in copying.
       auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
         dest_slot.Store(slot.GetValue());
       };
-      InsertAscending<is_rehash>(insert_bucket, insert_slot, get_value_and_store, hash);
+      InsertAscending<insert_tombstones>(insert_bucket, insert_slot, get_value_and_store, reader.hash());
+      if (copied != nullptr && size_ % 4096 == 0) {
+        copied->store(size_, std::memory_order_relaxed);
+      }
+    }
+  }
+  FinishInsertAscending(insert_bucket);
+}
+
+template <class Traits>
+void HashTable<Traits>::AssignRehashedCopy(const HashTable &other,
+                                           size_t count,
+                                           std::atomic<size_t> *copied) {
+  clear();
+  watchdog().set_seed(other.watchdog().seed());
+  rehash(RehashedSlotCount(std::max(count, other.size_)));
+  if (IsInline() || other.IsInline() || !CanStreamWith(other)) {
+    for (const value_type &value : other) {
+      insert(value);
+    }
+  } else if (!other.empty()) {
+    size_ = other.size_;
+    RehashOrCopyFrom</*is_rehash=*/false, /*insert_tombstones=*/true>(
+        other.buckets_, copied);
+  }
+  UpdateObservers();
+  if (copied != nullptr) {
+    copied->store(size_, std::memory_order_relaxed);
+  }
+}
+
+template <class Traits>
+void HashTable<Traits>::SortByHash(std::pair<size_t, size_t> *first,
+                                   std::pair<size_t, size_t> *last,
+                                   std::pair<size_t, size_t> *scratch,
+                                   int known_bits) {
+  // Parts this small are sorted by comparison.
+  constexpr size_t kSmallPart = 32;
+  const size_t n = last - first;
+  int bits = 0;
+  while (bits < 16 && known_bits + bits < 64 && (n >> bits) > kSmallPart) {
+    ++bits;
+  }
+  if (bits == 0) {
+    std::sort(first, last);
+    return;
+  }
+  const int shift = 64 - known_bits - bits;
+  const size_t mask = (size_t{1} << bits) - 1;
+  std::vector<size_t> part_begin((size_t{1} << bits) + 1);
+  for (const std::pair<size_t, size_t> *p = first; p != last; ++p) {
+    ++part_begin[((p->first >> shift) & mask) + 1];
+  }
+  for (size_t k = 1; k < part_begin.size(); ++k) {
+    part_begin[k] += part_begin[k - 1];
+  }
+  std::vector<size_t> next(part_begin.begin(), part_begin.end() - 1);
+  for (const std::pair<size_t, size_t> *p = first; p != last; ++p) {
+    scratch[next[(p->first >> shift) & mask]++] = *p;
+  }
+  // Sort each part in `scratch`, using the same part of `[first,
+  // last)` as its scratch.
+  for (size_t k = 0; k + 1 < part_begin.size(); ++k) {
+    std::pair<size_t, size_t> *part = scratch + part_begin[k];
+    const size_t part_size = part_begin[k + 1] - part_begin[k];
+    if (part_size <= kSmallPart) {
+      std::sort(part, part + part_size);
+    } else {
+      SortByHash(part, part + part_size, first + part_begin[k],
+                 known_bits + bits);
+    }
+  }
+  std::copy(scratch, scratch + n, first);
+}
+
+template <class Traits>
+std::pair<size_t, size_t> *
+HashTable<Traits>::UniqueByKey(absl::Span<const value_type> values,
+                               std::pair<size_t, size_t> *first,
+                               std::pair<size_t, size_t> *last) const {
+  std::pair<size_t, size_t> *const begin = first;
+  std::pair<size_t, size_t> *out = first;
+  for (; first != last; ++first) {
+    const key_type &key = Traits::KeyOf(values[first->second]);
+    // Equal keys have equal hashes, so only the kept run of equal
+    // hashes (almost always empty) needs comparing.
+    bool duplicate = false;
+    for (std::pair<size_t, size_t> *kept = out;
+         kept != begin && kept[-1].first == first->first && !duplicate;
+         --kept) {
+      duplicate = get_key_eq_ref()(Traits::KeyOf(values[kept[-1].second]),
+                                   key);
+    }
+    if (!duplicate) {
+      *out++ = *first;
+    }
+  }
+  return out;
+}
+
+template <class Traits>
+void HashTable<Traits>::AssignBulk(absl::Span<const value_type> values) {
+  clear();
+  if constexpr (Traits::kInlineCapacity > 0) {
+    for (const value_type &value : values) {
+      insert(value);
+    }
+    return;
+  }
+  std::vector<std::pair<size_t, size_t>> order(values.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    order[i] = {SeededHashOf(Traits::KeyOf(values[i])), i};
+  }
+  SortByHash(order.data(), order.data() + order.size(), /*known_bits=*/0);
+  order.resize(UniqueByKey(values, order.data(), order.data() + order.size()) -
+               order.data());
+  if (order.empty()) {
+    return;
+  }
+  AllocateForBulk(order.size());
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  for (size_t i = 0; i < order.size(); ++i) {
+    if (!FitsAscending(insert_bucket, buckets_.H1(order[i].first))) {
+      size_ = i;
+      FinishInsertAscending(insert_bucket);
+      AssignByInserting(values);
+      return;
+    }
+    // The values are read in hash order, that is, at random.
+    if (i + kBulkPrefetchDistance < order.size()) {
+      __builtin_prefetch(&values[order[i + kBulkPrefetchDistance].second]);
     }
+    auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
+      dest_slot.Store(values[order[i].second]);
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                get_value_and_store,
+                                                order[i].first);
+  }
+  FinishInsertAscending(insert_bucket);
+  size_ = order.size();
+  UpdateObservers();
+}
+
+template <class Traits>
+void HashTable<Traits>::AssignBulkParallel(absl::Span<const value_type> values,
+                                           size_t threads) {
+  if (Traits::kInlineCapacity > 0 || threads <= 1 ||
+      values.size() < threads * 1024) {
+    AssignBulk(values);
+    return;
+  }
+  clear();
+  const size_t n = values.size();
+  // Several partitions per thread, to balance the load.
+  int partition_bits = 0;
+  while ((size_t{1} << partition_bits) < 8 * threads) {
+    ++partition_bits;
+  }
+  const size_t partitions = size_t{1} << partition_bits;
+  auto partition_of = [partition_bits](size_t hash) {
+    return hash >> (64 - partition_bits);
   };
-  auto insert_from_heap = [&]() {
-    insert_and_copy_or_move_and_destroy(*heap.front().slot, heap.front().hash);
-    std::pop_heap(heap.begin(), heap.end());
-    heap.pop_back();
+  auto share = [n, threads](size_t t) {
+    return std::pair(n * t / threads, n * (t + 1) / threads);
   };
-  for (size_t bucket_number = 0; bucket_number < buckets.physical_size(); ++bucket_number) {
-    if (bucket_number < buckets.logical_size()) {
-      // Don't need to get the disordered values after the logical
-      // size, since we'll pick them all up starting from a logical
-      // bucket.
-      GetDisorderedValues<is_rehash>(buckets, bucket_number, disordered_bucket, heap);
-    }
-    // TODO: In the case where there are a *lot* of disordered slots (which
-    // can happen due to a reserve occuring), we want to avoid filling
-    // up the heap.
-    if (0) {
-      // This almost works.  The problem is that the item in the front
-      // of the heap can go before bucket_number but that there are
-      // still small items in bucket_number.
-      while (!heap.empty() && buckets.H1(heap.front().hash) < bucket_number) {
-        // We have something in the heap that goes ahead of everything in the current bucket.
-        insert_from_heap();
-      }
-    }
-    auto &bucket = buckets[bucket_number];
-    for (size_t slot_number = 0; slot_number < Traits::kSlotsPerBucket; ++ slot_number) {
-      MetaByte meta_byte = bucket.h2[slot_number];
-      if (meta_byte.IsNonemptyAndOrdered()) {
-        const value_type &value = bucket.slots[slot_number].GetValue();
-        const key_type &key = Traits::KeyOf(value);
-        const size_t hash = get_hasher_ref()(key);
-        while (!heap.empty() && heap.front().hash < hash) {
-          insert_from_heap();
+  // Each thread hashes a share of the values and counts them by
+  // partition, and then (once the counts are turned into offsets)
+  // scatters them into the partitions.
+  std::vector<size_t> hashes(n);
+  std::vector<size_t> offsets(threads * partitions);
+  RunOnThreads(threads, [&](size_t t) {
+    auto [begin, end] = share(t);
+    size_t *counts = &offsets[t * partitions];
+    for (size_t i = begin; i < end; ++i) {
+      hashes[i] = SeededHashOf(Traits::KeyOf(values[i]));
+      ++counts[partition_of(hashes[i])];
+    }
+  });
+  std::vector<size_t> partition_begin(partitions + 1);
+  size_t offset = 0;
+  for (size_t p = 0; p < partitions; ++p) {
+    partition_begin[p] = offset;
+    for (size_t t = 0; t < threads; ++t) {
+      offset += std::exchange(offsets[t * partitions + p], offset);
+    }
+  }
+  partition_begin[partitions] = n;
+  std::vector<std::pair<size_t, size_t>> order(n);
+  RunOnThreads(threads, [&](size_t t) {
+    auto [begin, end] = share(t);
+    size_t *next = &offsets[t * partitions];
+    for (size_t i = begin; i < end; ++i) {
+      order[next[partition_of(hashes[i])]++] = {hashes[i], i};
+    }
+  });
+  hashes = {};
+  // Equal keys have equal hashes, so they're in the same partition.
+  std::vector<size_t> partition_end(partitions);
+  std::atomic<size_t> next_partition{0};
+  RunOnThreads(threads, [&](size_t) {
+    for (size_t p; (p = next_partition.fetch_add(1)) < partitions;) {
+      std::pair<size_t, size_t> *first = order.data() + partition_begin[p];
+      std::pair<size_t, size_t> *last = order.data() + partition_begin[p + 1];
+      SortByHash(first, last, partition_bits);
+      partition_end[p] = UniqueByKey(values, first, last) - order.data();
+    }
+  });
+  // Pack the partitions together.
+  std::vector<size_t> packed_begin(partitions + 1);
+  for (size_t p = 0; p < partitions; ++p) {
+    packed_begin[p + 1] =
+        packed_begin[p] + partition_end[p] - partition_begin[p];
+  }
+  const size_t count = packed_begin[partitions];
+  if (count == 0) {
+    return;
+  }
+  std::vector<std::pair<size_t, size_t>> sorted(count);
+  next_partition = 0;
+  RunOnThreads(threads, [&](size_t) {
+    for (size_t p; (p = next_partition.fetch_add(1)) < partitions;) {
+      std::copy(order.begin() + partition_begin[p],
+                order.begin() + partition_end[p],
+                sorted.begin() + packed_begin[p]);
+    }
+  });
+  order = {};
+  AllocateForBulk(count);
+  if constexpr (!Traits::kZeroIsEmpty) {
+    const size_t physical = buckets_.physical_size();
+    RunOnThreads(threads, [&](size_t t) {
+      for (size_t b = physical * t / threads; b < physical * (t + 1) / threads;
+           ++b) {
+        buckets_[b].Init();
+      }
+    });
+  }
+  // Split the sorted values into ranges that start where the preferred
+  // bucket changes, so that no two threads write the same search
+  // distance.
+  const size_t ranges = partitions;
+  auto h1_of = [&](size_t i) { return buckets_.H1(sorted[i].first); };
+  std::vector<size_t> range_begin(ranges + 1);
+  range_begin[ranges] = count;
+  for (size_t r = 1; r < ranges; ++r) {
+    size_t i = std::max(count * r / ranges, range_begin[r - 1]);
+    while (i > 0 && i < count && h1_of(i) == h1_of(i - 1)) {
+      ++i;
+    }
+    range_begin[r] = i;
+  }
+  // The insert position (bucket and slot) after each range, if no
+  // values spill into it from the range before.
+  using Position = std::pair<size_t, size_t>;
+  std::vector<Position> unspilled_end(ranges);
+  std::atomic<size_t> next_range{0};
+  RunOnThreads(threads, [&](size_t) {
+    for (size_t r; (r = next_range.fetch_add(1)) < ranges;) {
+      Position position{0, 0};
+      if (range_begin[r] > 0 && range_begin[r] < range_begin[r + 1]) {
+        position = {h1_of(range_begin[r]) - 1, 0};
+        NextInsertBucket<true>(position.first, position.second);
+      }
+      for (size_t i = range_begin[r]; i < range_begin[r + 1]; ++i) {
+        SkipAscending(position.first, position.second, h1_of(i));
+      }
+      unspilled_end[r] = position;
+    }
+  });
+  // Where each range really starts.  A range that spills forward
+  // changes the next range's positions only until a value whose
+  // preferred bucket is past the spill, after which they're the
+  // unspilled ones.
+  std::vector<Position> start(ranges);
+  Position position{0, 0};
+  for (size_t r = 0; r < ranges; ++r) {
+    start[r] = position;
+    for (size_t i = range_begin[r]; i < range_begin[r + 1]; ++i) {
+      const size_t h1 = h1_of(i);
+      if (position.first < h1) {
+        position = unspilled_end[r];
+        break;
+      }
+      SkipAscending(position.first, position.second, h1);
+    }
+  }
+  next_range = 0;
+  std::atomic<bool> overflowed{false};
+  RunOnThreads(threads, [&](size_t) {
+    for (size_t r; (r = next_range.fetch_add(1)) < ranges;) {
+      auto [insert_bucket, insert_slot] = start[r];
+      for (size_t i = range_begin[r]; i < range_begin[r + 1]; ++i) {
+        if (!FitsAscending(insert_bucket, h1_of(i))) {
+          overflowed.store(true, std::memory_order_relaxed);
+          break;
         }
-        insert_and_copy_or_move_and_destroy(bucket.slots[slot_number], hash);
-        if constexpr (is_rehash) {
-          bucket.h2[slot_number].SetEmpty();
+        if (i + kBulkPrefetchDistance < count) {
+          __builtin_prefetch(&values[sorted[i + kBulkPrefetchDistance].second]);
         }
+        auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
+          dest_slot.Store(values[sorted[i].second]);
+        };
+        InsertAscending</*insert_tombstones=*/true, /*concurrent=*/true>(
+            insert_bucket, insert_slot, get_value_and_store, sorted[i].first);
       }
     }
+  });
+  if (overflowed.load(std::memory_order_relaxed)) {
+    // Every bucket was initialized, so the stored values can be found.
+    AssignByInserting(values);
+    return;
   }
-  while (!heap.empty()) {
-    insert_from_heap();
+  buckets_[buckets_.physical_size() - 1].search_distance =
+      Traits::kSearchDistanceEndSentinal;
+  size_ = count;
+  if constexpr (Traits::kOnlineProbeStatistics) {
+    probe_sums() = ComputeProbeSums();
   }
-  FinishInsertAscending(insert_bucket);
+  UpdateObservers();
+}
+
+template <class Traits>
+void HashTable<Traits>::SplitFrom(HashTable &source, HashTable &upper) {
+  assert(empty() && upper.empty());
+  auto goes_up = [&source](const value_type &value) {
+    return (source.get_hasher_ref()(Traits::KeyOf(value)) >> 63) != 0;
+  };
+  if (Traits::kInlineCapacity > 0 || source.watchdog().seed() != 0) {
+    // The values aren't in hash order (or can't be read that way), so
+    // just insert them.
+    for (const value_type &value : source) {
+      (goes_up(value) ? upper : *this).insert(value);
+    }
+    source.clear();
+    return;
+  }
+  size_t upper_count = 0;
+  source.for_each(
+      [&](const value_type &value) { upper_count += goes_up(value); });
+  const size_t lower_count = source.size_ - upper_count;
+  HashTable *const halves[2] = {this, &upper};
+  size_t insert_bucket[2] = {0, 0};
+  size_t insert_slot[2] = {0, 0};
+  for (int half = 0; half < 2; ++half) {
+    const size_t count = half == 0 ? lower_count : upper_count;
+    if (count > 0) {
+      halves[half]->AllocateForBulk(count);
+      halves[half]->BeginInsertAscending();
+      halves[half]->size_ = count;
+    }
+  }
+  OrderedReader</*is_mutable=*/true> reader(source, source.buckets_);
+  for (; !reader.done(); reader.Next()) {
+    auto &slot = reader.slot();
+    const int half = reader.hash() >> 63;
+    HashTable &target = *halves[half];
+    auto get_value_and_store = [&](typename Traits::Slot &dest_slot) {
+      dest_slot.Transfer(slot);
+    };
+    target.template InsertAscending</*insert_tombstones=*/true>(
+        insert_bucket[half], insert_slot[half], get_value_and_store,
+        target.SeededHashOf(Traits::KeyOf(slot.GetValue())));
+    reader.meta_byte().SetEmpty();
+  }
+  for (int half = 0; half < 2; ++half) {
+    if (halves[half]->size_ > 0) {
+      halves[half]->FinishInsertAscending(insert_bucket[half]);
+    }
+    halves[half]->UpdateObservers();
+  }
+  source.size_ = 0;
+  source.clear();
 }
 
 template <class Traits> void HashTable<Traits>::rehash(size_t slot_count) {
+  const auto start = instrumentation().OnRehashBegin();
+  const uint64_t sample_start = SampleRehashBegin();
+  const size_t values = size_;
   typename Traits::rehash_callback callback{};
   // `callback` will call `rehash_internal`, possibly doing some
   // instrumentation before or after call.
   callback(*this, slot_count);
+  instrumentation().OnRehashEnd(start, values * sizeof(value_type));
+  ObserveRehash(sample_start);
 }
 
 template <class Traits>
 void HashTable<Traits>::rehash_internal(size_t slot_count) {
-  if (slot_count == 0) {
-    slot_count = ceil(size() * Traits::full_utilization_denominator,
-                      Traits::full_utilization_numerator);
+  slot_count = std::max(slot_count,
+                        ceil(size() * FullUtilization().denominator,
+                             FullUtilization().numerator));
+  const size_t logical_size = ceil(slot_count, Traits::kSlotsPerBucket);
+  if constexpr (Traits::kInlineCapacity > 0) {
+    if (slot_count <= Traits::kInlineCapacity) {
+      MoveToInline();
+      return;
+    }
+    if (IsInline()) {
+      MoveFromInline(logical_size);
+      return;
+    }
+  }
+  if (logical_size == 0) {
+    // `size()` is zero.
+    buckets_.clear();
+    probe_sums().Reset();
+    return;
+  }
+  if (logical_size < buckets_.logical_size() &&
+      buckets_.CanShrinkInPlace(logical_size)) {
+    next_buckets().Free();
+    ShrinkInPlace(logical_size);
+    return;
+  }
+  Buckets<Traits> buckets;
+  if (!next_buckets().Take(logical_size, buckets)) {
+    Buckets<Traits> allocated(logical_size);
+    buckets.swap(allocated);
   }
-  Buckets<Traits> buckets(ceil(slot_count, Traits::kSlotsPerBucket));
   buckets.swap(buckets_);
   // Leaves size_ unmodified.
   RehashOrCopyFrom</*destroy_source*/true>(buckets);
@@ -1440,8 +4263,8 @@ void HashTable<Traits>::rehash_internal(size_t slot_count) {
 template <class Traits> void HashTable<Traits>::reserve(size_t count) {
   if (NeedsRehash(count)) {
     size_t new_capacity_for_count =
-        ceil(count * Traits::full_utilization_denominator,
-             Traits::full_utilization_numerator);
+        ceil(count * FullUtilization().denominator,
+             FullUtilization().numerator);
     // Don't grow by less than 1/7.
     size_t new_capacity =
         std::max(new_capacity_for_count, ceil(LogicalSlotCount() * 8, 7));
@@ -1450,10 +4273,143 @@ template <class Traits> void HashTable<Traits>::reserve(size_t count) {
   }
 }
 
+template <class Traits> void HashTable<Traits>::Maintain() {
+  if (NeedsShrink()) {
+    Shrink();
+    return;
+  }
+  if constexpr (Traits::kMemoryBudget) {
+    // Follow the budget's advice now: grow if the table is fuller than
+    // the advised policy allows, and shrink if the advised policy saves
+    // at least an eighth of the buckets.
+    if (IsInline() || empty()) {
+      return;
+    }
+    const size_t slot_count = RehashedSlotCount(size_);
+    if (NeedsRehash(size_) ||
+        8 * ceil(slot_count, Traits::kSlotsPerBucket) <=
+            7 * buckets_.logical_size()) {
+      rehash(slot_count);
+    }
+  }
+}
+
+template <class Traits> bool HashTable<Traits>::NeedsShrink() const {
+  return size() * Traits::shrink_utilization_denominator <
+         LogicalSlotCount() * Traits::shrink_utilization_numerator;
+}
+
+template <class Traits> void HashTable<Traits>::Shrink() {
+  size_t slot_count = RehashedSlotCount(size());
+  if (ceil(slot_count, Traits::kSlotsPerBucket) < buckets_.logical_size()) {
+    rehash(slot_count);
+  }
+}
+
+template <class Traits>
+void HashTable<Traits>::ShrinkInPlace(size_t logical_size) {
+  using StoredType = typename Traits::Slot::StoredType;
+  const size_t old_logical_size = buckets_.logical_size();
+  const size_t old_physical_size = buckets_.physical_size();
+  assert(0 < logical_size && logical_size < old_logical_size);
+  Bucket<Traits> *const old_buckets = buckets_.begin();
+  // The values that have been moved out of the old buckets but not
+  // yet stored into the new ones, and a min-heap of their indexes.
+  // Stored values free their indexes for reuse, so `spilled` is only as
+  // big as the heap ever gets.
+  std::vector<std::optional<StoredType>> spilled;
+  std::vector<SpilledItem> heap;
+  std::vector<size_t> free_indexes;
+  // The search distances of old logical buckets that have been
+  // emptied but not yet processed by the main loop below.
+  std::deque<uint8_t> search_distances;
+  // Old buckets `[0, extracted)` have been emptied.
+  size_t extracted = 0;
+  auto extract_through = [&](size_t bucket_number) {
+    for (; extracted <= bucket_number && extracted < old_physical_size;
+         ++extracted) {
+      Bucket<Traits> &bucket = old_buckets[extracted];
+      if (extracted < old_logical_size) {
+        search_distances.push_back(bucket.search_distance);
+      }
+      for (size_t slot = 0; slot < Traits::kSlotsPerBucket; ++slot) {
+        if (!bucket.h2[slot].IsEmpty()) {
+          size_t hash =
+              SeededHashOf(Traits::KeyOf(bucket.slots[slot].GetValue()));
+          size_t index;
+          if (free_indexes.empty()) {
+            index = spilled.size();
+            spilled.emplace_back();
+          } else {
+            index = free_indexes.back();
+            free_indexes.pop_back();
+          }
+          spilled[index].emplace(bucket.slots[slot].MoveAndDestroy());
+          heap.push_back({hash, index});
+          std::push_heap(heap.begin(), heap.end());
+        }
+      }
+      // Leave it clean for `InitForInsertAscending`.
+      bucket.Init();
+    }
+  };
+  extract_through(0);
+  buckets_.SetLogicalSizeInPlace(logical_size);
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  auto insert_smallest = [&]() {
+    SpilledItem item = heap.front();
+    std::pop_heap(heap.begin(), heap.end());
+    heap.pop_back();
+    // `InsertAscending` may initialize the bucket after the one it
+    // stores into, so empty that one first too.
+    extract_through(std::max(insert_bucket, buckets_.H1(item.hash)) + 1);
+    auto store = [&](typename Traits::Slot &dest_slot) {
+      dest_slot.Store(std::move(*spilled[item.index]));
+      spilled[item.index].reset();
+      free_indexes.push_back(item.index);
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                store, item.hash);
+  };
+  // Old bucket `bucket_number` has been processed once every value
+  // that prefers it has been extracted, which requires emptying its
+  // whole search window.  At that point the smallest hash in the heap
+  // that prefers a bucket up to `bucket_number` is smaller than any
+  // hash still in the old buckets.
+  for (size_t bucket_number = 0; bucket_number < old_logical_size;
+       ++bucket_number) {
+    extract_through(bucket_number);
+    assert(!search_distances.empty());
+    size_t search_distance = search_distances.front();
+    search_distances.pop_front();
+    if (search_distance > 0) {
+      extract_through(bucket_number + search_distance - 1);
+    }
+    while (!heap.empty() &&
+           Buckets<Traits>::H1(heap.front().hash, old_logical_size) <=
+               bucket_number) {
+      insert_smallest();
+    }
+  }
+  while (!heap.empty()) {
+    insert_smallest();
+  }
+  // The buckets after the last insert hold no values, but if they
+  // weren't extracted they may have stale search distances.
+  extract_through(buckets_.physical_size() - 1);
+  FinishInsertAscending(insert_bucket);
+  buckets_.ReleaseTail(old_physical_size);
+}
+
 template <class Traits>
 bool HashTable<Traits>::NeedsRehash(size_t target_size) const {
-  return LogicalSlotCount() * Traits::full_utilization_numerator <
-         target_size * Traits::full_utilization_denominator;
+  if (IsInline()) {
+    return target_size > Traits::kInlineCapacity;
+  }
+  const Utilization full = FullUtilization();
+  return LogicalSlotCount() * full.numerator < target_size * full.denominator;
 }
 
 template <class Traits> size_t HashTable<Traits>::LogicalSlotCount() const {
@@ -1463,7 +4419,7 @@ template <class Traits> size_t HashTable<Traits>::LogicalSlotCount() const {
 template <class Traits>
 size_t
 HashTable<Traits>::GetSuccessfulProbeLength(const value_type &value) const {
-  const size_t h1 = buckets_.H1(get_hasher_ref()(value));
+  const size_t h1 = buckets_.H1(SeededHashOf(value));
   size_t search_distance = buckets_[h1].search_distance;
   for (size_t i = 0; i <= search_distance; ++i) {
     const Bucket<Traits> &bucket = buckets_[h1 + i];
@@ -1492,8 +4448,113 @@ size_t HashTable<Traits>::GetInsertProbeLength(
   }
 }
 
+template <class Traits> void HashTable<Traits>::MoveToInline() {
+  if (IsInline()) {
+    return;
+  }
+  assert(size() <= Traits::kInlineCapacity);
+  Bucket<Traits> &inline_bucket = inline_storage().bucket();
+  size_t inline_slot = 0;
+  for (Bucket<Traits> &bucket : buckets_) {
+    for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
+      if (!bucket.h2[j].IsEmpty()) {
+        inline_bucket.slots[inline_slot].Transfer(bucket.slots[j]);
+        inline_bucket.h2[inline_slot].SetOrderedValue(bucket.h2[j].h2());
+        bucket.h2[j].SetEmpty();
+        ++inline_slot;
+      }
+    }
+  }
+  buckets_.clear();
+  next_buckets().Free();
+  probe_sums().Reset();
+}
+
+template <class Traits>
+void HashTable<Traits>::MoveFromInline(size_t logical_size) {
+  assert(IsInline());
+  Buckets<Traits> buckets(logical_size);
+  buckets_.swap(buckets);
+  // `InsertAscending` needs the values in hash order.
+  Bucket<Traits> &inline_bucket = inline_storage().bucket();
+  std::array<std::pair<size_t, size_t>, Traits::kInlineCapacity> order;
+  size_t count = 0;
+  for (size_t j = 0; j < Traits::kInlineCapacity; ++j) {
+    if (!inline_bucket.h2[j].IsEmpty()) {
+      order[count++] = {
+          SeededHashOf(Traits::KeyOf(inline_bucket.slots[j].GetValue())),
+          j};
+    }
+  }
+  std::sort(order.begin(), order.begin() + count);
+  size_t insert_bucket = 0;
+  size_t insert_slot = 0;
+  BeginInsertAscending();
+  for (size_t i = 0; i < count; ++i) {
+    auto [hash, j] = order[i];
+    auto store = [&, j = j](typename Traits::Slot &dest_slot) {
+      dest_slot.Transfer(inline_bucket.slots[j]);
+    };
+    InsertAscending</*insert_tombstones=*/true>(insert_bucket, insert_slot,
+                                                store, hash);
+    inline_bucket.h2[j].SetEmpty();
+  }
+  FinishInsertAscending(insert_bucket);
+}
+
+template <class Traits>
+void HashTable<Traits>::CopyToInline(const HashTable &other) {
+  assert(IsInline() && empty());
+  assert(other.size() <= Traits::kInlineCapacity);
+  Bucket<Traits> &inline_bucket = inline_storage().bucket();
+  size_t inline_slot = 0;
+  for (const value_type &value : other) {
+    inline_bucket.slots[inline_slot].Store(value);
+    inline_bucket.h2[inline_slot].SetOrderedValue(
+        buckets_.H2(SeededHashOf(Traits::KeyOf(value))));
+    ++inline_slot;
+  }
+  size_ = other.size_;
+}
+
+template <class Traits> void HashTable<Traits>::SwapInline(HashTable &other) {
+  Bucket<Traits> &a = inline_storage().bucket();
+  Bucket<Traits> &b = other.inline_storage().bucket();
+  for (size_t j = 0; j < Traits::kInlineCapacity; ++j) {
+    const bool a_full = !a.h2[j].IsEmpty();
+    const bool b_full = !b.h2[j].IsEmpty();
+    if (a_full && b_full) {
+      typename Traits::Slot::StoredType value = a.slots[j].MoveAndDestroy();
+      a.slots[j].Transfer(b.slots[j]);
+      b.slots[j].Store(std::move(value));
+    } else if (a_full) {
+      b.slots[j].Transfer(a.slots[j]);
+    } else if (b_full) {
+      a.slots[j].Transfer(b.slots[j]);
+    }
+    std::swap(a.h2[j], b.h2[j]);
+  }
+}
+
+template <class Traits>
+InstrumentationSnapshot HashTable<Traits>::GetInstrumentationSnapshot() const {
+  InstrumentationSnapshot snapshot;
+  instrumentation().Fill(snapshot);
+  if (!IsInline()) {
+    for (size_t i = 0; i < buckets_.logical_size(); ++i) {
+      snapshot.max_search_distance = std::max<size_t>(
+          snapshot.max_search_distance, buckets_[i].search_distance);
+    }
+  }
+  return snapshot;
+}
+
 template <class Traits>
 ProbeStatistics HashTable<Traits>::GetProbeStatistics() const {
+  if (IsInline()) {
+    // Every lookup or insert looks at the one inline bucket.
+    return {.successful = 1, .unsuccessful = 1, .insert = 1};
+  }
   // Sum up the lengths for successful searches
   double success_sum = 0;
   for (const auto &value : *this) {
@@ -1522,6 +4583,101 @@ ProbeStatistics HashTable<Traits>::GetProbeStatistics() const {
           .insert = insert_sum / buckets_.logical_size()};
 }
 
+template <class Traits>
+ProbeSums<Traits> HashTable<Traits>::ComputeProbeSums() const {
+  ProbeSums<Traits> sums;
+  if (IsInline()) {
+    return sums;
+  }
+  for (size_t i = 0; i < buckets_.physical_size(); ++i) {
+    for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
+      if (!buckets_[i].h2[j].IsEmpty()) {
+        sums.AddValue(i + 1 - buckets_.H1(SeededHashOf(
+                                  Traits::KeyOf(buckets_[i].slots[j].GetValue()))));
+      }
+    }
+  }
+  for (size_t i = 0; i < buckets_.logical_size(); ++i) {
+    sums.AddSearchDistance(buckets_[i].search_distance);
+  }
+  return sums;
+}
+
+template <class Traits>
+ProbeStatistics HashTable<Traits>::GetOnlineProbeStatistics() const {
+  static_assert(Traits::kOnlineProbeStatistics,
+                "GetOnlineProbeStatistics requires kOnlineProbeStatistics");
+  if (IsInline()) {
+    return {.successful = 1, .unsuccessful = 1, .insert = 1};
+  }
+  return {.successful = static_cast<double>(probe_sums().successful()) / size(),
+          .unsuccessful = static_cast<double>(probe_sums().search_distance()) /
+                          buckets_.logical_size(),
+          .insert = std::numeric_limits<double>::quiet_NaN()};
+}
+
+template <class Traits>
+ProbeStatisticsEstimate
+HashTable<Traits>::EstimateProbeStatistics(size_t sample_buckets,
+                                           uint64_t seed) const {
+  if (IsInline() || buckets_.empty() || sample_buckets == 0) {
+    return {.mean = {.successful = 1, .unsuccessful = 1, .insert = 1},
+            .error = {.successful = 0, .unsuccessful = 0, .insert = 0}};
+  }
+  // For the unsuccessful and insert probe lengths, the buckets are a
+  // simple random sample.  The successful probe length is a ratio (the
+  // probe lengths of the values in the sampled buckets over the number
+  // of those values), so its error is that of a ratio estimator.
+  std::mt19937_64 random(seed);
+  std::uniform_int_distribution<size_t> pick(0, buckets_.logical_size() - 1);
+  std::vector<std::array<double, 4>> samples(sample_buckets);
+  std::array<double, 4> sums{};
+  for (auto &sample : samples) {
+    const size_t i = pick(random);
+    double probe_sum = 0;
+    double values = 0;
+    for (size_t j = 0; j < Traits::kSlotsPerBucket; ++j) {
+      if (!buckets_[i].h2[j].IsEmpty()) {
+        probe_sum += i + 1 - buckets_.H1(SeededHashOf(
+                                 Traits::KeyOf(buckets_[i].slots[j].GetValue())));
+        ++values;
+      }
+    }
+    sample = {probe_sum, values,
+              static_cast<double>(buckets_[i].search_distance),
+              static_cast<double>(GetInsertProbeLength(i))};
+    for (size_t k = 0; k < sample.size(); ++k) {
+      sums[k] += sample[k];
+    }
+  }
+  const double n = sample_buckets;
+  const double ratio = sums[1] == 0 ? 1 : sums[0] / sums[1];
+  const double values_mean = sums[1] / n;
+  const double unsuccessful_mean = sums[2] / n;
+  const double insert_mean = sums[3] / n;
+  double ratio_variance = 0;
+  double unsuccessful_variance = 0;
+  double insert_variance = 0;
+  for (const auto &sample : samples) {
+    ratio_variance += std::pow(sample[0] - ratio * sample[1], 2);
+    unsuccessful_variance += std::pow(sample[2] - unsuccessful_mean, 2);
+    insert_variance += std::pow(sample[3] - insert_mean, 2);
+  }
+  // 1.96 standard errors, with the sample variances.
+  auto error = [&](double variance_sum, double scale) {
+    if (sample_buckets < 2 || scale == 0) {
+      return std::numeric_limits<double>::infinity();
+    }
+    return 1.96 * std::sqrt(variance_sum / (n - 1) / n) / scale;
+  };
+  return {.mean = {.successful = ratio,
+                   .unsuccessful = unsuccessful_mean,
+                   .insert = insert_mean},
+          .error = {.successful = error(ratio_variance, values_mean),
+                    .unsuccessful = error(unsuccessful_variance, 1),
+                    .insert = error(insert_variance, 1)}};
+}
+
 } // namespace yobiduck::internal
 
 #endif // _GRAVEYARD_INTERNAL_HASH_TABLE_H
@@ -0,0 +1,215 @@
+#ifndef _GRAVEYARD_INTERNAL_INSTRUMENTATION_H_
+#define _GRAVEYARD_INTERNAL_INSTRUMENTATION_H_
+
+// Instrumentation policies for `HashTable` (see
+// `HashTableTraits::instrumentation`).  The table calls the policy's
+// hooks on every find, insert, and rehash.
+//
+// `NullInstrumentation` (the default) has empty hooks, so they compile
+// away, and it takes no space in the table.
+//
+// `CountingInstrumentation` keeps a few counters and histograms in the
+// table object (about 420 bytes).  A find or an insert increments one
+// histogram bucket (the counts of finds, hits, misses, and inserts are
+// the histograms' sums).  With the out-of-line call that the counting
+// find needs (see below), that costs 10-35% in a tight loop of finds.
+//
+// `SampledCountingInstrumentation` is meant for monitoring in
+// production.  It counts every insert and rehash, but only about one
+// find (or H2 false positive) in `kSampledFindPeriod`, and scales
+// those counts up in the snapshot.  The table asks `SampleFind()` once
+// per find and runs the counting code only for the sampled ones, out
+// of line, so the others run the same code as they do without
+// instrumentation, plus a decrement of a per-thread countdown and a
+// well-predicted branch.  The countdown restarts at a random length
+// whose mean is the period, so the finds are sampled independently of
+// their keys (a skewed workload is sampled in proportion) and of any
+// periodic pattern in the workload.
+//
+// It isn't yet the mode to leave on in production, though: that needs
+// under 1% on `benchmark/instrumentation_benchmark.cc`.  In a tight loop
+// of finds on a small table the countdown still costs 5-20%, and on a
+// 10M-key table the difference is within the benchmark's noise (about
+// 5%), so it hasn't been shown to be under 1% there.
+//
+// The counters are relaxed atomics that are incremented with a load
+// and a store rather than a locked add (which would cost more than the
+// rest of a find).  Concurrent `find`s on a const table are safe, but
+// may lose some counts.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+
+#include "absl/base/attributes.h"
+
+namespace yobiduck::internal {
+
+// A snapshot of a table's instrumentation.
+struct InstrumentationSnapshot {
+  // Probe lengths are numbers of buckets visited.  The last bucket of
+  // each histogram counts all the longer probes too.
+  static constexpr size_t kHistogramSize = 16;
+  using Histogram = std::array<uint64_t, kHistogramSize>;
+
+  // Of the finds that found the key.
+  Histogram hit_probe_lengths{};
+  // Of the finds that didn't.
+  Histogram miss_probe_lengths{};
+  // Of the inserts that inserted a value (an insert of a key that's
+  // already present is counted by neither histogram).
+  Histogram insert_probe_lengths{};
+  // Slots whose H2 matched a key that wasn't there.
+  uint64_t h2_false_positives = 0;
+  uint64_t rehashes = 0;
+  uint64_t rehash_nanoseconds = 0;
+  // The sizes of the values that the rehashes moved.
+  uint64_t rehash_bytes_moved = 0;
+  // The maximum search distance of the table's buckets now.
+  size_t max_search_distance = 0;
+
+  uint64_t hits() const { return Sum(hit_probe_lengths); }
+  uint64_t misses() const { return Sum(miss_probe_lengths); }
+  uint64_t finds() const { return hits() + misses(); }
+  uint64_t inserts() const { return Sum(insert_probe_lengths); }
+
+private:
+  static uint64_t Sum(const Histogram &histogram) {
+    uint64_t sum = 0;
+    for (uint64_t count : histogram) {
+      sum += count;
+    }
+    return sum;
+  }
+};
+
+struct NullInstrumentation {
+  static constexpr bool kEnabled = false;
+  // Returns whether to call `OnFind` and `OnFalsePositive` for a
+  // find (or for one false positive of an insert).
+  bool SampleFind() const { return false; }
+  void OnFind(size_t /*probe_length*/, bool /*found*/) const {}
+  void OnFalsePositive() const {}
+  void OnInsert(size_t /*probe_length*/) {}
+  // Returns a token to pass to `OnRehashEnd`.
+  int OnRehashBegin() const { return 0; }
+  void OnRehashEnd(int /*token*/, uint64_t /*bytes_moved*/) {}
+  void Fill(InstrumentationSnapshot & /*snapshot*/) const {}
+};
+
+// Counts about one find in `find_period` (see above).
+template <uint64_t find_period> class BasicCountingInstrumentation {
+  static_assert(find_period > 0);
+
+public:
+  static constexpr bool kEnabled = true;
+
+  BasicCountingInstrumentation() = default;
+  // A copy of a table starts with zero counts, and a table that's
+  // assigned to keeps counting where it was.
+  BasicCountingInstrumentation(const BasicCountingInstrumentation &) {}
+  BasicCountingInstrumentation &
+  operator=(const BasicCountingInstrumentation &) {
+    return *this;
+  }
+
+  bool SampleFind() const {
+    if constexpr (find_period == 1) {
+      return true;
+    } else {
+      if (--countdown_ > 0) {
+        return false;
+      }
+      countdown_ = NextCountdown();
+      return true;
+    }
+  }
+  void OnFind(size_t probe_length, bool found) const {
+    Increment((found ? hit_probe_lengths_
+                     : miss_probe_lengths_)[Bucket(probe_length)]);
+  }
+  void OnFalsePositive() const { Increment(h2_false_positives_); }
+  void OnInsert(size_t probe_length) {
+    Increment(insert_probe_lengths_[Bucket(probe_length)]);
+  }
+  std::chrono::steady_clock::time_point OnRehashBegin() const {
+    return std::chrono::steady_clock::now();
+  }
+  void OnRehashEnd(std::chrono::steady_clock::time_point start,
+                   uint64_t bytes_moved) {
+    Increment(rehashes_);
+    Increment(rehash_nanoseconds_,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - start)
+                  .count());
+    Increment(rehash_bytes_moved_, bytes_moved);
+  }
+
+  void Fill(InstrumentationSnapshot &snapshot) const {
+    for (size_t i = 0; i < InstrumentationSnapshot::kHistogramSize; ++i) {
+      snapshot.hit_probe_lengths[i] =
+          Load(hit_probe_lengths_[i]) * find_period;
+      snapshot.miss_probe_lengths[i] =
+          Load(miss_probe_lengths_[i]) * find_period;
+      snapshot.insert_probe_lengths[i] = Load(insert_probe_lengths_[i]);
+    }
+    snapshot.h2_false_positives = Load(h2_false_positives_) * find_period;
+    snapshot.rehashes = Load(rehashes_);
+    snapshot.rehash_nanoseconds = Load(rehash_nanoseconds_);
+    snapshot.rehash_bytes_moved = Load(rehash_bytes_moved_);
+  }
+
+private:
+  using Counter = std::atomic<uint64_t>;
+  using Histogram =
+      std::array<Counter, InstrumentationSnapshot::kHistogramSize>;
+
+  static size_t Bucket(size_t probe_length) {
+    return probe_length < InstrumentationSnapshot::kHistogramSize
+               ? probe_length
+               : InstrumentationSnapshot::kHistogramSize - 1;
+  }
+  static void Increment(Counter &counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n,
+                  std::memory_order_relaxed);
+  }
+  static uint64_t Load(const Counter &counter) {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+  // Returns a random countdown whose mean is `find_period`.
+  ABSL_ATTRIBUTE_NOINLINE static int64_t NextCountdown() {
+    thread_local uint64_t state =
+        reinterpret_cast<uintptr_t>(&state) ^ 0x9E3779B97F4A7C15ull;
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return 1 + static_cast<int64_t>(state % (2 * find_period - 1));
+  }
+
+  // The finds left until the thread's next sampled one, shared by all
+  // its tables.
+  static inline thread_local int64_t countdown_ = 1;
+
+  // Mutable since `find` is const.
+  mutable Histogram hit_probe_lengths_{};
+  mutable Histogram miss_probe_lengths_{};
+  mutable Counter h2_false_positives_{0};
+  Histogram insert_probe_lengths_{};
+  Counter rehashes_{0};
+  Counter rehash_nanoseconds_{0};
+  Counter rehash_bytes_moved_{0};
+};
+
+using CountingInstrumentation = BasicCountingInstrumentation<1>;
+
+inline constexpr uint64_t kSampledFindPeriod = 64;
+using SampledCountingInstrumentation =
+    BasicCountingInstrumentation<kSampledFindPeriod>;
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_INSTRUMENTATION_H_
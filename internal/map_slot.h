@@ -56,6 +56,12 @@ class MapSlot {
     new (&u_.stored) StoredType(std::move(value));
   }
 
+  // Constructs the pair from `args` (as in `std::pair`'s constructors,
+  // including `piecewise_construct`).
+  template <class... Args> void Emplace(Args &&...args) {
+    new (&u_.stored) StoredType(std::forward<Args>(args)...);
+  }
+
   // Effectly does `Store(from.MoveAndDestroy())` but without doing so
   // many move assignments.
   void Transfer(MapSlot &from) {
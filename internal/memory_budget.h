@@ -0,0 +1,247 @@
+#ifndef _GRAVEYARD_INTERNAL_MEMORY_BUDGET_H_
+#define _GRAVEYARD_INTERNAL_MEMORY_BUDGET_H_
+
+// A process-wide memory budget for hash tables.  Tables whose traits
+// have `kMemoryBudget = true` register with `MemoryBudget::Global()`
+// when they're constructed, and keep their entry up to date with their
+// size, capacity, allocated memory, and number of lookups.
+//
+// `Rebalance()` (which the program calls, e.g., periodically or when
+// it nears its memory limit) advises each table of a load policy:
+//
+//   `kSpacious`: Grow at 7/10 full, to 1/2 full.  Faster lookups.
+//   `kDefault`: The traits' utilizations.
+//   `kDense`: Grow at 15/16 full, to 29/32 full.  Less memory.
+//
+// It starts every table at `kSpacious` and, while the projected memory
+// exceeds the budget, moves the tables with the lowest lookup rates to
+// denser policies first.
+//
+// A table follows the advice at its next rehash (so a table advised to
+// be spacious grows at its next insert if it's fuller than that), or
+// at its next `Maintain()` (which also shrinks a table advised to be
+// denser).
+//
+// Like the `TableSampler`'s registry, the registry is a lock-free list
+// of entries that are never freed but are reused.  `Rebalance` holds a
+// mutex, but tables never take it.
+
+#include <algorithm> // for sort
+#include <atomic>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint8_t, uint64_t
+#include <mutex>
+#include <vector>
+
+namespace yobiduck::internal {
+
+enum class LoadPolicy : uint8_t { kDefault, kSpacious, kDense };
+
+// The fraction `numerator / denominator` of a table's logical slots.
+struct Utilization {
+  size_t numerator;
+  size_t denominator;
+
+  double value() const { return static_cast<double>(numerator) / denominator; }
+};
+
+inline constexpr Utilization kSpaciousFullUtilization{7, 10};
+inline constexpr Utilization kSpaciousRehashedUtilization{1, 2};
+inline constexpr Utilization kDenseFullUtilization{15, 16};
+inline constexpr Utilization kDenseRehashedUtilization{29, 32};
+
+// A table's entry in the budget.  The table writes the statistics; the
+// budget writes the policy.
+class BudgetEntry {
+public:
+  void Update(size_t size, size_t capacity, size_t allocated_bytes) {
+    size_.store(size, std::memory_order_relaxed);
+    capacity_.store(capacity, std::memory_order_relaxed);
+    allocated_bytes_.store(allocated_bytes, std::memory_order_relaxed);
+  }
+  // A load and a store rather than a locked add, so concurrent finds
+  // on a const table may lose some counts.
+  void CountLookups(uint64_t n) {
+    lookups_.store(lookups_.load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+  }
+  LoadPolicy policy() const { return policy_.load(std::memory_order_relaxed); }
+
+private:
+  friend class MemoryBudget;
+  enum State : int { kFree, kClaimed, kLive };
+
+  std::atomic<int> state_{kFree};
+  // Set before the entry is published, and never changed.
+  BudgetEntry *next_ = nullptr;
+
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> capacity_{0};
+  std::atomic<size_t> allocated_bytes_{0};
+  std::atomic<uint64_t> lookups_{0};
+  std::atomic<LoadPolicy> policy_{LoadPolicy::kDefault};
+  // The average utilization under the traits' own policy.
+  std::atomic<double> default_utilization_{0};
+  // The lookups at the last rebalance.
+  std::atomic<uint64_t> rebalanced_lookups_{0};
+};
+
+class MemoryBudget {
+public:
+  // What `Rebalance` did.
+  struct Report {
+    size_t tables = 0;
+    size_t allocated_bytes = 0;
+    // The memory the tables are expected to use once they've adopted
+    // their policies.
+    size_t projected_bytes = 0;
+    size_t spacious = 0;
+    size_t dense = 0;
+  };
+
+  // The budget of all the tables in the process.
+  static MemoryBudget &Global() {
+    static MemoryBudget *budget = new MemoryBudget();
+    return *budget;
+  }
+
+  // Sets the budget, in bytes, of all the registered tables' allocated
+  // memory.  0 means no limit.
+  void SetBudget(size_t bytes) {
+    budget_.store(bytes, std::memory_order_relaxed);
+  }
+  size_t budget() const { return budget_.load(std::memory_order_relaxed); }
+
+  // Registers a new table whose traits' policy averages
+  // `default_utilization` of its slots.
+  BudgetEntry *Register(double default_utilization) {
+    BudgetEntry *head = head_.load(std::memory_order_acquire);
+    BudgetEntry *entry = nullptr;
+    for (BudgetEntry *e = head; e != nullptr; e = e->next_) {
+      int expected = BudgetEntry::kFree;
+      if (e->state_.compare_exchange_strong(expected, BudgetEntry::kClaimed,
+                                            std::memory_order_acquire)) {
+        entry = e;
+        break;
+      }
+    }
+    const bool reused = entry != nullptr;
+    if (!reused) {
+      entry = new BudgetEntry();
+    }
+    entry->Update(0, 0, 0);
+    entry->lookups_.store(0, std::memory_order_relaxed);
+    entry->rebalanced_lookups_.store(0, std::memory_order_relaxed);
+    entry->policy_.store(LoadPolicy::kDefault, std::memory_order_relaxed);
+    entry->default_utilization_.store(default_utilization,
+                                      std::memory_order_relaxed);
+    entry->state_.store(BudgetEntry::kLive, std::memory_order_release);
+    if (!reused) {
+      do {
+        entry->next_ = head;
+      } while (!head_.compare_exchange_weak(head, entry,
+                                            std::memory_order_release,
+                                            std::memory_order_acquire));
+    }
+    return entry;
+  }
+
+  // Frees the entry of a destroyed table.
+  void Unregister(BudgetEntry *entry) {
+    entry->state_.store(BudgetEntry::kFree, std::memory_order_release);
+  }
+
+  // Advises every registered table of a load policy (see above).
+  Report Rebalance() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    struct Table {
+      BudgetEntry *entry;
+      uint64_t lookups;
+      // The projected bytes under each `LoadPolicy`.
+      double bytes[3];
+    };
+    std::vector<Table> tables;
+    Report report;
+    for (BudgetEntry *e = head_.load(std::memory_order_acquire); e != nullptr;
+         e = e->next_) {
+      if (e->state_.load(std::memory_order_acquire) != BudgetEntry::kLive) {
+        continue;
+      }
+      const uint64_t lookups = e->lookups_.load(std::memory_order_relaxed);
+      const uint64_t recent =
+          lookups - e->rebalanced_lookups_.load(std::memory_order_relaxed);
+      e->rebalanced_lookups_.store(lookups, std::memory_order_relaxed);
+      const size_t size = e->size_.load(std::memory_order_relaxed);
+      const size_t capacity = e->capacity_.load(std::memory_order_relaxed);
+      const size_t allocated = e->allocated_bytes_.load(std::memory_order_relaxed);
+      Table table{e, recent, {}};
+      // The bytes per slot stay the same, and the table is expected to
+      // be at the average of the policy's utilizations.
+      const double bytes_per_slot =
+          capacity == 0 ? 0 : static_cast<double>(allocated) / capacity;
+      table.bytes[static_cast<int>(LoadPolicy::kDefault)] =
+          size * bytes_per_slot /
+          e->default_utilization_.load(std::memory_order_relaxed);
+      table.bytes[static_cast<int>(LoadPolicy::kSpacious)] =
+          size * bytes_per_slot /
+          AverageUtilization(kSpaciousFullUtilization,
+                             kSpaciousRehashedUtilization);
+      table.bytes[static_cast<int>(LoadPolicy::kDense)] =
+          size * bytes_per_slot /
+          AverageUtilization(kDenseFullUtilization, kDenseRehashedUtilization);
+      tables.push_back(table);
+      report.allocated_bytes += allocated;
+    }
+    report.tables = tables.size();
+    // The tables with the fewest lookups since the last rebalance give
+    // up their memory first.
+    std::stable_sort(tables.begin(), tables.end(),
+                     [](const Table &a, const Table &b) {
+                       return a.lookups < b.lookups;
+                     });
+    std::vector<LoadPolicy> policies(tables.size(), LoadPolicy::kSpacious);
+    double projected = 0;
+    for (const Table &table : tables) {
+      projected += table.bytes[static_cast<int>(LoadPolicy::kSpacious)];
+    }
+    const size_t limit = budget();
+    for (LoadPolicy denser : {LoadPolicy::kDefault, LoadPolicy::kDense}) {
+      for (size_t i = 0; i < tables.size(); ++i) {
+        if (limit == 0 || projected <= limit) {
+          break;
+        }
+        const int from = static_cast<int>(policies[i]);
+        const int to = static_cast<int>(denser);
+        // Only if it's actually denser (the traits' own policy might
+        // not be denser than spacious).
+        if (tables[i].bytes[to] < tables[i].bytes[from]) {
+          projected += tables[i].bytes[to] - tables[i].bytes[from];
+          policies[i] = denser;
+        }
+      }
+    }
+    for (size_t i = 0; i < tables.size(); ++i) {
+      tables[i].entry->policy_.store(policies[i], std::memory_order_relaxed);
+      report.spacious += policies[i] == LoadPolicy::kSpacious;
+      report.dense += policies[i] == LoadPolicy::kDense;
+    }
+    report.projected_bytes = projected;
+    return report;
+  }
+
+  static double AverageUtilization(Utilization full, Utilization rehashed) {
+    return (full.value() + rehashed.value()) / 2;
+  }
+
+private:
+  MemoryBudget() = default;
+
+  std::atomic<size_t> budget_{0};
+  // The list of all the entries, live and free.
+  std::atomic<BudgetEntry *> head_{nullptr};
+  std::mutex mutex_;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_MEMORY_BUDGET_H_
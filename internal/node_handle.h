@@ -0,0 +1,108 @@
+#ifndef _GRAVEYARD_INTERNAL_NODE_HANDLE_H_
+#define _GRAVEYARD_INTERNAL_NODE_HANDLE_H_
+
+#include <cassert>
+#include <cstddef> // for size_t
+#include <optional>
+#include <utility>
+
+namespace yobiduck::internal {
+
+template <class Traits> class HashTable;
+
+// A node handle, as in `std::unordered_set::node_type`: owns a value
+// that has been extracted from a table.
+//
+// Graveyard tables store values in place (there are no nodes), so
+// extracting moves the value out of its slot.  The node also carries
+// the value's hash so that inserting it into a table with the same
+// (stateless) hasher doesn't hash the key again.  Getting a mutable
+// reference to the key forgets the hash.
+template <class Traits> class NodeHandleBase {
+  using key_type = typename Traits::key_type;
+  // The key of a node is mutable, so maps hold a `pair<K, V>` rather
+  // than a `pair<const K, V>`.
+  using StoredType =
+      std::conditional_t<Traits::is_map,
+                         std::pair<key_type, typename Traits::mapped_type_or_void>,
+                         key_type>;
+
+public:
+  using allocator_type = typename Traits::allocator;
+
+  constexpr NodeHandleBase() noexcept = default;
+  // A moved-from node is empty.
+  NodeHandleBase(NodeHandleBase &&other) noexcept
+      : value_(std::move(other.value_)), hash_(other.hash_) {
+    other.value_.reset();
+    other.hash_.reset();
+  }
+  NodeHandleBase &operator=(NodeHandleBase &&other) noexcept {
+    value_ = std::move(other.value_);
+    hash_ = other.hash_;
+    other.value_.reset();
+    other.hash_.reset();
+    return *this;
+  }
+
+  bool empty() const noexcept { return !value_.has_value(); }
+  explicit operator bool() const noexcept { return !empty(); }
+
+  void swap(NodeHandleBase &other) noexcept {
+    std::swap(value_, other.value_);
+    std::swap(hash_, other.hash_);
+  }
+  friend void swap(NodeHandleBase &a, NodeHandleBase &b) noexcept {
+    a.swap(b);
+  }
+
+protected:
+  StoredType &stored() const {
+    assert(!empty());
+    return *value_;
+  }
+  // Called when the key may be modified.
+  void ForgetHash() const { hash_.reset(); }
+
+private:
+  friend class HashTable<Traits>;
+
+  mutable std::optional<StoredType> value_;
+  mutable std::optional<size_t> hash_;
+};
+
+template <class Traits, bool = Traits::is_map>
+class NodeHandle : public NodeHandleBase<Traits> {
+public:
+  using value_type = typename Traits::value_type;
+
+  value_type &value() const {
+    this->ForgetHash();
+    return this->stored();
+  }
+};
+
+template <class Traits>
+class NodeHandle<Traits, true> : public NodeHandleBase<Traits> {
+public:
+  using key_type = typename Traits::key_type;
+  using mapped_type = typename Traits::mapped_type_or_void;
+
+  key_type &key() const {
+    this->ForgetHash();
+    return this->stored().first;
+  }
+  mapped_type &mapped() const { return this->stored().second; }
+};
+
+// The result of inserting a node (see
+// `std::unordered_set::insert_return_type`).
+template <class Iterator, class NodeType> struct InsertReturnType {
+  Iterator position;
+  bool inserted;
+  NodeType node;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_NODE_HANDLE_H_
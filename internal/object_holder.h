@@ -8,11 +8,14 @@
 // This idea comes from F14.  In contrast, Abseil uses a fancy templated
 // `Layout` class to store the empty objects.  The F14 scheme seems simpler.
 
+#include <type_traits>
 #include <utility>
 
 namespace yobiduck::internal {
 
-template <char Tag, class T> class ObjectHolder {
+template <char Tag, class T,
+          bool = std::is_empty_v<T> && !std::is_final_v<T>>
+class ObjectHolder {
 public:
   template <typename... Args>
   ObjectHolder(Args &&...args) : value_{std::forward<Args>(args)...} {}
@@ -24,6 +27,16 @@ private:
   T value_;
 };
 
+// An empty `T` is a base class, so that it takes no space.
+template <char Tag, class T> class ObjectHolder<Tag, T, true> : private T {
+public:
+  template <typename... Args>
+  ObjectHolder(Args &&...args) : T{std::forward<Args>(args)...} {}
+
+  T &operator*() { return *this; }
+  const T &operator*() const { return *this; }
+};
+
 } // namespace yobiduck::internal
 
 #endif // _GRAVEYARD_INTERNAL_OBJECT_HOLDER_H_
@@ -0,0 +1,396 @@
+#ifndef _GRAVEYARD_INTERNAL_SAMPLER_H_
+#define _GRAVEYARD_INTERNAL_SAMPLER_H_
+
+// A process-wide sampler of hash tables, in the style of Abseil's
+// hashtablez.  Tables whose traits have `kSample = true` ask the
+// sampler, when they're constructed, whether to be sampled; about one
+// in `sample_rate()` of them are.  A sampled table keeps its
+// `TableSample` up to date as it changes (size, capacity, memory,
+// insert probe lengths, lookup probe lengths, and rehashes), and
+// `TableSampler::Dump` writes all the live samples as text or JSON.
+//
+// The lookup probe lengths are those of `HashTable::GetProbeStatistics`,
+// which the table can't compute on every change.  So the table records
+// them at every rehash and every `kProbeLengthPeriod` changes: exactly
+// if it keeps online probe statistics, and otherwise estimated from a
+// few random buckets (see `HashTable::EstimateProbeStatistics`).
+//
+// A table that isn't sampled holds a null pointer, and each change
+// costs one test of that pointer.
+//
+// The registry is a lock-free list of samples that are never freed: a
+// table that's destroyed marks its sample free, and the next sampled
+// table reuses it.  So the memory used is proportional to the maximum
+// number of tables sampled at once.  Each sample is written only by its
+// table (with relaxed atomics), so a dump that runs concurrently with
+// the tables' changes may see a sample in the middle of a change.
+
+#include <unistd.h> // for write
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <cstdio>  // for snprintf
+#include <string>
+#include <vector>
+
+namespace yobiduck::internal {
+
+// A copy of a `TableSample`.
+struct TableSampleSnapshot {
+  static constexpr size_t kRehashHistorySize = 8;
+
+  // The `sizeof` of the table's `value_type`.
+  size_t value_size = 0;
+  // How long ago the table was constructed.
+  uint64_t age_nanoseconds = 0;
+  size_t size = 0;
+  size_t max_size = 0;
+  size_t capacity = 0;
+  // `GetAllocatedMemorySize()`.
+  size_t allocated_bytes = 0;
+  uint64_t inserts = 0;
+  // The number of buckets visited by the inserts.
+  uint64_t total_insert_probe_length = 0;
+  size_t max_insert_probe_length = 0;
+  // The average number of buckets that a successful and an
+  // unsuccessful lookup visit, as of the table's most recent record of
+  // them.  A badly hashed table has long ones.
+  double successful_probe_length = 0;
+  double unsuccessful_probe_length = 0;
+  uint64_t rehashes = 0;
+  uint64_t rehash_nanoseconds = 0;
+  // The capacities after the most recent rehashes, oldest first.
+  std::vector<size_t> rehash_history;
+
+  double load() const {
+    return capacity == 0 ? 0 : static_cast<double>(size) / capacity;
+  }
+  double average_insert_probe_length() const {
+    return inserts == 0 ? 0
+                        : static_cast<double>(total_insert_probe_length) /
+                              inserts;
+  }
+};
+
+// The statistics of a sampled table.  Written by the table, read by
+// the sampler.
+class TableSample {
+public:
+  // How many changes apart a table records its lookup probe lengths.
+  static constexpr uint64_t kProbeLengthPeriod = 64;
+
+  void Update(size_t size, size_t capacity, size_t allocated_bytes) {
+    Store(size_, size);
+    if (size > Load(max_size_)) {
+      Store(max_size_, size);
+    }
+    Store(capacity_, capacity);
+    Store(allocated_bytes_, allocated_bytes);
+  }
+
+  void RecordInsert(size_t probe_length) {
+    Store(inserts_, Load(inserts_) + 1);
+    Store(total_insert_probe_length_,
+          Load(total_insert_probe_length_) + probe_length);
+    if (probe_length > Load(max_insert_probe_length_)) {
+      Store(max_insert_probe_length_, probe_length);
+    }
+  }
+
+  // Counts a change to the table.  Returns true if the table should
+  // record its lookup probe lengths: at its first change, and every
+  // `kProbeLengthPeriod` changes after that.
+  bool CountChange() {
+    const uint64_t changes = Load(changes_);
+    Store(changes_, changes + 1);
+    return changes % kProbeLengthPeriod == 0;
+  }
+
+  void RecordProbeLengths(double successful, double unsuccessful) {
+    Store(successful_probe_length_, successful);
+    Store(unsuccessful_probe_length_, unsuccessful);
+  }
+
+  void RecordRehash(uint64_t nanoseconds, size_t capacity) {
+    const uint64_t rehashes = Load(rehashes_);
+    Store(rehash_history_[rehashes % kRehashHistorySize], capacity);
+    Store(rehash_nanoseconds_, Load(rehash_nanoseconds_) + nanoseconds);
+    Store(rehashes_, rehashes + 1);
+  }
+
+  TableSampleSnapshot Snapshot() const {
+    TableSampleSnapshot snapshot;
+    snapshot.value_size = Load(value_size_);
+    snapshot.age_nanoseconds = NowNanoseconds() - Load(created_nanoseconds_);
+    snapshot.size = Load(size_);
+    snapshot.max_size = Load(max_size_);
+    snapshot.capacity = Load(capacity_);
+    snapshot.allocated_bytes = Load(allocated_bytes_);
+    snapshot.inserts = Load(inserts_);
+    snapshot.total_insert_probe_length = Load(total_insert_probe_length_);
+    snapshot.max_insert_probe_length = Load(max_insert_probe_length_);
+    snapshot.successful_probe_length = Load(successful_probe_length_);
+    snapshot.unsuccessful_probe_length = Load(unsuccessful_probe_length_);
+    snapshot.rehashes = Load(rehashes_);
+    snapshot.rehash_nanoseconds = Load(rehash_nanoseconds_);
+    const uint64_t begin = snapshot.rehashes > kRehashHistorySize
+                               ? snapshot.rehashes - kRehashHistorySize
+                               : 0;
+    for (uint64_t i = begin; i < snapshot.rehashes; ++i) {
+      snapshot.rehash_history.push_back(
+          Load(rehash_history_[i % kRehashHistorySize]));
+    }
+    return snapshot;
+  }
+
+  static uint64_t NowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+private:
+  friend class TableSampler;
+  static constexpr size_t kRehashHistorySize =
+      TableSampleSnapshot::kRehashHistorySize;
+  enum State : int { kFree, kClaimed, kLive };
+
+  template <class T> static T Load(const std::atomic<T> &v) {
+    return v.load(std::memory_order_relaxed);
+  }
+  template <class T> static void Store(std::atomic<T> &v, T value) {
+    v.store(value, std::memory_order_relaxed);
+  }
+
+  // Called by the sampler on a claimed sample before it's live.
+  void Reset(size_t value_size) {
+    Store(value_size_, value_size);
+    Store(created_nanoseconds_, NowNanoseconds());
+    Store<size_t>(size_, 0);
+    Store<size_t>(max_size_, 0);
+    Store<size_t>(capacity_, 0);
+    Store<size_t>(allocated_bytes_, 0);
+    Store<uint64_t>(inserts_, 0);
+    Store<uint64_t>(total_insert_probe_length_, 0);
+    Store<size_t>(max_insert_probe_length_, 0);
+    Store<uint64_t>(changes_, 0);
+    Store(successful_probe_length_, 0.0);
+    Store(unsuccessful_probe_length_, 0.0);
+    Store<uint64_t>(rehashes_, 0);
+    Store<uint64_t>(rehash_nanoseconds_, 0);
+  }
+
+  std::atomic<int> state_{kFree};
+  // Set before the sample is published, and never changed.
+  TableSample *next_ = nullptr;
+
+  std::atomic<size_t> value_size_{0};
+  std::atomic<uint64_t> created_nanoseconds_{0};
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> max_size_{0};
+  std::atomic<size_t> capacity_{0};
+  std::atomic<size_t> allocated_bytes_{0};
+  std::atomic<uint64_t> inserts_{0};
+  std::atomic<uint64_t> total_insert_probe_length_{0};
+  std::atomic<size_t> max_insert_probe_length_{0};
+  std::atomic<uint64_t> changes_{0};
+  std::atomic<double> successful_probe_length_{0};
+  std::atomic<double> unsuccessful_probe_length_{0};
+  std::atomic<uint64_t> rehashes_{0};
+  std::atomic<uint64_t> rehash_nanoseconds_{0};
+  std::array<std::atomic<size_t>, kRehashHistorySize> rehash_history_{};
+};
+
+class TableSampler {
+public:
+  enum class Format { kText, kJson };
+
+  static constexpr size_t kDefaultSampleRate = 1024;
+
+  // The sampler of all the tables in the process.
+  static TableSampler &Global() {
+    static TableSampler *sampler = new TableSampler();
+    return *sampler;
+  }
+
+  // Samples about one in `rate` tables.  0 samples none.
+  void SetSampleRate(size_t rate) {
+    rate_.store(rate, std::memory_order_relaxed);
+  }
+  size_t sample_rate() const { return rate_.load(std::memory_order_relaxed); }
+
+  // Returns a sample for a new table whose values have size
+  // `value_size`, or nullptr if the table isn't sampled.
+  TableSample *MaybeSample(size_t value_size) {
+    thread_local int64_t countdown = -1;
+    if (--countdown > 0) {
+      return nullptr;
+    }
+    return MaybeSampleSlow(countdown, value_size);
+  }
+
+  // Frees the sample of a destroyed table.
+  void Unregister(TableSample *sample) {
+    sample->state_.store(TableSample::kFree, std::memory_order_release);
+  }
+
+  // Returns snapshots of the live samples.
+  std::vector<TableSampleSnapshot> Snapshot() const {
+    std::vector<TableSampleSnapshot> snapshots;
+    for (TableSample *sample = head_.load(std::memory_order_acquire);
+         sample != nullptr; sample = sample->next_) {
+      if (sample->state_.load(std::memory_order_acquire) ==
+          TableSample::kLive) {
+        snapshots.push_back(sample->Snapshot());
+      }
+    }
+    return snapshots;
+  }
+
+  // Writes the live samples to the file descriptor `fd`: as text, one
+  // table per line, or as a JSON array of objects.  Returns false if
+  // a write fails.
+  bool Dump(int fd, Format format = Format::kText) const {
+    const std::string text = ToString(Snapshot(), format);
+    for (size_t written = 0; written < text.size();) {
+      const ssize_t n = write(fd, text.data() + written, text.size() - written);
+      if (n < 0) {
+        return false;
+      }
+      written += n;
+    }
+    return true;
+  }
+
+private:
+  TableSampler() = default;
+
+  TableSample *MaybeSampleSlow(int64_t &countdown, size_t value_size) {
+    const size_t rate = sample_rate();
+    if (rate == 0) {
+      // Check the rate again at the next table.
+      countdown = 1;
+      return nullptr;
+    }
+    if (countdown < 0) {
+      // The thread's first table: start the countdown.
+      countdown = NextCountdown(rate);
+      if (--countdown > 0) {
+        return nullptr;
+      }
+    }
+    countdown = NextCountdown(rate);
+    return Register(value_size);
+  }
+
+  // Returns a random countdown whose mean is `rate`.
+  static int64_t NextCountdown(size_t rate) {
+    thread_local uint64_t state =
+        TableSample::NowNanoseconds() ^
+        reinterpret_cast<uintptr_t>(&state) ^ 0x9E3779B97F4A7C15ull;
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return 1 + static_cast<int64_t>(state % (2 * rate - 1));
+  }
+
+  TableSample *Register(size_t value_size) {
+    TableSample *head = head_.load(std::memory_order_acquire);
+    for (TableSample *sample = head; sample != nullptr;
+         sample = sample->next_) {
+      int expected = TableSample::kFree;
+      if (sample->state_.compare_exchange_strong(expected,
+                                                 TableSample::kClaimed,
+                                                 std::memory_order_acquire)) {
+        sample->Reset(value_size);
+        sample->state_.store(TableSample::kLive, std::memory_order_release);
+        return sample;
+      }
+    }
+    TableSample *sample = new TableSample();
+    sample->Reset(value_size);
+    sample->state_.store(TableSample::kLive, std::memory_order_relaxed);
+    do {
+      sample->next_ = head;
+    } while (!head_.compare_exchange_weak(head, sample,
+                                          std::memory_order_release,
+                                          std::memory_order_acquire));
+    return sample;
+  }
+
+  static std::string ToString(const std::vector<TableSampleSnapshot> &snapshots,
+                             Format format) {
+    std::string out;
+    char buffer[512];
+    if (format == Format::kJson) {
+      out += "[";
+    }
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+      const TableSampleSnapshot &s = snapshots[i];
+      std::string history;
+      for (size_t capacity : s.rehash_history) {
+        if (!history.empty()) {
+          history += format == Format::kJson ? "," : " ";
+        }
+        history += std::to_string(capacity);
+      }
+      if (format == Format::kJson) {
+        snprintf(buffer, sizeof(buffer),
+                 "%s\n {\"value_size\": %zu, \"age_ns\": %llu, \"size\": %zu, "
+                 "\"max_size\": %zu, \"capacity\": %zu, \"load\": %.4f, "
+                 "\"allocated_bytes\": %zu, \"inserts\": %llu, "
+                 "\"average_insert_probe_length\": %.4f, "
+                 "\"max_insert_probe_length\": %zu, "
+                 "\"successful_probe_length\": %.4f, "
+                 "\"unsuccessful_probe_length\": %.4f, \"rehashes\": %llu, "
+                 "\"rehash_ns\": %llu, \"rehash_history\": [",
+                 i == 0 ? "" : ",", s.value_size,
+                 static_cast<unsigned long long>(s.age_nanoseconds), s.size,
+                 s.max_size, s.capacity, s.load(), s.allocated_bytes,
+                 static_cast<unsigned long long>(s.inserts),
+                 s.average_insert_probe_length(), s.max_insert_probe_length,
+                 s.successful_probe_length, s.unsuccessful_probe_length,
+                 static_cast<unsigned long long>(s.rehashes),
+                 static_cast<unsigned long long>(s.rehash_nanoseconds));
+        out += buffer;
+        out += history;
+        out += "]}";
+      } else {
+        snprintf(buffer, sizeof(buffer),
+                 "value_size=%zu age_ns=%llu size=%zu max_size=%zu "
+                 "capacity=%zu load=%.4f allocated_bytes=%zu inserts=%llu "
+                 "average_insert_probe_length=%.4f "
+                 "max_insert_probe_length=%zu successful_probe_length=%.4f "
+                 "unsuccessful_probe_length=%.4f rehashes=%llu "
+                 "rehash_ns=%llu rehash_history=[",
+                 s.value_size,
+                 static_cast<unsigned long long>(s.age_nanoseconds), s.size,
+                 s.max_size, s.capacity, s.load(), s.allocated_bytes,
+                 static_cast<unsigned long long>(s.inserts),
+                 s.average_insert_probe_length(), s.max_insert_probe_length,
+                 s.successful_probe_length, s.unsuccessful_probe_length,
+                 static_cast<unsigned long long>(s.rehashes),
+                 static_cast<unsigned long long>(s.rehash_nanoseconds));
+        out += buffer;
+        out += history;
+        out += "]\n";
+      }
+    }
+    if (format == Format::kJson) {
+      out += "\n]\n";
+    }
+    return out;
+  }
+
+  std::atomic<size_t> rate_{kDefaultSampleRate};
+  // The list of all the samples, live and free.
+  std::atomic<TableSample *> head_{nullptr};
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_SAMPLER_H_
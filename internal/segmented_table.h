@@ -0,0 +1,314 @@
+#ifndef _GRAVEYARD_INTERNAL_SEGMENTED_TABLE_H_
+#define _GRAVEYARD_INTERNAL_SEGMENTED_TABLE_H_
+
+// A hash table made of bounded segments, with extendible hashing, for
+// tables so big that a rehash that doubles the memory for a while (even
+// a deamortized one) is too much.  A directory of `2^global_depth()`
+// entries, indexed by the top bits of the hash, points to segments,
+// each a graveyard `HashTable` of at most about `max_segment_size`
+// values.  A segment of depth `d` holds the values whose hashes start
+// with the same `d` bits, and `2^(global_depth() - d)` adjacent
+// directory entries point to it.
+//
+// A segment grows (rehashes) on its own until it reaches the maximum
+// size, and then it splits in two, on the next bit of the hash (doubling
+// the directory if the segment's depth was already the global depth).
+// Since the values of a segment are in hash order, the split is a
+// linear pass: the values of the lower half come first, and both halves
+// are written in hash order, just as a rehash writes them (see
+// `HashTable::SplitFrom`).  So growth never needs more than about one
+// segment of extra memory, and a lookup costs one more indirection (the
+// directory entry) than it does in a `HashTable`.
+//
+// Each segment hashes with the top `d` bits of the hash shifted out, so
+// that its preferred buckets (which are chosen by the high bits of the
+// hash) span all its buckets.  H2 (the low bits) is left alone.
+//
+// The hash should be well mixed in its high bits, as it is for the
+// default hasher and `MixHash`.  A full segment whose values would all
+// go to one half doesn't split (which would just make an empty segment
+// and double the directory): it grows instead, and tries again when
+// it has doubled.  Neither does a segment split past `MaxDepth()`,
+// which keeps the directory within a small factor of the number of
+// segments the values need.  (So with a hash whose high bits are
+// poorly mixed, the table works, but with fewer, bigger segments.)
+
+#include <algorithm> // for min
+#include <cassert>
+#include <cstddef> // for size_t
+#include <memory>  // for unique_ptr
+#include <utility> // for pair
+#include <vector>
+
+#include "absl/log/check.h"
+#include "internal/hash_table.h"
+
+namespace yobiduck::internal {
+
+template <class Traits> class SegmentedTable {
+public:
+  using key_type = typename Traits::key_type;
+  using value_type = typename Traits::value_type;
+  using hasher = typename Traits::hasher;
+  using key_equal = typename Traits::key_equal;
+  // A `value_type *` for a map, and a `const value_type *` for a set.
+  using pointer = typename Traits::iterator_pointer_type;
+  using const_pointer = const value_type *;
+
+  static constexpr size_t kDefaultMaxSegmentSize = size_t{1} << 16;
+
+  explicit SegmentedTable(size_t max_segment_size = kDefaultMaxSegmentSize,
+                          const hasher &hash = hasher(),
+                          const key_equal &key_eq = key_equal())
+      : hash_(hash), key_eq_(key_eq), max_segment_size_(max_segment_size) {
+    clear();
+  }
+  SegmentedTable(const SegmentedTable &) = delete;
+  SegmentedTable &operator=(const SegmentedTable &) = delete;
+
+  // Inserts `value` if its key isn't present.  Returns a pointer to the
+  // value with the key, and true if it inserted.
+  std::pair<pointer, bool> insert(const value_type &value) {
+    const key_type &key = Traits::KeyOf(value);
+    const size_t hash = hash_(key);
+    while (true) {
+      Segment &segment = SegmentOf(hash);
+      const size_t segment_hash = SegmentHash(hash, segment.depth);
+      if (segment.table.size() >= segment.split_size) {
+        auto it = segment.table.find(key, segment_hash);
+        if (it != segment.table.end()) {
+          return {&*it, false};
+        }
+        if (CanSplit(segment)) {
+          Split(segment, hash);
+          continue;
+        }
+        segment.split_size = 2 * segment.table.size();
+      }
+      auto [it, inserted] = segment.table.insert(value, segment_hash);
+      size_ += inserted;
+      return {&*it, inserted};
+    }
+  }
+
+  // Returns a pointer to the value with `key`, or null.
+  pointer find(const key_type &key) {
+    const size_t hash = hash_(key);
+    Segment &segment = SegmentOf(hash);
+    auto it = segment.table.find(key, SegmentHash(hash, segment.depth));
+    return it == segment.table.end() ? nullptr : &*it;
+  }
+  const_pointer find(const key_type &key) const {
+    const size_t hash = hash_(key);
+    const Segment &segment = SegmentOf(hash);
+    auto it = segment.table.find(key, SegmentHash(hash, segment.depth));
+    return it == segment.table.end() ? nullptr : &*it;
+  }
+
+  bool contains(const key_type &key) const { return find(key) != nullptr; }
+
+  // Segments never merge, so an erase doesn't shrink the directory.
+  size_t erase(const key_type &key) {
+    const size_t hash = hash_(key);
+    Segment &segment = SegmentOf(hash);
+    const size_t erased =
+        segment.table.erase(key, SegmentHash(hash, segment.depth));
+    size_ -= erased;
+    return erased;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Leaves one empty segment.
+  void clear() {
+    size_ = 0;
+    global_depth_ = 0;
+    segments_.clear();
+    segments_.push_back(NewSegment(/*depth=*/0, /*prefix=*/0));
+    directory_.assign(1, segments_.front().get());
+  }
+
+  int global_depth() const { return global_depth_; }
+  size_t segment_count() const { return segments_.size(); }
+  size_t max_segment_size() const { return max_segment_size_; }
+
+  // Calls `f(value)` on every value, a segment at a time (see
+  // `HashTable::for_each`).
+  template <class F> void for_each(F &&f) {
+    for (std::unique_ptr<Segment> &segment : segments_) {
+      segment->table.for_each(f);
+    }
+  }
+  template <class F> void for_each(F &&f) const {
+    for (const std::unique_ptr<Segment> &segment : segments_) {
+      std::as_const(segment->table).for_each(f);
+    }
+  }
+
+  // The memory allocated by the directory and the segments (not
+  // including `*this`).
+  size_t GetAllocatedMemorySize() const {
+    size_t bytes = directory_.capacity() * sizeof(Segment *) +
+                   segments_.capacity() * sizeof(std::unique_ptr<Segment>);
+    for (const std::unique_ptr<Segment> &segment : segments_) {
+      bytes += sizeof(Segment) + segment->table.GetAllocatedMemorySize();
+    }
+    return bytes;
+  }
+
+  // Checks the directory and every segment.
+  void Validate() const {
+    size_t size = 0;
+    for (const std::unique_ptr<Segment> &segment : segments_) {
+      CHECK_LE(segment->depth, global_depth_);
+      const size_t span = size_t{1} << (global_depth_ - segment->depth);
+      const size_t first = segment->prefix * span;
+      for (size_t i = 0; i < directory_.size(); ++i) {
+        CHECK_EQ(directory_[i] == segment.get(), i >= first && i < first + span)
+            << "directory entry " << i;
+      }
+      segment->table.Validate();
+      segment->table.for_each([&](const value_type &value) {
+        CHECK_EQ(Prefix(hash_(Traits::KeyOf(value)), segment->depth),
+                 segment->prefix);
+      });
+      size += segment->table.size();
+    }
+    CHECK_EQ(size, size_);
+  }
+
+private:
+  // How many more bits than the values need the directory may index.
+  static constexpr int kDepthSlack = 4;
+
+  // The bits of the hash that are H2.
+  static constexpr size_t kH2Mask = Bucket<Traits>::MetaByte::kMaxH2;
+
+  // Returns the hash that a segment of depth `depth` uses: `hash` with
+  // its top `depth` bits (which all the segment's values share) shifted
+  // out of the bits above H2.  The segment hash of a child (of depth
+  // `depth + 1`) is its parent's with the top bit shifted out, so a
+  // split preserves the order.
+  static size_t SegmentHash(size_t hash, int depth) {
+    return ((hash & ~kH2Mask) << depth) | (hash & kH2Mask);
+  }
+
+  // The top `bits` bits of `hash`.
+  static size_t Prefix(size_t hash, int bits) {
+    return bits == 0 ? 0 : hash >> (64 - bits);
+  }
+
+  class SegmentHasher {
+  public:
+    SegmentHasher(const hasher &hash, int depth) : hash_(hash), depth_(depth) {}
+    template <class K> size_t operator()(const K &key) const {
+      return SegmentHash(hash_(key), depth_);
+    }
+
+  private:
+    hasher hash_;
+    int depth_;
+  };
+
+  struct SegmentTraits : public Traits {
+    using hasher = SegmentHasher;
+  };
+
+  struct Segment {
+    Segment(int segment_depth, size_t segment_prefix, size_t max_size,
+            const hasher &hash, const key_equal &key_eq)
+        : depth(segment_depth), prefix(segment_prefix), split_size(max_size),
+          table(0, SegmentHasher(hash, segment_depth), key_eq) {}
+    // The values' hashes all start with the `depth` bits `prefix`.
+    int depth;
+    size_t prefix;
+    // The size at which an insert tries to split the segment.
+    size_t split_size;
+    HashTable<SegmentTraits> table;
+  };
+
+  std::unique_ptr<Segment> NewSegment(int depth, size_t prefix) const {
+    return std::make_unique<Segment>(depth, prefix, max_segment_size_, hash_,
+                                     key_eq_);
+  }
+
+  // The deepest a segment may be: `kDepthSlack` more than the bits of
+  // the number of segments that the values need.
+  int MaxDepth() const {
+    int depth = kDepthSlack;
+    for (size_t segments = size_ / max_segment_size_; segments != 0;
+         segments >>= 1) {
+      ++depth;
+    }
+    return std::min(depth, 63);
+  }
+
+  // Returns true if `segment` may split and both halves would get
+  // values.
+  bool CanSplit(const Segment &segment) const {
+    if (segment.depth >= MaxDepth()) {
+      return false;
+    }
+    const int shift = 63 - segment.depth;
+    size_t upper = 0;
+    segment.table.for_each([&](const value_type &value) {
+      upper += (hash_(Traits::KeyOf(value)) >> shift) & 1;
+    });
+    return upper != 0 && upper != segment.table.size();
+  }
+
+  Segment &SegmentOf(size_t hash) {
+    return *directory_[Prefix(hash, global_depth_)];
+  }
+  const Segment &SegmentOf(size_t hash) const {
+    return *directory_[Prefix(hash, global_depth_)];
+  }
+
+  // Splits `segment` (which holds `hash`) into two segments of one more
+  // depth.
+  void Split(Segment &segment, size_t hash) {
+    const int depth = segment.depth + 1;
+    if (depth > global_depth_) {
+      // Double the directory: each entry becomes two.
+      std::vector<Segment *> directory(directory_.size() * 2);
+      for (size_t i = 0; i < directory.size(); ++i) {
+        directory[i] = directory_[i / 2];
+      }
+      directory_.swap(directory);
+      ++global_depth_;
+    }
+    const size_t prefix = Prefix(hash, segment.depth);
+    std::unique_ptr<Segment> lower = NewSegment(depth, prefix * 2);
+    std::unique_ptr<Segment> upper = NewSegment(depth, prefix * 2 + 1);
+    lower->table.SplitFrom(segment.table, upper->table);
+    // The entries that pointed to `segment` are adjacent: the first
+    // half now point to `lower`, and the second to `upper`.
+    const size_t span = size_t{1} << (global_depth_ - depth);
+    const size_t first = lower->prefix * span;
+    for (size_t i = 0; i < span; ++i) {
+      directory_[first + i] = lower.get();
+      directory_[first + span + i] = upper.get();
+    }
+    for (std::unique_ptr<Segment> &owned : segments_) {
+      if (owned.get() == &segment) {
+        owned = std::move(lower);
+        break;
+      }
+    }
+    segments_.push_back(std::move(upper));
+  }
+
+  hasher hash_;
+  key_equal key_eq_;
+  size_t max_segment_size_;
+  size_t size_ = 0;
+  int global_depth_ = 0;
+  // `2^global_depth_` entries.
+  std::vector<Segment *> directory_;
+  std::vector<std::unique_ptr<Segment>> segments_;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_SEGMENTED_TABLE_H_
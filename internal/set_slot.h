@@ -15,6 +15,10 @@ class SetSlot {
   void Store(StoredType value) {
     new (&u_.value) StoredType(std::move(value));
   }
+  // Constructs the value from `args`.
+  template <class... Args> void Emplace(Args &&...args) {
+    new (&u_.value) StoredType(std::forward<Args>(args)...);
+  }
   void Transfer(SetSlot &from) {
     new (&u_.value) StoredType(std::move(from.u_.value));
     from.Destroy();
@@ -0,0 +1,378 @@
+#ifndef _GRAVEYARD_INTERNAL_SINGLE_WRITER_TABLE_H_
+#define _GRAVEYARD_INTERNAL_SINGLE_WRITER_TABLE_H_
+
+// A `HashTable` with one writer thread and any number of reader threads
+// whose finds take no locks.
+//
+// Readers run the table's normal `find` probe while the writer changes
+// the table, and validate what they read with seqlock-style version
+// counters, one per group of `kGroupBuckets` buckets.  The writer makes
+// the counters of the groups that an insert or erase touches odd before
+// it changes them, and even again after.  A reader reads the counters of
+// the groups its probe covers before and after the probe, and retries
+// if any was odd or changed.  So a reader waits only for a write to its
+// own few buckets.
+//
+// The table never rehashes in place.  When an insert would grow it (or
+// finds no free slot within reach), the writer copies the table into a
+// bigger one (see `HashTable::AssignRehashedCopy`), inserts there, and
+// publishes the new table with one atomic pointer exchange.  Readers
+// that started on the old table finish on it, so a reader never waits
+// for a rehash.  The old table is freed once no reader can be using it,
+// using epoch-based reclamation: each reader announces the epoch it
+// started in, the writer advances the epoch at every exchange, and a
+// table retired in epoch `e` is freed when no reader announces an epoch
+// of `e` or earlier.
+//
+// Readers copy values out (they can't hold references, since the writer
+// may change the value), and may see a torn value before they retry, so
+// the keys and values must be trivially copyable.  Each reader thread
+// uses its own `Reader`, which must be destroyed before the table.
+
+#include <algorithm> // for max
+#include <atomic>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint64_t
+#include <cstring> // for memcpy
+#include <memory>  // for unique_ptr
+#include <thread>  // for yield
+#include <type_traits>
+#include <vector>
+
+#include "internal/hash_table.h"
+
+namespace yobiduck::internal {
+
+template <class Traits> class SingleWriterTable {
+  using Table = HashTable<Traits>;
+  static_assert(std::is_trivially_copyable_v<typename Traits::key_type>);
+  static_assert(!Traits::is_map ||
+                std::is_trivially_copyable_v<
+                    typename Traits::mapped_type_or_void>);
+  // These change a table in place behind the readers' backs.
+  static_assert(Traits::kInlineCapacity == 0);
+  static_assert(!Traits::kHashWatchdog);
+
+public:
+  using key_type = typename Traits::key_type;
+  using value_type = typename Traits::value_type;
+  // What `Reader::find` copies out: the mapped value, or for a set the
+  // key.
+  using found_type =
+      std::conditional_t<Traits::is_map, typename Traits::mapped_type_or_void,
+                         key_type>;
+
+  // The buckets covered by one version counter.
+  static constexpr size_t kGroupBuckets = 16;
+
+  class Reader;
+
+  SingleWriterTable() : current_(new Snapshot()) {}
+  SingleWriterTable(const SingleWriterTable &) = delete;
+  SingleWriterTable &operator=(const SingleWriterTable &) = delete;
+  // Requires: all the `Reader`s have been destroyed.
+  ~SingleWriterTable() {
+    delete current_.load(std::memory_order_relaxed);
+    for (const Retired &retired : retired_) {
+      delete retired.snapshot;
+    }
+    for (ReaderSlot *slot = slots_.load(std::memory_order_relaxed);
+         slot != nullptr;) {
+      ReaderSlot *next = slot->next;
+      delete slot;
+      slot = next;
+    }
+  }
+
+  // Returns a reader for the calling thread.  Thread safe.
+  Reader NewReader();
+
+  // The rest are for the writer thread only.
+
+  size_t size() const { return writer_table().size(); }
+  bool empty() const { return size() == 0; }
+  bool contains(const key_type &key) const {
+    return writer_table().contains(key);
+  }
+  const Table &table() const { return writer_table(); }
+
+  // Inserts `value` if its key isn't present.  Returns true if it
+  // inserted.
+  bool insert(const value_type &value);
+
+  // Erases the value whose key is `key`.  Returns the number erased.
+  size_t erase(const key_type &key);
+
+  // The number of old tables not yet freed.
+  size_t retired_count() const { return retired_.size(); }
+
+  // Frees the old tables that no reader can be using.
+  void Reclaim();
+
+private:
+  // A table and its version counters.
+  struct Snapshot {
+    Snapshot() = default;
+    // Makes the counters for `table`, all zero.
+    void InitVersions() {
+      const size_t groups =
+          (table.capacity() / Traits::kSlotsPerBucket + kGroupBuckets - 1) /
+          kGroupBuckets;
+      versions = std::make_unique<std::atomic<uint64_t>[]>(groups);
+      for (size_t i = 0; i < groups; ++i) {
+        versions[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    Table table;
+    std::unique_ptr<std::atomic<uint64_t>[]> versions;
+  };
+
+  // A reader's announcement of the epoch it's reading in (0 if it
+  // isn't reading).  On its own cache line.  Slots are reused, and freed
+  // with the table.
+  struct alignas(Traits::kCacheLineSize) ReaderSlot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{true};
+    ReaderSlot *next = nullptr;
+  };
+
+  struct Retired {
+    Snapshot *snapshot;
+    uint64_t epoch;
+  };
+
+  const Table &writer_table() const {
+    return current_.load(std::memory_order_relaxed)->table;
+  }
+
+  // Makes the counters of the groups of buckets `[first, last]` odd.
+  static void BeginWrite(Snapshot &snapshot, size_t first, size_t last) {
+    for (size_t g = first / kGroupBuckets; g <= last / kGroupBuckets; ++g) {
+      snapshot.versions[g].store(
+          snapshot.versions[g].load(std::memory_order_relaxed) + 1,
+          std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+  // Makes them even again.
+  static void EndWrite(Snapshot &snapshot, size_t first, size_t last) {
+    for (size_t g = first / kGroupBuckets; g <= last / kGroupBuckets; ++g) {
+      snapshot.versions[g].store(
+          snapshot.versions[g].load(std::memory_order_relaxed) + 1,
+          std::memory_order_release);
+    }
+  }
+
+  // Inserts `value` into a copy of the table big enough for it, and
+  // publishes the copy.
+  void GrowAndInsert(const value_type &value, size_t hash);
+
+  std::atomic<Snapshot *> current_;
+  std::atomic<uint64_t> epoch_{1};
+  std::atomic<ReaderSlot *> slots_{nullptr};
+  std::vector<Retired> retired_;
+};
+
+template <class Traits> class SingleWriterTable<Traits>::Reader {
+public:
+  Reader(Reader &&other) : table_(other.table_), slot_(other.slot_) {
+    other.slot_ = nullptr;
+  }
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+  ~Reader() {
+    if (slot_ != nullptr) {
+      slot_->in_use.store(false, std::memory_order_release);
+    }
+  }
+
+  bool contains(const key_type &key) const {
+    return Find(key, [](const auto &) {});
+  }
+
+  // If `key` is present, copies its value (for a map, its mapped value)
+  // into `*value` and returns true.
+  bool find(const key_type &key, found_type *value) const {
+    using V = found_type;
+    // Copied into a buffer first, since an attempt that's retried may
+    // copy a torn value.
+    alignas(V) unsigned char buffer[sizeof(V)];
+    const bool found = Find(key, [&buffer](const auto &found_value) {
+      if constexpr (Traits::is_map) {
+        std::memcpy(buffer, &found_value.second, sizeof(V));
+      } else {
+        std::memcpy(buffer, &found_value, sizeof(V));
+      }
+    });
+    if (found) {
+      std::memcpy(value, buffer, sizeof(V));
+    }
+    return found;
+  }
+
+private:
+  friend class SingleWriterTable;
+  Reader(const SingleWriterTable &table, ReaderSlot *slot)
+      : table_(table), slot_(slot) {}
+
+  // The most groups that a find can cover.
+  static constexpr size_t kMaxGroups =
+      (Traits::kSearchDistanceEndSentinal + kGroupBuckets - 1) /
+          kGroupBuckets +
+      1;
+
+  // Calls `copy(value)` with a value that's consistent by the time
+  // `Find` returns (a torn value may be passed first).
+  template <class Copy> bool Find(const key_type &key, Copy copy) const {
+    slot_->epoch.store(table_.epoch_.load(std::memory_order_seq_cst),
+                       std::memory_order_seq_cst);
+    bool found;
+    for (;;) {
+      const Snapshot *snapshot =
+          table_.current_.load(std::memory_order_seq_cst);
+      const Table &table = snapshot->table;
+      if (table.capacity() == 0) {
+        found = false;
+        break;
+      }
+      const size_t hash = table.hash_function()(key);
+      const size_t bucket = table.PreferredBucket(hash);
+      const size_t first = bucket / kGroupBuckets;
+      uint64_t versions[kMaxGroups];
+      versions[0] = snapshot->versions[first].load(std::memory_order_acquire);
+      // A torn search distance is caught by the first group's version.
+      const size_t distance = std::max<size_t>(table.SearchDistance(bucket), 1);
+      const size_t groups = (bucket + distance - 1) / kGroupBuckets - first + 1;
+      bool odd = versions[0] % 2 == 1;
+      for (size_t g = 1; g < groups; ++g) {
+        versions[g] =
+            snapshot->versions[first + g].load(std::memory_order_acquire);
+        odd |= versions[g] % 2 == 1;
+      }
+      if (odd) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto it = table.find(key, hash);
+      found = it != table.end();
+      if (found) {
+        copy(*it);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      bool changed = false;
+      for (size_t g = 0; g < groups; ++g) {
+        changed |= snapshot->versions[first + g].load(
+                       std::memory_order_relaxed) != versions[g];
+      }
+      if (!changed) {
+        break;
+      }
+    }
+    slot_->epoch.store(0, std::memory_order_release);
+    return found;
+  }
+
+  const SingleWriterTable &table_;
+  ReaderSlot *slot_;
+};
+
+template <class Traits>
+typename SingleWriterTable<Traits>::Reader SingleWriterTable<Traits>::NewReader() {
+  ReaderSlot *head = slots_.load(std::memory_order_acquire);
+  for (ReaderSlot *slot = head; slot != nullptr; slot = slot->next) {
+    bool expected = false;
+    if (slot->in_use.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      return Reader(*this, slot);
+    }
+  }
+  ReaderSlot *slot = new ReaderSlot();
+  do {
+    slot->next = head;
+  } while (!slots_.compare_exchange_weak(head, slot, std::memory_order_release,
+                                         std::memory_order_acquire));
+  return Reader(*this, slot);
+}
+
+template <class Traits>
+bool SingleWriterTable<Traits>::insert(const value_type &value) {
+  Reclaim();
+  Snapshot &snapshot = *current_.load(std::memory_order_relaxed);
+  Table &table = snapshot.table;
+  const size_t hash = table.hash_function()(Traits::KeyOf(value));
+  if (table.contains(Traits::KeyOf(value), hash)) {
+    return false;
+  }
+  if (table.capacity() == 0 || table.WouldGrow(1)) {
+    GrowAndInsert(value, hash);
+    return true;
+  }
+  const size_t bucket = table.PreferredBucket(hash);
+  const size_t insert_bucket = table.InsertBucket(bucket);
+  if (insert_bucket == table.capacity() / Traits::kSlotsPerBucket) {
+    GrowAndInsert(value, hash);
+    return true;
+  }
+  BeginWrite(snapshot, bucket, insert_bucket);
+  table.insert(value, hash);
+  EndWrite(snapshot, bucket, insert_bucket);
+  return true;
+}
+
+template <class Traits>
+size_t SingleWriterTable<Traits>::erase(const key_type &key) {
+  Reclaim();
+  Snapshot &snapshot = *current_.load(std::memory_order_relaxed);
+  Table &table = snapshot.table;
+  auto it = table.find(key);
+  if (it == table.end()) {
+    return 0;
+  }
+  const size_t bucket = table.BucketNumber(it);
+  BeginWrite(snapshot, bucket, bucket);
+  // Not `erase(key)`, which may shrink the table in place.
+  table.erase(it);
+  EndWrite(snapshot, bucket, bucket);
+  return 1;
+}
+
+template <class Traits>
+void SingleWriterTable<Traits>::GrowAndInsert(const value_type &value,
+                                              size_t hash) {
+  Snapshot *old = current_.load(std::memory_order_relaxed);
+  auto next = std::make_unique<Snapshot>();
+  next->table.AssignRehashedCopy(old->table, old->table.size() + 1, nullptr);
+  next->table.insert(value, hash);
+  next->InitVersions();
+  current_.store(next.release(), std::memory_order_seq_cst);
+  retired_.push_back({old, epoch_.fetch_add(1, std::memory_order_seq_cst)});
+}
+
+template <class Traits> void SingleWriterTable<Traits>::Reclaim() {
+  if (retired_.empty()) {
+    return;
+  }
+  // The oldest epoch that a reader might still be reading in.
+  uint64_t oldest = epoch_.load(std::memory_order_seq_cst);
+  for (ReaderSlot *slot = slots_.load(std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    const uint64_t epoch = slot->epoch.load(std::memory_order_seq_cst);
+    if (epoch != 0 && epoch < oldest) {
+      oldest = epoch;
+    }
+  }
+  size_t kept = 0;
+  for (const Retired &retired : retired_) {
+    if (retired.epoch < oldest) {
+      delete retired.snapshot;
+    } else {
+      retired_[kept++] = retired;
+    }
+  }
+  retired_.resize(kept);
+}
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_SINGLE_WRITER_TABLE_H_
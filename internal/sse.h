@@ -10,9 +10,20 @@
 #define YOBIDUCK_HAVE_SSE2 0
 #endif
 
+// The vectorized `contains_many` needs 64-bit multiplies (DQ), byte
+// compares into masks (BW) and leading-zero counts (CD).
+#if defined(__AVX512F__) && defined(__AVX512BW__) && defined(__AVX512DQ__) && \
+    defined(__AVX512CD__)
+#define YOBIDUCK_HAVE_AVX512 1
+#include <immintrin.h>
+#else
+#define YOBIDUCK_HAVE_AVX512 0
+#endif
+
 namespace yobiduck::internal {
 
 static constexpr bool kHaveSse2 = (YOBIDUCK_HAVE_SSE2 != 0);
+static constexpr bool kHaveAvx512 = (YOBIDUCK_HAVE_AVX512 != 0);
 
 } // namespace yobiduck::internal
 
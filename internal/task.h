@@ -0,0 +1,242 @@
+#ifndef _GRAVEYARD_INTERNAL_TASK_H_
+#define _GRAVEYARD_INTERNAL_TASK_H_
+
+// A minimal lazy coroutine type and a round-robin scheduler, for
+// interleaving independent lookups so that their cache misses
+// overlap.  Requires C++20 coroutines; empty otherwise.
+
+#if defined(__cpp_impl_coroutine)
+
+#include <array>
+#include <cassert>
+#include <coroutine>
+#include <cstddef> // for size_t
+#include <exception>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace yobiduck::internal {
+
+template <class T> class Task;
+
+// State shared by the promises of all the tasks of one chain of
+// `co_await`s.  Points to the innermost task of the chain (the one to
+// resume next) which is stored in the outermost task's promise.
+class TaskPromiseBase {
+public:
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  // Resumes the awaiting task (if any) directly.
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <class Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      TaskPromiseBase &promise = handle.promise();
+      if (!promise.continuation_) {
+        return std::noop_coroutine();
+      }
+      *promise.leaf_ = promise.continuation_;
+      return promise.continuation_;
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { exception_ = std::current_exception(); }
+
+  // `RunInterleaved` creates a coroutine frame per task, so frames are
+  // recycled through a per-thread free list for each size class.
+  static void *operator new(size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class < kSizeClasses) {
+      FreeFrame *&free_list = FreeLists()[size_class];
+      if (free_list != nullptr) {
+        return std::exchange(free_list, free_list->next);
+      }
+      return ::operator new((size_class + 1) * kSizeClassBytes);
+    }
+    return ::operator new(size);
+  }
+  static void operator delete(void *frame, size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class < kSizeClasses) {
+      FreeFrame *&free_list = FreeLists()[size_class];
+      free_list = new (frame) FreeFrame{free_list};
+      return;
+    }
+    ::operator delete(frame);
+  }
+
+protected:
+  void RethrowIfFailed() const {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+
+private:
+  template <class T> friend class Task;
+
+  static constexpr size_t kSizeClassBytes = 64;
+  static constexpr size_t kSizeClasses = 16;
+  struct FreeFrame {
+    FreeFrame *next;
+  };
+  static size_t SizeClass(size_t size) {
+    return (size - 1) / kSizeClassBytes;
+  }
+  // The frames are never returned to the system.  Their number is
+  // bounded by the most tasks alive at once in the thread.
+  static std::array<FreeFrame *, kSizeClasses> &FreeLists() {
+    static thread_local std::array<FreeFrame *, kSizeClasses> free_lists{};
+    return free_lists;
+  }
+
+  // The task awaiting this one, if any.
+  std::coroutine_handle<> continuation_;
+  // The innermost task of the chain.  Points at `own_leaf_` of the
+  // outermost task.
+  std::coroutine_handle<> *leaf_ = &own_leaf_;
+  std::coroutine_handle<> own_leaf_;
+  std::exception_ptr exception_;
+};
+
+template <class T> class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object() noexcept;
+  template <class U> void return_value(U &&value) {
+    value_.emplace(std::forward<U>(value));
+  }
+  T TakeValue() {
+    RethrowIfFailed();
+    assert(value_.has_value());
+    return std::move(*value_);
+  }
+
+private:
+  std::optional<T> value_;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object() noexcept;
+  void return_void() noexcept {}
+  void TakeValue() const { RethrowIfFailed(); }
+};
+
+// A coroutine that starts when it is awaited by another task or run
+// by `RunInterleaved`.  A task that suspends (e.g., on
+// `std::suspend_always` after issuing a prefetch) returns control to
+// the scheduler along with all the tasks awaiting it.
+template <class T> class Task {
+public:
+  using promise_type = TaskPromise<T>;
+
+  Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      Destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  ~Task() { Destroy(); }
+
+  // Awaiting a task runs it until it completes or suspends.
+  bool await_ready() const noexcept { return false; }
+  template <class Promise>
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<Promise> awaiting) noexcept {
+    TaskPromiseBase &promise = handle_.promise();
+    promise.continuation_ = awaiting;
+    promise.leaf_ = awaiting.promise().leaf_;
+    *promise.leaf_ = handle_;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().TakeValue(); }
+
+  // Runs the task (which must be the outermost of its chain) until it
+  // next suspends.  Returns true if it has completed.
+  bool Step() {
+    std::coroutine_handle<> leaf = handle_.promise().own_leaf_;
+    (leaf ? leaf : std::coroutine_handle<>(handle_)).resume();
+    return handle_.done();
+  }
+  // Requires: `Step()` returned true.
+  T Result() { return handle_.promise().TakeValue(); }
+
+private:
+  friend class TaskPromise<T>;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  void Destroy() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <class T> Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(std::coroutine_handle<TaskPromise>::from_promise(*this));
+}
+
+// Runs the tasks `make_task(i)` for `i` in `[0, n)`, keeping up to
+// `width` of them in flight.  Steps the in-flight tasks round-robin,
+// so while one task waits on a prefetch the others run.  Calls
+// `done(i, result)` (or `done(i)` for `Task<void>`) as each task
+// completes.
+template <class MakeTask, class Done>
+void RunInterleaved(size_t n, size_t width, MakeTask make_task, Done done) {
+  using TaskType = decltype(make_task(size_t{0}));
+  struct InFlight {
+    size_t index;
+    TaskType task;
+  };
+  assert(width > 0);
+  std::vector<InFlight> in_flight;
+  in_flight.reserve(width);
+  size_t next = 0;
+  for (; next < n && next < width; ++next) {
+    in_flight.push_back({next, make_task(next)});
+  }
+  while (!in_flight.empty()) {
+    for (size_t i = 0; i < in_flight.size();) {
+      InFlight &flight = in_flight[i];
+      if (!flight.task.Step()) {
+        ++i;
+        continue;
+      }
+      if constexpr (std::is_void_v<decltype(flight.task.Result())>) {
+        flight.task.Result();
+        done(flight.index);
+      } else {
+        done(flight.index, flight.task.Result());
+      }
+      if (next < n) {
+        flight.index = next;
+        flight.task = make_task(next);
+        ++next;
+        ++i;
+      } else {
+        flight = std::move(in_flight.back());
+        in_flight.pop_back();
+      }
+    }
+  }
+}
+
+} // namespace yobiduck::internal
+
+#endif // defined(__cpp_impl_coroutine)
+
+#endif // _GRAVEYARD_INTERNAL_TASK_H_
@@ -0,0 +1,109 @@
+#ifndef _GRAVEYARD_INTERNAL_WORK_STEALING_H_
+#define _GRAVEYARD_INTERNAL_WORK_STEALING_H_
+
+// Hands out the chunks `[0, chunk_count)` of a job to a fixed number of
+// workers.  Each worker starts with an equal, contiguous share of the
+// chunks and takes them one at a time from the front of its range, so
+// that a worker's chunks are adjacent in memory.  A worker whose range
+// runs out steals the back half of the largest range left, so that a
+// worker that got slow chunks (or was descheduled) doesn't hold up the
+// others.
+//
+// Each range is a `(begin, end)` pair packed into one atomic word, which
+// the owner advances and thieves shrink with compare-and-swaps.  Only
+// the owner stores into its range once it's empty, and a range never
+// grows back to a value it had before, so the compare-and-swaps can't
+// be fooled by a range that was emptied and refilled.
+
+#include <atomic>
+#include <cassert>
+#include <cstddef> // for size_t
+#include <cstdint> // for uint32_t, uint64_t
+#include <limits>
+#include <vector>
+
+namespace yobiduck::internal {
+
+class WorkStealingRanges {
+public:
+  WorkStealingRanges(size_t chunk_count, size_t worker_count)
+      : ranges_(worker_count) {
+    assert(worker_count > 0);
+    assert(chunk_count <= std::numeric_limits<uint32_t>::max());
+    for (size_t w = 0; w < worker_count; ++w) {
+      ranges_[w].packed.store(Pack(chunk_count * w / worker_count,
+                                   chunk_count * (w + 1) / worker_count),
+                              std::memory_order_relaxed);
+    }
+  }
+
+  // Sets `chunk` to the next chunk for worker `worker` and returns true,
+  // or returns false if every chunk has been handed out.
+  bool Next(size_t worker, size_t &chunk) {
+    std::atomic<uint64_t> &own = ranges_[worker].packed;
+    uint64_t packed = own.load(std::memory_order_relaxed);
+    while (Begin(packed) < End(packed)) {
+      if (own.compare_exchange_weak(packed,
+                                    Pack(Begin(packed) + 1, End(packed)),
+                                    std::memory_order_relaxed)) {
+        chunk = Begin(packed);
+        return true;
+      }
+    }
+    return Steal(worker, chunk);
+  }
+
+private:
+  // Takes the back half of the largest range of another worker, keeps
+  // its first chunk in `chunk`, and makes the rest worker `worker`'s
+  // range.
+  bool Steal(size_t worker, size_t &chunk) {
+    while (true) {
+      size_t victim = ranges_.size();
+      uint64_t victim_packed = 0;
+      for (size_t w = 0; w < ranges_.size(); ++w) {
+        if (w == worker) {
+          continue;
+        }
+        uint64_t packed = ranges_[w].packed.load(std::memory_order_relaxed);
+        if (Remaining(packed) > Remaining(victim_packed)) {
+          victim = w;
+          victim_packed = packed;
+        }
+      }
+      if (victim == ranges_.size()) {
+        return false;
+      }
+      const uint32_t begin = Begin(victim_packed);
+      const uint32_t end = End(victim_packed);
+      const uint32_t middle = begin + (end - begin) / 2;
+      if (ranges_[victim].packed.compare_exchange_strong(
+              victim_packed, Pack(begin, middle), std::memory_order_relaxed)) {
+        chunk = middle;
+        ranges_[worker].packed.store(Pack(middle + 1, end),
+                                     std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+
+  static uint64_t Pack(uint64_t begin, uint64_t end) {
+    return (begin << 32) | end;
+  }
+  static uint32_t Begin(uint64_t packed) { return packed >> 32; }
+  static uint32_t End(uint64_t packed) { return packed; }
+  static uint32_t Remaining(uint64_t packed) {
+    return End(packed) - Begin(packed);
+  }
+
+  // Each worker's range gets its own cache line, since the owner
+  // updates it for every chunk.
+  struct alignas(64) Range {
+    std::atomic<uint64_t> packed;
+  };
+  std::vector<Range> ranges_;
+};
+
+} // namespace yobiduck::internal
+
+#endif // _GRAVEYARD_INTERNAL_WORK_STEALING_H_